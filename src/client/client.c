@@ -47,13 +47,16 @@ Side player_1_side = 0;
 Side player_2_side = 0;
 Side winning_side;
 GameSnapshot current_game_snapshot;
+int32_t game_sequence = -1; // sequence of the last move applied to current_game_snapshot, -1 if unknown
+char is_waiting_for_snapshot = 0;
 int spectator_count = 0;
 
-// USER LIST
+// USER LIST (grown on demand, see reserveUserList)
 int users_list_count = 0;
-char users_list_buf[MAX_CLIENTS][USERNAME_LENGTH];
-int32_t users_list_id[MAX_CLIENTS];
-char users_list_status[MAX_CLIENTS];
+int users_list_capacity = 0;
+char (*users_list_buf)[USERNAME_LENGTH] = NULL;
+int32_t* users_list_id = NULL;
+char* users_list_status = NULL;
 
 // BUTTONS
 char game_request_selected_field = 0; // Game request popup
@@ -76,6 +79,7 @@ int main(int argc, char **argv) {
     int port = atoi(argv[2]);
     const char *server_ip = argv[1];
     connect_to_server(server_ip, port, &sock, &srv);
+    negotiate_protocol();
 
     initApplication();
 
@@ -131,7 +135,7 @@ void frameContent(GridCharBuffer* gcbuf) {
         int i = 0;
         int row = 4;
         int col = 7;
-        if (users_list_status[selected_field])
+        if (users_list_count > 0 && users_list_status[selected_field])
             drawText(gcbuf, BOTTOM_CENTER, -3, 0, "!{u}Retour Arr.!{r}: Retour | !{u}Entrée!{r}: Regarder");
         else
             drawText(gcbuf, BOTTOM_CENTER, -3, 0, "!{u}Retour Arr.!{r}: Retour | !{u}Entrée!{r}: Inviter");
@@ -300,7 +304,9 @@ void frameContent(GridCharBuffer* gcbuf) {
         TextStyle faint_style = { mkStyleFlags(1, FAINT), 0, 0 };
 
         if (player_1.id == connected_user.id) {
-            if (winning_side==player_1_side)
+            if (winning_side==NO_SIDE)
+                drawPopup(gcbuf, CENTER, -10, 0, NO_STYLE, 13, 1, "Égalité");
+            else if (winning_side==player_1_side)
                 drawPopup(gcbuf, CENTER, -10, 0, NO_STYLE, 13, 1, "Victoire !");
             else
                 drawPopup(gcbuf, CENTER, -10, 0, NO_STYLE, 13, 1, "Défaite :(");
@@ -318,7 +324,9 @@ void frameContent(GridCharBuffer* gcbuf) {
             drawButton(gcbuf, BOTTOM_CENTER, -3, 0, "Retourner à l'accueil", 13, 1);
         } 
         else {
-            if (winning_side==player_1_side)
+            if (winning_side==NO_SIDE)
+                sprintf(general_display_buf, "Égalité");
+            else if (winning_side==player_1_side)
                 sprintf(general_display_buf, "Victoire de !{u}%s #%d", player_1.username, player_1.id);
             else
                 sprintf(general_display_buf, "Victoire de !{u}%s #%d", player_2.username, player_2.id);
@@ -376,6 +384,8 @@ void frameContent(GridCharBuffer* gcbuf) {
 }
 
 void changeMenu(NavigationState new_menu) {
+    // the user list is only kept up to date while it is displayed
+    if (navigationState == USER_LIST_MENU && new_menu != USER_LIST_MENU) sendMessageUnsubscribeLobby(sock);
     navigationState = new_menu;
     // Entering state
     switch (new_menu) {
@@ -464,7 +474,7 @@ void processEvents(struct pollfd pfds[2]) {
                 else if (c==KEY_ENTER) switch (selected_field)
                     {
                     case MM_PLAY_BUTTON:
-                        sendMessageGetUserList(sock);
+                        sendMessageSubscribeLobby(sock);
                         is_waiting = 1;
                         break;
                     case MM_BACK_BUTTON:
@@ -487,7 +497,7 @@ void processEvents(struct pollfd pfds[2]) {
                 else if (c==KEY_ARROW_UP && selected_field>0) selected_field--;
                 else if (c==KEY_ARROW_DOWN && selected_field<field_count-1) selected_field++;
                 else if (c==KEY_BACKSPACE) changeMenu(MAIN_MENU);
-                else if (c==KEY_ENTER) {
+                else if (c==KEY_ENTER && users_list_count > 0) {
                     if (users_list_status[selected_field]) {
                         MessageObserve mes = { users_list_id[selected_field] };
                         sendMessageObserve(sock, mes);
@@ -566,30 +576,90 @@ void processEvents(struct pollfd pfds[2]) {
 
         // Vars used in switch (<C99 complience)
         int32_t user_count;
+        int32_t entries_length;
         int32_t res;
         char username[USERNAME_LENGTH];
         int32_t user_id;
+        int user_index;
+        MessageUserJoined joined_mes;
+        MessageUserStatus status_mes;
+        MessageGameMoveApplied applied_mes;
 
         switch (message_type) {
         case USER_REGISTRATION:
             recieve_from_server(&(connected_user.id), sizeof(int32_t));
-            strcpy(connected_user.username, user_pseudo.buf);
             is_waiting = 0;
+            if (connected_user.id < 0) {
+                // username already taken
+                changeMenu(USER_CREATION_MENU);
+                is_notified = 1;
+                strcpy(notification_message, "Pseudo déjà utilisé");
+                break;
+            }
+            strcpy(connected_user.username, user_pseudo.buf);
             changeMenu(MAIN_MENU);
             break;
 
         case SEND_USER_LIST:
             recieve_from_server(&user_count, sizeof(int32_t));
-            users_list_count = user_count;
-            if (user_count > 0) {
-                recieve_from_server(users_list_buf, sizeof(char)*user_count*USERNAME_LENGTH);
-                recieve_from_server(users_list_id, sizeof(int32_t)*user_count);
-                recieve_from_server(users_list_status, sizeof(char)*user_count);
+            recieve_from_server(&entries_length, sizeof(int32_t));
+            reserveUserList(user_count);
+            users_list_count = 0;
+            if (entries_length > 0) {
+                char* entries = malloc(entries_length);
+                if (entries == NULL) die("malloc");
+                recieve_from_server(entries, entries_length);
+                size_t offset = 0;
+                while (users_list_count < user_count && offset < (size_t)entries_length) {
+                    size_t entry_length = decodeUserListEntry(entries + offset, entries_length - offset,
+                        &users_list_id[users_list_count], &users_list_status[users_list_count], users_list_buf[users_list_count]);
+                    if (entry_length == 0) break;
+                    offset += entry_length;
+                    users_list_count++;
+                }
+                free(entries);
             }
             is_waiting = 0;
             changeMenu(USER_LIST_MENU);
             break;
 
+        // lobby changes, pushed while subscribed (a change may be received twice: apply them idempotently)
+        case USER_JOINED:
+            recieve_from_server(&joined_mes, sizeof(MessageUserJoined));
+            if (joined_mes.user_id == connected_user.id) break;
+            user_index = findInUserList(joined_mes.user_id);
+            if (user_index < 0) {
+                reserveUserList(users_list_count + 1);
+                user_index = users_list_count++;
+            }
+            joined_mes.username[USERNAME_LENGTH-1] = '\0';
+            strcpy(users_list_buf[user_index], joined_mes.username);
+            users_list_id[user_index] = joined_mes.user_id;
+            users_list_status[user_index] = joined_mes.in_game;
+            if (navigationState == USER_LIST_MENU) field_count = users_list_count;
+            break;
+
+        case USER_LEFT:
+            recieve_from_server(&user_id, sizeof(int32_t));
+            user_index = findInUserList(user_id);
+            if (user_index < 0) break;
+            // keep the display order of the remaining users
+            memmove(users_list_buf[user_index], users_list_buf[user_index+1], sizeof(char)*USERNAME_LENGTH*(users_list_count-user_index-1));
+            memmove(&users_list_id[user_index], &users_list_id[user_index+1], sizeof(int32_t)*(users_list_count-user_index-1));
+            memmove(&users_list_status[user_index], &users_list_status[user_index+1], sizeof(char)*(users_list_count-user_index-1));
+            users_list_count--;
+            if (navigationState == USER_LIST_MENU) {
+                field_count = users_list_count;
+                if (selected_field > user_index || (selected_field == users_list_count && selected_field > 0)) selected_field--;
+            }
+            break;
+
+        case USER_STATUS:
+            recieve_from_server(&status_mes, sizeof(MessageUserStatus));
+            user_index = findInUserList(status_mes.user_id);
+            if (user_index >= 0) users_list_status[user_index] = status_mes.in_game;
+            break;
+
         case MATCH_PROPOSITION:
             recieve_from_server(&(player_2.id), sizeof(int32_t));
             recieve_from_server(&(player_2.username), sizeof(char)*USERNAME_LENGTH);
@@ -641,10 +711,34 @@ void processEvents(struct pollfd pfds[2]) {
             strcpy(player_1.username, connected_user.username);
             player_2_side = !player_1_side;
             recieve_from_server(&current_game_snapshot, sizeof(GameSnapshot));
+            game_sequence = 0;
+            is_waiting_for_snapshot = 0;
             break;
 
         case GAME_UPDATE:
+            // every move for a legacy connection, only the answer to GAME_SNAPSHOT_REQUEST for a compact one
             recieve_from_server(&current_game_snapshot, sizeof(GameSnapshot));
+            game_sequence = -1;
+            is_waiting_for_snapshot = 0;
+            break;
+
+        case GAME_MOVE_APPLIED:
+            recieve_from_server(&applied_mes, sizeof(MessageGameMoveApplied));
+            if (is_waiting_for_snapshot) break; // the requested snapshot already includes this move
+
+            // replay the move locally, a gap or a different result means the board drifted: ask for the real one
+            if ((game_sequence < 0 || applied_mes.sequence == game_sequence + 1)
+                && applied_mes.selected_house >= 0 && applied_mes.selected_house < 12) {
+                // the turn may have been switched in advance when the move was sent
+                current_game_snapshot.turn = house_ownership(applied_mes.selected_house);
+                if (playSnapshotMove(&current_game_snapshot, current_game_snapshot.turn, applied_mes.selected_house) >= 0
+                    && snapshotChecksum(&current_game_snapshot) == applied_mes.checksum) {
+                    game_sequence = applied_mes.sequence;
+                    break;
+                }
+            }
+            sendMessageGameSnapshotRequest(sock);
+            is_waiting_for_snapshot = 1;
             break;
 
         case GAME_END:
@@ -673,6 +767,8 @@ void processEvents(struct pollfd pfds[2]) {
             recieve_from_server(&(player_1.id), sizeof(int32_t));
             recieve_from_server(&(player_2.id), sizeof(int32_t));
             recieve_from_server(&current_game_snapshot, sizeof(GameSnapshot));
+            game_sequence = -1; // joined in the middle of the game
+            is_waiting_for_snapshot = 0;
             connected_user_side = NO_SIDE;
             changeMenu(IN_GAME_MENU);
             is_waiting = 0;
@@ -681,7 +777,7 @@ void processEvents(struct pollfd pfds[2]) {
         case SPECTATOR_JOIN:
             spectator_count++;
             recieve_from_server(username, sizeof(char)*USERNAME_LENGTH);
-            recieve_from_server(&user_id, sizeof(char)*USERNAME_LENGTH);
+            recieve_from_server(&user_id, sizeof(int32_t));
             sprintf(general_display_buf, "%s #%d a rejoint les spectateurs", username, user_id);
             strcpy(chat_history[chat_message_count%100].message, general_display_buf);
             strcpy(chat_history[chat_message_count%100].username, "Serveur");
@@ -693,7 +789,7 @@ void processEvents(struct pollfd pfds[2]) {
         case SPECTATOR_LEAVE:
             spectator_count--;
             recieve_from_server(username, sizeof(char)*USERNAME_LENGTH);
-            recieve_from_server(&user_id, sizeof(char)*USERNAME_LENGTH);
+            recieve_from_server(&user_id, sizeof(int32_t));
             sprintf(general_display_buf, "%s #%d a quitté les spectateurs", username, user_id);
             strcpy(chat_history[chat_message_count%100].message, general_display_buf);
             strcpy(chat_history[chat_message_count%100].username, "Serveur");
@@ -714,6 +810,25 @@ void processEvents(struct pollfd pfds[2]) {
     }
 }
 
+void reserveUserList(int capacity) {
+    if (capacity <= users_list_capacity) return;
+    int new_capacity = users_list_capacity ? users_list_capacity : 64;
+    while (new_capacity < capacity) new_capacity *= 2;
+
+    users_list_buf = realloc(users_list_buf, sizeof(char)*USERNAME_LENGTH*new_capacity);
+    users_list_id = realloc(users_list_id, sizeof(int32_t)*new_capacity);
+    users_list_status = realloc(users_list_status, sizeof(char)*new_capacity);
+    if (users_list_buf == NULL || users_list_id == NULL || users_list_status == NULL) die("realloc");
+    users_list_capacity = new_capacity;
+}
+
+int findInUserList(int32_t user_id) {
+    for (int i = 0; i < users_list_count; ++i) {
+        if (users_list_id[i] == user_id) return i;
+    }
+    return -1;
+}
+
 void handle_notification(int c) {
     if (c==KEY_ENTER) {
         is_notified = 0;
@@ -745,8 +860,9 @@ void handle_game_request_popup(int c) {
     }
 }
 
-ssize_t recieve_from_server(void* buffer, size_t size) {
-    ssize_t r = recv(sock, buffer, size, 0);
+static ssize_t receive_raw(void* buffer, size_t size) {
+    // large messages (like the user list) may arrive in several segments: wait for all of them
+    ssize_t r = recv(sock, buffer, size, MSG_WAITALL);
     if (r < 0) {
         close(sock);
         die("recv");
@@ -757,6 +873,74 @@ ssize_t recieve_from_server(void* buffer, size_t size) {
     return r;
 }
 
+// compact frames are decoded into their legacy encoding, which recieve_from_server then hands out like the socket would
+static char* incoming = NULL;
+static size_t incoming_capacity = 0;
+static size_t incoming_length = 0;
+static size_t incoming_offset = 0;
+static char* compact_frame = NULL;
+static size_t compact_frame_capacity = 0;
+
+static void receive_compact_frame() {
+    char prefix[5];
+    size_t prefix_length = 0;
+    int frame_length;
+    do {
+        receive_raw(prefix + prefix_length, 1);
+        prefix_length++;
+    } while ((frame_length = compactFrameLength(prefix, prefix_length, MAX_INCOMING_FRAME_LENGTH)) == 0);
+    if (frame_length < 0) dieNoError("Malformed message from server.");
+
+    if ((size_t)frame_length > compact_frame_capacity) {
+        compact_frame = realloc(compact_frame, frame_length);
+        if (compact_frame == NULL) die("realloc");
+        compact_frame_capacity = frame_length;
+    }
+    // the legacy encoding is at most MAX_FRAME_LENGTH bytes, or a few bytes longer than the frame for the user list
+    size_t needed = (size_t)frame_length + MAX_FRAME_LENGTH;
+    if (needed > incoming_capacity) {
+        incoming = realloc(incoming, needed);
+        if (incoming == NULL) die("realloc");
+        incoming_capacity = needed;
+    }
+
+    memcpy(compact_frame, prefix, prefix_length);
+    if ((size_t)frame_length > prefix_length) receive_raw(compact_frame + prefix_length, frame_length - prefix_length);
+
+    ssize_t decoded = decodeCompactFrame(compact_frame, frame_length, incoming, incoming_capacity);
+    if (decoded < 0) dieNoError("Malformed message from server.");
+    incoming_length = decoded;
+    incoming_offset = 0;
+}
+
+ssize_t recieve_from_server(void* buffer, size_t size) {
+    if (connectionProtocol(sock) == PROTOCOL_LEGACY) return receive_raw(buffer, size);
+
+    char* out = buffer;
+    size_t remaining = size;
+    while (remaining > 0) {
+        if (incoming_offset == incoming_length) receive_compact_frame();
+        size_t n = incoming_length - incoming_offset;
+        if (n > remaining) n = remaining;
+        memcpy(out, incoming + incoming_offset, n);
+        incoming_offset += n;
+        out += n;
+        remaining -= n;
+    }
+    return size;
+}
+
+void negotiate_protocol() {
+    // ask for the compact protocol, the server answers with the protocol used from now on
+    MessageHello hello = { PROTOCOL_COMPACT };
+    sendMessageHello(sock, hello);
+
+    int32_t answer[2];
+    receive_raw(answer, sizeof(answer));
+    if (answer[0] != HELLO) dieNoError("Unexpected answer to HELLO from server.");
+    setConnectionProtocol(sock, answer[1]);
+}
+
 void connect_to_server(const char* server_ip, int port, int* sock_out, struct sockaddr_in* srv_out) {
     if (port <= 0 || port > 65535) {
         fprintf(stderr, "Invalid port: %d\n", port);
@@ -831,8 +1015,8 @@ void drawAwaleBoard(GridCharBuffer* gcbuf, ScreenPos pos, int offset_row, int of
     // TOP HOUSES
     for (int i=0; i<6; i++) {
         unsigned int seedCount = (player_2_side==TOP)?
-            current_game_snapshot.board.houses[11-i].seeds:
-            current_game_snapshot.board.houses[5-i].seeds;
+            current_game_snapshot.board.seeds[11-i]:
+            current_game_snapshot.board.seeds[5-i];
         drawAwaleHouse(
             gcbuf, TOP_LEFT, 
             pos_row, pos_col+(AWALE_HOUSE_WIDTH+1)*i, top_style, 
@@ -845,8 +1029,8 @@ void drawAwaleBoard(GridCharBuffer* gcbuf, ScreenPos pos, int offset_row, int of
         else if (selected_awale_house == i && selected_field==IG_AWALE_HOUSE) drawnStyle = &bot_style_selected;
         else drawnStyle = bot_style;
         unsigned int seedCount = (player_1_side==BOTTOM)?
-            current_game_snapshot.board.houses[i].seeds:
-            current_game_snapshot.board.houses[i+6].seeds;
+            current_game_snapshot.board.seeds[i]:
+            current_game_snapshot.board.seeds[i+6];
         drawAwaleHouse(
             gcbuf, TOP_LEFT, 
             pos_row+board_height-AWALE_HOUSE_HEIGHT, pos_col+(AWALE_HOUSE_WIDTH+1)*i, drawnStyle,
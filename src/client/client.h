@@ -16,6 +16,7 @@
 #include "../common/game.h"
 
 #define BUF_SIZE 4096
+#define MAX_INCOMING_FRAME_LENGTH (1 << 26) // the user list is the only message of unbounded size
 
 typedef enum NavigationState {
     USER_CREATION_MENU,
@@ -26,9 +27,12 @@ typedef enum NavigationState {
 } NavigationState;
 
 void handle_notification(int c);
+int findInUserList(int32_t user_id);
+void reserveUserList(int capacity);
 void handle_waiting_for_game_response(int c);
 void handle_game_request_popup(int c);
 ssize_t recieve_from_server(void* buffer, size_t size);
+void negotiate_protocol();
 void connect_to_server(const char* server_ip, int port, int* sock_out, struct sockaddr_in* srv_out);
 void processEvents(struct pollfd pfds[2]);
 void changeMenu(NavigationState new_menu);
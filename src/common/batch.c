@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "batch.h"
+
+
+GameBatch* createGameBatch(int count) {
+    GameBatch* batch = malloc(sizeof(GameBatch));
+    if (batch == NULL) return NULL;
+    batch->count = count;
+    batch->stride = (count + BATCH_LANES - 1) / BATCH_LANES * BATCH_LANES;
+    batch->rows = aligned_alloc(16, (size_t)BATCH_ROWS * batch->stride + 16); // + 16: aligned_alloc wants a non zero size
+    if (batch->rows == NULL) {
+        free(batch);
+        return NULL;
+    }
+
+    memset(batch->rows, 0, (size_t)BATCH_ROWS * batch->stride);
+    memset(batch->rows, 4, (size_t)12 * batch->stride);
+    // the padding games are over, no move is ever played in them
+    memset(BATCH_ROW(batch, BATCH_OVER_ROW) + count, 1, batch->stride - count);
+    return batch;
+}
+
+void freeGameBatch(GameBatch* batch) {
+    if (batch == NULL) return;
+    free(batch->rows);
+    free(batch);
+}
+
+void setBatchGame(GameBatch* batch, int game, const GameSnapshot* snapshot) {
+    for (int k = 0; k < 12; ++k) BATCH_ROW(batch, k)[game] = snapshot->board.seeds[k];
+    BATCH_ROW(batch, BATCH_TURN_ROW)[game] = snapshot->turn;
+    BATCH_ROW(batch, BATCH_POINTS_ROW(BOTTOM))[game] = snapshot->points[BOTTOM];
+    BATCH_ROW(batch, BATCH_POINTS_ROW(TOP))[game] = snapshot->points[TOP];
+    BATCH_ROW(batch, BATCH_OVER_ROW)[game] = isTerminal(snapshot);
+}
+
+void getBatchGame(const GameBatch* batch, int game, GameSnapshot* snapshot) {
+    for (int k = 0; k < 12; ++k) snapshot->board.seeds[k] = BATCH_ROW(batch, k)[game];
+    snapshot->turn = BATCH_ROW(batch, BATCH_TURN_ROW)[game];
+    snapshot->points[BOTTOM] = BATCH_ROW(batch, BATCH_POINTS_ROW(BOTTOM))[game];
+    snapshot->points[TOP] = BATCH_ROW(batch, BATCH_POINTS_ROW(TOP))[game];
+    snapshot->unused = 0;
+}
+
+#ifdef __SSE2__
+
+#define LOAD(batch, row, offset) _mm_load_si128((const __m128i*)(BATCH_ROW(batch, row) + (offset)))
+#define STORE(batch, row, offset, value) _mm_store_si128((__m128i*)(BATCH_ROW(batch, row) + (offset)), value)
+// per byte masks: a >= b (unsigned), and mask ? a : b
+#define GE(a, b) _mm_cmpeq_epi8(_mm_max_epu8(a, b), a)
+#define SELECT(mask, a, b) _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b))
+
+void legalMovesBatch(const GameBatch* batch, uint8_t* moves) {
+    const __m128i zero = _mm_setzero_si128();
+    for (int offset = 0; offset < batch->stride; offset += BATCH_LANES) {
+        __m128i top = _mm_cmpeq_epi8(LOAD(batch, BATCH_TURN_ROW, offset), _mm_set1_epi8(TOP));
+        __m128i mask = zero;
+        for (int i = 0; i < 6; ++i) {
+            __m128i seeds = SELECT(top, LOAD(batch, 6 + i, offset), LOAD(batch, i, offset));
+            mask = _mm_or_si128(mask, _mm_andnot_si128(_mm_cmpeq_epi8(seeds, zero), _mm_set1_epi8(1 << i)));
+        }
+        __m128i over = _mm_cmpeq_epi8(LOAD(batch, BATCH_OVER_ROW, offset), _mm_set1_epi8(1));
+        mask = _mm_andnot_si128(over, mask);
+
+        // the padding games of the last vector are not copied out
+        if (offset + BATCH_LANES <= batch->count) {
+            _mm_storeu_si128((__m128i*)(moves + offset), mask);
+        }
+        else {
+            uint8_t lanes[BATCH_LANES];
+            _mm_storeu_si128((__m128i*)lanes, mask);
+            memcpy(moves + offset, lanes, batch->count - offset);
+        }
+    }
+}
+
+static __m128i loadHouses(const uint8_t* houses, int offset, int count) {
+    if (offset + BATCH_LANES <= count) return _mm_loadu_si128((const __m128i*)(houses + offset));
+    uint8_t lanes[BATCH_LANES];
+    memset(lanes, 0, sizeof(lanes));
+    memcpy(lanes, houses + offset, count - offset);
+    return _mm_loadu_si128((const __m128i*)lanes);
+}
+
+static void storeResults(int8_t* results, int offset, int count, __m128i value) {
+    if (offset + BATCH_LANES <= count) {
+        _mm_storeu_si128((__m128i*)(results + offset), value);
+        return;
+    }
+    int8_t lanes[BATCH_LANES];
+    _mm_storeu_si128((__m128i*)lanes, value);
+    memcpy(results + offset, lanes, count - offset);
+}
+
+void playMoveBatch(GameBatch* batch, const uint8_t* houses, int8_t* results) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_cmpeq_epi8(zero, zero);
+
+    for (int offset = 0; offset < batch->stride; offset += BATCH_LANES) {
+        __m128i seeds[12];
+        for (int k = 0; k < 12; ++k) seeds[k] = LOAD(batch, k, offset);
+        __m128i turn = LOAD(batch, BATCH_TURN_ROW, offset);
+        __m128i top = _mm_cmpeq_epi8(turn, _mm_set1_epi8(TOP));
+        __m128i over = _mm_cmpeq_epi8(LOAD(batch, BATCH_OVER_ROW, offset), _mm_set1_epi8(1));
+        __m128i origin = loadHouses(houses, offset, batch->count);
+
+        // seeds of the house played in each game
+        __m128i sown = zero;
+        for (int k = 0; k < 12; ++k) {
+            sown = _mm_or_si128(sown, _mm_and_si128(_mm_cmpeq_epi8(origin, _mm_set1_epi8(k)), seeds[k]));
+        }
+
+        // same checks and codes as playHouse, the first failing check gives the code
+        __m128i in_range = GE(_mm_set1_epi8(11), origin);
+        __m128i top_house = GE(origin, _mm_set1_epi8(6));
+        __m128i result = SELECT(_mm_cmpeq_epi8(sown, zero), _mm_set1_epi8(-4), zero);
+        result = SELECT(_mm_andnot_si128(top, top_house), _mm_set1_epi8(-3), result);
+        result = SELECT(_mm_andnot_si128(top_house, top), _mm_set1_epi8(-2), result);
+        result = SELECT(in_range, result, _mm_set1_epi8(-1));
+        __m128i played = _mm_andnot_si128(over, _mm_cmpeq_epi8(result, zero));
+
+        // sowing: with sown = 11 * laps + rest, the house at distance d (1 to 11) from the origin gets
+        // laps seeds, plus one if d <= rest
+        __m128i laps = zero;
+        __m128i rest = sown;
+        for (int lap = 0; lap < 4; ++lap) {
+            __m128i full = GE(rest, _mm_set1_epi8(11));
+            rest = _mm_sub_epi8(rest, _mm_and_si128(full, _mm_set1_epi8(11)));
+            laps = _mm_sub_epi8(laps, full);
+        }
+        for (int k = 0; k < 12; ++k) {
+            __m128i distance = _mm_sub_epi8(_mm_set1_epi8(k), origin);
+            distance = _mm_add_epi8(distance, _mm_and_si128(_mm_cmpgt_epi8(origin, _mm_set1_epi8(k)), _mm_set1_epi8(12)));
+            // GE is 0xff (-1) where the last lap reaches the house
+            __m128i added = _mm_sub_epi8(laps, GE(rest, distance));
+            __m128i is_origin = _mm_cmpeq_epi8(distance, zero);
+            __m128i after = _mm_andnot_si128(is_origin, _mm_add_epi8(seeds[k], added));
+            seeds[k] = SELECT(played, after, seeds[k]);
+        }
+
+        // last house sown: origin + 1 + (sown - 1) % 11, modulo 12, that is origin + rest, or origin + 11 when rest is 0
+        __m128i last = _mm_add_epi8(origin, SELECT(_mm_cmpeq_epi8(rest, zero), _mm_set1_epi8(11), rest));
+        last = _mm_sub_epi8(last, _mm_and_si128(GE(last, _mm_set1_epi8(12)), _mm_set1_epi8(12)));
+
+        // captures: from the last house down, while the houses of the opponent hold 2 or 3 seeds
+        __m128i going = played;
+        __m128i captured = zero;
+        for (int k = 11; k >= 0; --k) {
+            __m128i opponent_house = (k >= 6) ? _mm_xor_si128(top, ones) : top;
+            // the chain starts at the last house and stops at the first house it cannot take
+            __m128i reached = _mm_and_si128(going, GE(last, _mm_set1_epi8(k)));
+            __m128i two_or_three = _mm_or_si128(_mm_cmpeq_epi8(seeds[k], _mm_set1_epi8(2)), _mm_cmpeq_epi8(seeds[k], _mm_set1_epi8(3)));
+            __m128i take = _mm_and_si128(reached, _mm_and_si128(opponent_house, two_or_three));
+            captured = _mm_add_epi8(captured, _mm_and_si128(take, seeds[k]));
+            seeds[k] = _mm_andnot_si128(take, seeds[k]);
+            going = _mm_andnot_si128(_mm_andnot_si128(take, reached), going);
+        }
+
+        __m128i points_bottom = _mm_add_epi8(LOAD(batch, BATCH_POINTS_ROW(BOTTOM), offset), _mm_andnot_si128(top, captured));
+        __m128i points_top = _mm_add_epi8(LOAD(batch, BATCH_POINTS_ROW(TOP), offset), _mm_and_si128(top, captured));
+        __m128i won = _mm_and_si128(played, GE(SELECT(top, points_top, points_bottom), _mm_set1_epi8(12)));
+        result = SELECT(won, _mm_set1_epi8(1), result);
+        turn = _mm_xor_si128(turn, _mm_and_si128(_mm_andnot_si128(won, played), _mm_set1_epi8(1)));
+
+        // the game is over if the side to play now has no seeds left
+        __m128i bottom_seeds = zero, top_seeds = zero;
+        for (int k = 0; k < 6; ++k) {
+            bottom_seeds = _mm_or_si128(bottom_seeds, seeds[k]);
+            top_seeds = _mm_or_si128(top_seeds, seeds[k + 6]);
+        }
+        __m128i next_top = _mm_cmpeq_epi8(turn, _mm_set1_epi8(TOP));
+        __m128i stuck = _mm_cmpeq_epi8(SELECT(next_top, top_seeds, bottom_seeds), zero);
+        __m128i ended = _mm_or_si128(over, _mm_and_si128(played, _mm_or_si128(won, stuck)));
+
+        for (int k = 0; k < 12; ++k) STORE(batch, k, offset, seeds[k]);
+        STORE(batch, BATCH_TURN_ROW, offset, turn);
+        STORE(batch, BATCH_POINTS_ROW(BOTTOM), offset, points_bottom);
+        STORE(batch, BATCH_POINTS_ROW(TOP), offset, points_top);
+        STORE(batch, BATCH_OVER_ROW, offset, _mm_and_si128(ended, _mm_set1_epi8(1)));
+        storeResults(results, offset, batch->count, SELECT(over, _mm_set1_epi8(BATCH_GAME_OVER), result));
+    }
+}
+
+#else
+
+void legalMovesBatch(const GameBatch* batch, uint8_t* moves) {
+    for (int game = 0; game < batch->count; ++game) {
+        GameSnapshot snapshot;
+        getBatchGame(batch, game, &snapshot);
+        moves[game] = BATCH_ROW(batch, BATCH_OVER_ROW)[game] ? 0 : generateLegalMoves(&snapshot);
+    }
+}
+
+void playMoveBatch(GameBatch* batch, const uint8_t* houses, int8_t* results) {
+    for (int game = 0; game < batch->count; ++game) {
+        if (BATCH_ROW(batch, BATCH_OVER_ROW)[game]) {
+            results[game] = BATCH_GAME_OVER;
+            continue;
+        }
+        GameSnapshot snapshot;
+        getBatchGame(batch, game, &snapshot);
+        results[game] = playSnapshotMove(&snapshot, snapshot.turn, houses[game]);
+        if (results[game] >= 0) setBatchGame(batch, game, &snapshot);
+    }
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "game.h"
+
+// Many games played at once, for bulk simulation (self-play, load tests).
+// The games are stored as a structure of arrays: row k holds house k of every game, then come the turn, the points
+// and the end of game flag rows. Sixteen games then share each SSE2 register and playMoveBatch plays one move
+// in each of them with the same instructions: sowing by comparing the seeds played with the distance of every
+// house, captures by walking the houses down with a mask of the games whose capture chain is still going.
+// Without SSE2 the games are played one by one with playSnapshotMove.
+
+
+#define BATCH_LANES 16          // games per vector, rows are padded to a multiple of it
+#define BATCH_TURN_ROW 12
+#define BATCH_POINTS_ROW(side) (13 + (side))
+#define BATCH_OVER_ROW 15       // 1 once a player reached 12 points or the side to play has no legal move
+#define BATCH_ROWS 16
+
+#define BATCH_GAME_OVER 2       // result of a move asked in a game already over, the game is left untouched
+
+typedef struct GameBatch {
+    int count;              // games
+    int stride;             // bytes per row, count rounded up to BATCH_LANES
+    uint8_t* rows;          // BATCH_ROWS rows of stride bytes, 16-byte aligned
+} GameBatch;
+
+#define BATCH_ROW(batch, row) ((batch)->rows + (size_t)(row) * (batch)->stride)
+
+
+GameBatch* createGameBatch(int count);
+// count games at the initial position, NULL if memory is exhausted
+
+void freeGameBatch(GameBatch* batch);
+
+void setBatchGame(GameBatch* batch, int game, const GameSnapshot* snapshot);
+// copies a snapshot into a game of the batch
+
+void getBatchGame(const GameBatch* batch, int game, GameSnapshot* snapshot);
+// copies a game of the batch into a snapshot
+
+void legalMovesBatch(const GameBatch* batch, uint8_t* moves);
+// moves[g] gets the legal moves of game g as generateLegalMoves does, 0 if the game is over
+
+void playMoveBatch(GameBatch* batch, const uint8_t* houses, int8_t* results);
+// plays house houses[g] for the side to play in every game g, as playSnapshotMove does
+// results[g] gets the value playSnapshotMove returns, or BATCH_GAME_OVER
+// the end of game flags are updated: check BATCH_OVER_ROW instead of calling isTerminal on each game
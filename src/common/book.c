@@ -0,0 +1,88 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "book.h"
+
+
+OpeningBook* openOpeningBook(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat status;
+    if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(BookHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void* mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    // the header must match the size of the file
+    const BookHeader* header = mapping;
+    if (memcmp(header->magic, BOOK_MAGIC, sizeof(header->magic)) != 0
+        || (size_t)status.st_size != sizeof(BookHeader) + header->entries * sizeof(BookEntry)) {
+        munmap(mapping, status.st_size);
+        return NULL;
+    }
+
+    OpeningBook* book = malloc(sizeof(OpeningBook));
+    if (book == NULL) {
+        munmap(mapping, status.st_size);
+        return NULL;
+    }
+    book->entries = (const BookEntry*)((const uint8_t*)mapping + sizeof(BookHeader));
+    book->count = header->entries;
+    book->max_plies = header->max_plies;
+    book->mapping = mapping;
+    book->mapping_size = status.st_size;
+    return book;
+}
+
+void closeOpeningBook(OpeningBook* book) {
+    if (book == NULL) return;
+    munmap(book->mapping, book->mapping_size);
+    free(book);
+}
+
+const BookEntry* findBookEntries(const OpeningBook* book, const GameSnapshot* snapshot, int* count) {
+    *count = 0;
+    if (book == NULL) return NULL;
+    uint64_t key = canonicalSnapshotHash(snapshot);
+
+    // first entry whose key is not below the key of the position
+    uint64_t low = 0, high = book->count;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (book->entries[middle].key < key) low = middle + 1;
+        else high = middle;
+    }
+    while (low + *count < book->count && book->entries[low + *count].key == key) (*count)++;
+    return *count ? &book->entries[low] : NULL;
+}
+
+int chooseBookMove(const OpeningBook* book, const GameSnapshot* snapshot) {
+    int count;
+    const BookEntry* entries = findBookEntries(book, snapshot, &count);
+    int moves = generateLegalMoves(snapshot);
+
+    int best = -1;
+    double best_score = -1;
+    for (int i = 0; i < count; ++i) {
+        // a key collision could list moves that are not legal here
+        if (entries[i].house > 5 || !(moves >> entries[i].house & 1)) continue;
+        double games = entries[i].wins + entries[i].draws + entries[i].losses + BOOK_PRIOR_DRAWS;
+        double score = (entries[i].wins + 0.5 * (entries[i].draws + BOOK_PRIOR_DRAWS)) / games;
+        if (score > best_score) {
+            best_score = score;
+            best = entries[i].house;
+        }
+    }
+    if (best < 0) return -1;
+    return ((snapshot->turn == TOP) ? 6 : 0) + best;
+}
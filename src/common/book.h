@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// Opening book: the results of the moves played in the first plies of recorded games, built offline by
+// build_book (src/tools) from game record files and read through mmap, so a new server has its book at once.
+//
+// A position is identified by canonicalSnapshotHash (seen from the side to play, so a position and its mirror
+// share their statistics) and a move by the index of its house on the side of its player (0 to 5).
+// The file is a BookHeader followed by BookEntries sorted by key then house: the moves of a position are next
+// to each other and found by a binary search.
+
+
+#define BOOK_MAGIC "AWALEBK1"
+#define BOOK_PRIOR_DRAWS 2  // virtual draws added to every move when comparing them, a lucky move seen once loses
+
+typedef struct BookHeader {
+    char magic[8];          // BOOK_MAGIC, without the terminating 0
+    uint64_t entries;       // number of entries following the header
+    uint32_t max_plies;     // plies of each game the book was built from
+    uint32_t min_games;     // a move played in fewer games was left out
+} BookHeader;
+
+typedef struct BookEntry {
+    uint64_t key;           // canonicalSnapshotHash of the position before the move
+    uint32_t wins;          // games won, drawn and lost by the player of the move
+    uint32_t draws;
+    uint32_t losses;
+    uint8_t house;          // 0 to 5, from the side to play
+    uint8_t unused[3];
+} BookEntry;
+
+typedef struct OpeningBook {
+    const BookEntry* entries;
+    uint64_t count;
+    int max_plies;
+    void* mapping;
+    size_t mapping_size;
+} OpeningBook;
+
+
+OpeningBook* openOpeningBook(const char* path);
+// maps a file written by build_book, NULL if it is missing or invalid
+
+void closeOpeningBook(OpeningBook* book);
+
+const BookEntry* findBookEntries(const OpeningBook* book, const GameSnapshot* snapshot, int* count);
+// entries of the moves of a position, by increasing house, and their number in count
+// returns NULL (count 0) if the position is not in the book
+
+int chooseBookMove(const OpeningBook* book, const GameSnapshot* snapshot);
+// house (0 to 11) of the legal move of the side to play with the best score in the book, -1 if there is none
+// the score of a move is its share of points, a draw counting as half a win, with BOOK_PRIOR_DRAWS more draws
+// read only: safe to call from several threads at once
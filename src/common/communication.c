@@ -1,3 +1,5 @@
+#include <stddef.h>
+
 #include "communication.h"
 
 
@@ -12,311 +14,600 @@
     // GAME_ILLEGAL_MOVE       // server -> client
 
 
-int isMessageComplete(int32_t message_type, ssize_t r) {
-// returns the difference between message expected lentgh and actual received lentgh
-// if < 0, message was too long and most likely another message was transmitted at the same time
-// if = 0, the message was in full
-// if > 0, the message was only partly received
-    int expected;
-    switch (message_type) {
-        case USER_CREATION:
-            expected = sizeof(int32_t) + sizeof(MessageUserCreation) ;
-            break;
-        case GET_USER_LIST:
-            expected = sizeof(int32_t);
-            break;
-        case MATCH_REQUEST:
-            expected = sizeof(int32_t) + sizeof(MessageMatchRequest);
-            break;
-        case GAME_MOVE:
-            expected = sizeof(int32_t) + sizeof(MessageGameMove);
-            break;       
-        case MATCH_RESPONSE:
-            expected = sizeof(int32_t) * 2;
-            break;
-        case MATCH_CANCELLATION:
-            expected = sizeof(int32_t);
-            break;
-        case CHAT_MESSAGE:
-            expected = sizeof(int32_t) + sizeof(MessageChat);
-            break;
-        case OBSERVE_GAME:
-            expected = sizeof(int32_t) + sizeof(MessageObserve);
-            break;
-        case SPECTATOR_JOIN:
-            expected = sizeof(int32_t) + sizeof(MessageSpectatorJoin);
-            break;
-        case SPECTATOR_LEAVE:
-            expected = sizeof(int32_t) + sizeof(MessageSpectatorLeave);
-            break;
-        case STOP_OBSERVING:
-            expected = sizeof(int32_t);
-            break;
-        default: 
-            printf("error: unknown length for message of type %d.\n", message_type);
-            exit(-1);
+static MessageSink message_sink = NULL;
+
+// protocol of each fd, indexed by fd
+static unsigned char* fd_protocols = NULL;
+static int fd_protocols_capacity = 0;
+
+void setMessageSink(MessageSink sink) {
+    message_sink = sink;
+}
+
+void setConnectionProtocol(int fd, int protocol) {
+    if (fd < 0) return;
+    if (fd >= fd_protocols_capacity) {
+        if (protocol == PROTOCOL_LEGACY) return; // default value
+        int new_capacity = fd_protocols_capacity ? fd_protocols_capacity : 64;
+        while (new_capacity <= fd) new_capacity *= 2;
+        unsigned char* grown = realloc(fd_protocols, new_capacity);
+        if (grown == NULL) return;
+        memset(grown + fd_protocols_capacity, PROTOCOL_LEGACY, new_capacity - fd_protocols_capacity);
+        fd_protocols = grown;
+        fd_protocols_capacity = new_capacity;
     }
-    return expected - r;
+    fd_protocols[fd] = (unsigned char)protocol;
+}
+
+int connectionProtocol(int fd) {
+    if (fd < 0 || fd >= fd_protocols_capacity) return PROTOCOL_LEGACY;
+    return fd_protocols[fd];
 }
 
+static void transmit(int fd, int protocol, const void* data, size_t length) {
+    if (message_sink != NULL) {
+        message_sink(fd, protocol, data, length);
+        return;
+    }
+    if (fd < 0) return;
+
+    // blocking socket: loop until everything is written, send may return early
+    const char* remaining = data;
+    while (length > 0) {
+        ssize_t w = send(fd, remaining, length, 0);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        remaining += w;
+        length -= w;
+    }
+}
 
-void sendMessageUserCreation(int fd, MessageUserCreation message) {
+static void emitMessage(int fd, int32_t message_type, const void* message, size_t message_length) {
+    char frame[MAX_FRAME_LENGTH];
+    if (fd < 0) {
+        // broadcast: one encoding per protocol, or only the one of PROTOCOL_BROADCAST_FD
+        for (int protocol = 0; protocol < PROTOCOL_COUNT; ++protocol) {
+            if (fd != BROADCAST_FD && fd != PROTOCOL_BROADCAST_FD(protocol)) continue;
+            transmit(fd, protocol, frame, encodeFrame(frame, protocol, message_type, message, message_length));
+        }
+        return;
+    }
+    int protocol = connectionProtocol(fd);
+    transmit(fd, protocol, frame, encodeFrame(frame, protocol, message_type, message, message_length));
+}
 
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageUserCreation message;
-    } MessageWithHeader;
 
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = USER_CREATION;
-    message_with_header.message = message;
+// compact encoding
+
+typedef enum FieldKind {
+    FIELD_INT32,    // zigzag varint
+    FIELD_STRING,   // varint length, bytes (NUL-terminated char array in the legacy struct)
+    FIELD_SNAPSHOT  // the snapshot bytes without its padding
+} FieldKind;
+
+#define COMPACT_SNAPSHOT_LENGTH offsetof(GameSnapshot, unused)
+
+typedef struct Field {
+    FieldKind kind;
+    size_t offset;  // in the legacy struct
+    size_t size;
+} Field;
+
+typedef struct MessageLayout {
+    const Field* fields;
+    int field_count;
+    size_t legacy_size;
+} MessageLayout;
+
+#define INT32_FIELD(type, member) { FIELD_INT32, offsetof(type, member), sizeof(int32_t) }
+#define STRING_FIELD(type, member) { FIELD_STRING, offsetof(type, member), USERNAME_LENGTH }
+#define SNAPSHOT_FIELD(type, member) { FIELD_SNAPSHOT, offsetof(type, member), sizeof(GameSnapshot) }
+#define LAYOUT(type, fields) { fields, sizeof(fields) / sizeof(Field), sizeof(type) }
+
+static const Field int32_fields[] = { { FIELD_INT32, 0, sizeof(int32_t) } };
+static const Field user_creation_fields[] = { STRING_FIELD(MessageUserCreation, username) };
+static const Field game_start_fields[] = {
+    STRING_FIELD(MessageGameStart, opponent_username), INT32_FIELD(MessageGameStart, player_side), SNAPSHOT_FIELD(MessageGameStart, first_snapshot)
+};
+static const Field game_update_fields[] = { SNAPSHOT_FIELD(MessageGameUpdate, snapshot) };
+static const Field game_end_fields[] = { INT32_FIELD(MessageGameEnd, winner), SNAPSHOT_FIELD(MessageGameEnd, final_snapshot) };
+static const Field match_proposition_fields[] = {
+    INT32_FIELD(MessageMatchProposition, opponent_id), STRING_FIELD(MessageMatchProposition, opponent_username)
+};
+static const Field chat_fields[] = {
+    { FIELD_STRING, offsetof(MessageChat, message), MAX_CHAT_MESSAGE_LENTGH },
+    STRING_FIELD(MessageChat, username), INT32_FIELD(MessageChat, user_id)
+};
+static const Field observation_start_fields[] = {
+    STRING_FIELD(MessageObservationStart, usernames[0]), STRING_FIELD(MessageObservationStart, usernames[1]),
+    INT32_FIELD(MessageObservationStart, ids[0]), INT32_FIELD(MessageObservationStart, ids[1]),
+    SNAPSHOT_FIELD(MessageObservationStart, snapshot)
+};
+static const Field spectator_fields[] = { STRING_FIELD(MessageSpectatorJoin, spectator_username), INT32_FIELD(MessageSpectatorJoin, spectator_id) };
+static const Field user_joined_fields[] = {
+    INT32_FIELD(MessageUserJoined, user_id), INT32_FIELD(MessageUserJoined, in_game), STRING_FIELD(MessageUserJoined, username)
+};
+static const Field user_status_fields[] = { INT32_FIELD(MessageUserStatus, user_id), INT32_FIELD(MessageUserStatus, in_game) };
+static const Field move_applied_fields[] = {
+    INT32_FIELD(MessageGameMoveApplied, selected_house), INT32_FIELD(MessageGameMoveApplied, sequence), INT32_FIELD(MessageGameMoveApplied, checksum)
+};
+
+// messages without a layout have no body (SEND_USER_LIST is handled apart)
+static const MessageLayout layouts[] = {
+    [USER_CREATION] = LAYOUT(MessageUserCreation, user_creation_fields),
+    [USER_REGISTRATION] = LAYOUT(MessageUserRegistration, int32_fields),
+    [MATCH_REQUEST] = LAYOUT(MessageMatchRequest, int32_fields),
+    [MATCH_PROPOSITION] = LAYOUT(MessageMatchProposition, match_proposition_fields),
+    [MATCH_RESPONSE] = LAYOUT(int32_t, int32_fields),
+    [GAME_START] = LAYOUT(MessageGameStart, game_start_fields),
+    [GAME_UPDATE] = LAYOUT(MessageGameUpdate, game_update_fields),
+    [GAME_END] = LAYOUT(MessageGameEnd, game_end_fields),
+    [GAME_MOVE] = LAYOUT(MessageGameMove, int32_fields),
+    [CHAT_MESSAGE] = LAYOUT(MessageChat, chat_fields),
+    [OBSERVE_GAME] = LAYOUT(MessageObserve, int32_fields),
+    [OBSERVATION_START] = LAYOUT(MessageObservationStart, observation_start_fields),
+    [SPECTATOR_JOIN] = LAYOUT(MessageSpectatorJoin, spectator_fields),
+    [SPECTATOR_LEAVE] = LAYOUT(MessageSpectatorLeave, spectator_fields),
+    [USER_JOINED] = LAYOUT(MessageUserJoined, user_joined_fields),
+    [USER_LEFT] = LAYOUT(MessageUserLeft, int32_fields),
+    [USER_STATUS] = LAYOUT(MessageUserStatus, user_status_fields),
+    [HELLO] = LAYOUT(MessageHello, int32_fields),
+    [GAME_MOVE_APPLIED] = LAYOUT(MessageGameMoveApplied, move_applied_fields),
+};
+#define LAYOUT_COUNT ((int32_t)(sizeof(layouts) / sizeof(MessageLayout)))
+
+static size_t putVarint(char* out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (char)value;
+    return n;
+}
 
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+static int getVarint(const unsigned char* data, size_t length, size_t* position, uint32_t* value) {
+    // returns 0 if data ends before the varint does, -1 if it is longer than 5 bytes
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*position >= length) return 0;
+        unsigned char byte = data[(*position)++];
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return 1;
+        }
+    }
+    return -1;
 }
 
+static uint32_t zigzag(int32_t value) { return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31); }
+static int32_t unzigzag(uint32_t value) { return (int32_t)(value >> 1) ^ -(int32_t)(value & 1); }
+
+static size_t encodeCompactBody(char* out, const MessageLayout* layout, const char* message) {
+    size_t n = 0;
+    for (int i = 0; i < layout->field_count; ++i) {
+        const Field* field = &layout->fields[i];
+        const char* value = message + field->offset;
+        if (field->kind == FIELD_INT32) {
+            int32_t number;
+            memcpy(&number, value, sizeof(int32_t));
+            n += putVarint(out + n, zigzag(number));
+        }
+        else if (field->kind == FIELD_STRING) {
+            const char* end = memchr(value, '\0', field->size - 1);
+            size_t string_length = (end != NULL) ? (size_t)(end - value) : field->size - 1;
+            n += putVarint(out + n, (uint32_t)string_length);
+            memcpy(out + n, value, string_length);
+            n += string_length;
+        }
+        else {
+            // houses, turn and points are already bytes, only the padding byte is left out
+            memcpy(out + n, value, COMPACT_SNAPSHOT_LENGTH);
+            n += COMPACT_SNAPSHOT_LENGTH;
+        }
+    }
+    return n;
+}
 
-void sendMessageUserRegistration(int fd, MessageUserRegistration message) {
+static int decodeCompactBody(const unsigned char* data, size_t length, size_t* position, const MessageLayout* layout, char* message) {
+    for (int i = 0; i < layout->field_count; ++i) {
+        const Field* field = &layout->fields[i];
+        char* value = message + field->offset;
+        uint32_t number;
+        if (field->kind == FIELD_INT32) {
+            if (getVarint(data, length, position, &number) <= 0) return -1;
+            int32_t decoded = unzigzag(number);
+            memcpy(value, &decoded, sizeof(int32_t));
+        }
+        else if (field->kind == FIELD_STRING) {
+            if (getVarint(data, length, position, &number) <= 0) return -1;
+            if (number >= field->size || number > length - *position) return -1;
+            memcpy(value, data + *position, number);
+            value[number] = '\0';
+            *position += number;
+        }
+        else {
+            if (length - *position < COMPACT_SNAPSHOT_LENGTH) return -1;
+            GameSnapshot snapshot = { 0 };
+            memcpy(&snapshot, data + *position, COMPACT_SNAPSHOT_LENGTH);
+            *position += COMPACT_SNAPSHOT_LENGTH;
+            memcpy(value, &snapshot, sizeof(GameSnapshot));
+        }
+    }
+    return 0;
+}
 
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageUserRegistration message;
-    } MessageWithHeader;
+static size_t varintLength(uint32_t value) {
+    size_t n = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
 
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = USER_REGISTRATION;
-    message_with_header.message = message;
+// legacy encoding
 
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+static void widenSnapshot(LegacySnapshot* legacy, const GameSnapshot* snapshot) {
+    for (int i = 0; i < 12; ++i) legacy->houses[i] = snapshot->board.seeds[i];
+    legacy->turn = snapshot->turn;
+    legacy->points[BOTTOM] = snapshot->points[BOTTOM];
+    legacy->points[TOP] = snapshot->points[TOP];
 }
 
+static void narrowSnapshot(GameSnapshot* snapshot, const LegacySnapshot* legacy) {
+    memset(snapshot, 0, sizeof(GameSnapshot));
+    for (int i = 0; i < 12; ++i) snapshot->board.seeds[i] = (uint8_t)legacy->houses[i];
+    snapshot->turn = (uint8_t)legacy->turn;
+    snapshot->points[BOTTOM] = (uint8_t)legacy->points[BOTTOM];
+    snapshot->points[TOP] = (uint8_t)legacy->points[TOP];
+}
 
-void sendMessageMatchRequest(int fd, MessageMatchRequest message) {
+static const Field* snapshotField(int32_t message_type) {
+    // at most one snapshot per message
+    if (message_type < 0 || message_type >= LAYOUT_COUNT) return NULL;
+    const MessageLayout* layout = &layouts[message_type];
+    for (int i = 0; i < layout->field_count; ++i) {
+        if (layout->fields[i].kind == FIELD_SNAPSHOT) return &layout->fields[i];
+    }
+    return NULL;
+}
 
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageMatchRequest message;
-    } MessageWithHeader;
+static size_t encodeLegacyBody(char* out, int32_t message_type, const char* message, size_t message_length) {
+    // the struct is copied as is, but for its snapshot
+    const Field* field = snapshotField(message_type);
+    if (field == NULL || message_length == 0) {
+        if (message_length > 0) memcpy(out, message, message_length);
+        return message_length;
+    }
+    GameSnapshot snapshot;
+    LegacySnapshot legacy;
+    memcpy(&snapshot, message + field->offset, sizeof(GameSnapshot));
+    widenSnapshot(&legacy, &snapshot);
+
+    size_t after = field->offset + sizeof(GameSnapshot);
+    memcpy(out, message, field->offset);
+    memcpy(out + field->offset, &legacy, sizeof(LegacySnapshot));
+    memcpy(out + field->offset + sizeof(LegacySnapshot), message + after, message_length - after);
+    return message_length + sizeof(LegacySnapshot) - sizeof(GameSnapshot);
+}
 
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = MATCH_REQUEST;
-    message_with_header.message = message;
+size_t legacyBodyLength(int32_t message_type) {
+    if (message_type < 0 || message_type >= LAYOUT_COUNT || layouts[message_type].fields == NULL) return 0;
+    size_t length = layouts[message_type].legacy_size;
+    if (snapshotField(message_type) != NULL) length += sizeof(LegacySnapshot) - sizeof(GameSnapshot);
+    return length;
+}
 
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+void decodeLegacyBody(int32_t message_type, const void* body, void* message) {
+    const char* data = body;
+    char* out = message;
+    const Field* field = snapshotField(message_type);
+    if (field == NULL) {
+        memcpy(out, data, legacyBodyLength(message_type));
+        return;
+    }
+    LegacySnapshot legacy;
+    GameSnapshot snapshot;
+    memcpy(&legacy, data + field->offset, sizeof(LegacySnapshot));
+    narrowSnapshot(&snapshot, &legacy);
+
+    size_t after = field->offset + sizeof(GameSnapshot);
+    memcpy(out, data, field->offset);
+    memcpy(out + field->offset, &snapshot, sizeof(GameSnapshot));
+    memcpy(out + after, data + field->offset + sizeof(LegacySnapshot), layouts[message_type].legacy_size - after);
 }
 
 
-void sendMessageGameStart(int fd, MessageGameStart message) {
+size_t encodeUserListHeader(char* out, int protocol, int32_t user_count, size_t entries_length) {
+    if (protocol == PROTOCOL_LEGACY) {
+        int32_t header[3] = { SEND_USER_LIST, user_count, (int32_t)entries_length };
+        memcpy(out, header, sizeof(header));
+        return sizeof(header);
+    }
+    size_t payload_length = 1 + varintLength((uint32_t)user_count) + entries_length;
+    size_t n = putVarint(out, (uint32_t)payload_length);
+    out[n++] = SEND_USER_LIST;
+    n += putVarint(out + n, (uint32_t)user_count);
+    return n;
+}
 
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageGameStart message;
-    } MessageWithHeader;
+size_t encodeFrame(char* out, int protocol, int32_t message_type, const void* message, size_t message_length) {
+    if (protocol == PROTOCOL_LEGACY) {
+        memcpy(out, &message_type, sizeof(int32_t));
+        return sizeof(int32_t) + encodeLegacyBody(out + sizeof(int32_t), message_type, message, message_length);
+    }
 
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = GAME_START;
-    message_with_header.message = message;
+    if (message_type == SEND_USER_LIST) {
+        int32_t header[2];
+        memcpy(header, message, sizeof(header));
+        size_t n = encodeUserListHeader(out, protocol, header[0], (size_t)header[1]);
+        memcpy(out + n, (const char*)message + sizeof(header), (size_t)header[1]);
+        return n + (size_t)header[1];
+    }
 
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+    // the body is written after room for the longest length prefix, then moved next to the actual prefix
+    char* body = out + 5;
+    body[0] = (char)message_type;
+    size_t body_length = 1;
+    if (message_type >= 0 && message_type < LAYOUT_COUNT) {
+        body_length += encodeCompactBody(body + 1, &layouts[message_type], message);
+    }
+    size_t prefix_length = putVarint(out, (uint32_t)body_length);
+    memmove(out + prefix_length, body, body_length);
+    return prefix_length + body_length;
 }
 
-void sendMessageGameUpdate(int fd, MessageGameUpdate message) {
+int compactFrameLength(const void* data, size_t available, size_t max_length) {
+    size_t position = 0;
+    uint32_t payload_length;
+    int status = getVarint(data, available, &position, &payload_length);
+    if (status <= 0) return status;
+    if (payload_length == 0 || position + payload_length > max_length) return -1;
+    return (int)(position + payload_length);
+}
 
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageGameUpdate message;
-    } MessageWithHeader;
+ssize_t decodeCompactFrame(const void* frame, size_t frame_length, void* out, size_t out_capacity) {
+    const unsigned char* data = frame;
+    size_t position = 0;
+    uint32_t payload_length;
+    if (getVarint(data, frame_length, &position, &payload_length) <= 0 || position + payload_length != frame_length) return -1;
+
+    int32_t message_type = data[position++];
+    char* legacy = out;
+    if (out_capacity < sizeof(int32_t)) return -1;
+    memcpy(legacy, &message_type, sizeof(int32_t));
+
+    if (message_type == SEND_USER_LIST) {
+        uint32_t user_count;
+        if (getVarint(data, frame_length, &position, &user_count) <= 0) return -1;
+        int32_t header[2] = { (int32_t)user_count, (int32_t)(frame_length - position) };
+        size_t legacy_length = sizeof(int32_t) + sizeof(header) + (frame_length - position);
+        if (legacy_length > out_capacity) return -1;
+        memcpy(legacy + sizeof(int32_t), header, sizeof(header));
+        memcpy(legacy + sizeof(int32_t) + sizeof(header), data + position, frame_length - position);
+        return legacy_length;
+    }
+
+    size_t legacy_length = sizeof(int32_t);
+    if (message_type < LAYOUT_COUNT && layouts[message_type].fields != NULL) {
+        const MessageLayout* layout = &layouts[message_type];
+        if (sizeof(int32_t) + layout->legacy_size > out_capacity) return -1;
+        memset(legacy + sizeof(int32_t), 0, layout->legacy_size);
+        if (decodeCompactBody(data, frame_length, &position, layout, legacy + sizeof(int32_t)) < 0) return -1;
+        legacy_length += layout->legacy_size;
+    }
+    if (position != frame_length) return -1; // trailing bytes
+    return legacy_length;
+}
 
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = GAME_UPDATE;
-    message_with_header.message = message;
 
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+int expectedMessageLength(int32_t message_type) {
+// returns the full length (header included) of a client -> server message of the given type
+// returns -1 if the type is unknown, in which case the stream cannot be parsed any further
+    switch (message_type) {
+        case USER_CREATION:
+            return sizeof(int32_t) + sizeof(MessageUserCreation);
+        case GET_USER_LIST:
+            return sizeof(int32_t);
+        case MATCH_REQUEST:
+            return sizeof(int32_t) + sizeof(MessageMatchRequest);
+        case GAME_MOVE:
+            return sizeof(int32_t) + sizeof(MessageGameMove);
+        case MATCH_RESPONSE:
+            return sizeof(int32_t) * 2;
+        case MATCH_CANCELLATION:
+            return sizeof(int32_t);
+        case CHAT_MESSAGE:
+            return sizeof(int32_t) + sizeof(MessageChat);
+        case OBSERVE_GAME:
+            return sizeof(int32_t) + sizeof(MessageObserve);
+        case SPECTATOR_JOIN:
+            return sizeof(int32_t) + sizeof(MessageSpectatorJoin);
+        case SPECTATOR_LEAVE:
+            return sizeof(int32_t) + sizeof(MessageSpectatorLeave);
+        case STOP_OBSERVING:
+            return sizeof(int32_t);
+        case SUBSCRIBE_LOBBY:
+            return sizeof(int32_t);
+        case UNSUBSCRIBE_LOBBY:
+            return sizeof(int32_t);
+        case HELLO:
+            return sizeof(int32_t) + sizeof(MessageHello);
+        case GAME_SNAPSHOT_REQUEST:
+            return sizeof(int32_t);
+        default: 
+            return -1;
+    }
 }
-void sendMessageGameEnd(int fd, MessageGameEnd message) {
 
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageGameEnd message;
-    } MessageWithHeader;
+int isMessageComplete(int32_t message_type, ssize_t r) {
+// returns the difference between message expected lentgh and actual received lentgh
+// if < 0, message was too long and most likely another message was transmitted at the same time
+// if = 0, the message was in full
+// if > 0, the message was only partly received
+    int expected = expectedMessageLength(message_type);
+    if (expected < 0) {
+        printf("error: unknown length for message of type %d.\n", message_type);
+        exit(-1);
+    }
+    return expected - r;
+}
 
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = GAME_END;
-    message_with_header.message = message;
 
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+void sendMessageUserCreation(int fd, MessageUserCreation message) {
+    emitMessage(fd, USER_CREATION, &message, sizeof(message));
 }
-void sendMessageGameMove(int fd, MessageGameMove message) {
 
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageGameMove message;
-    } MessageWithHeader;
 
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = GAME_MOVE;
-    message_with_header.message = message;
+void sendMessageUserRegistration(int fd, MessageUserRegistration message) {
+    emitMessage(fd, USER_REGISTRATION, &message, sizeof(message));
+}
 
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+
+void sendMessageMatchRequest(int fd, MessageMatchRequest message) {
+    emitMessage(fd, MATCH_REQUEST, &message, sizeof(message));
+}
+
+
+void sendMessageGameStart(int fd, MessageGameStart message) {
+    emitMessage(fd, GAME_START, &message, sizeof(message));
+}
+
+void sendMessageGameUpdate(int fd, MessageGameUpdate message) {
+    emitMessage(fd, GAME_UPDATE, &message, sizeof(message));
+}
+void sendMessageGameEnd(int fd, MessageGameEnd message) {
+    emitMessage(fd, GAME_END, &message, sizeof(message));
+}
+void sendMessageGameMove(int fd, MessageGameMove message) {
+    emitMessage(fd, GAME_MOVE, &message, sizeof(message));
 }
 
 
 // single signal messages 
 
 void sendMessageQueueAcknowledgement(int fd) {
-
-    int ack = USER_REGISTRATION;
-    send(fd, &ack, sizeof(ack), 0);
+    emitMessage(fd, USER_REGISTRATION, NULL, 0);
 }
 
 void sendMessageIllegalMove(int fd) {
-
-    int ack = GAME_ILLEGAL_MOVE;
-    send(fd, &ack, sizeof(ack), 0);
+    emitMessage(fd, GAME_ILLEGAL_MOVE, NULL, 0);
 }
 
 void sendMessageGetUserList(int fd) {
-    int32_t message_type = GET_USER_LIST;
-    send(fd, &message_type, sizeof(message_type), 0);
+    emitMessage(fd, GET_USER_LIST, NULL, 0);
+}
+
+size_t encodeUserListEntry(char* out, int32_t user_id, char in_game, const char username[USERNAME_LENGTH]) {
+    const char* end = memchr(username, '\0', USERNAME_LENGTH - 1);
+    size_t name_length = (end != NULL) ? (size_t)(end - username) : USERNAME_LENGTH - 1;
+    memcpy(out, &user_id, sizeof(int32_t));
+    out[sizeof(int32_t)] = in_game;
+    out[sizeof(int32_t) + 1] = (char)name_length;
+    memcpy(out + sizeof(int32_t) + 2, username, name_length);
+    return sizeof(int32_t) + 2 + name_length;
+}
+
+size_t decodeUserListEntry(const char* data, size_t length, int32_t* user_id, char* in_game, char username[USERNAME_LENGTH]) {
+    if (length < sizeof(int32_t) + 2) return 0;
+    size_t name_length = (unsigned char)data[sizeof(int32_t) + 1];
+    if (name_length >= USERNAME_LENGTH || length < sizeof(int32_t) + 2 + name_length) return 0;
+
+    memcpy(user_id, data, sizeof(int32_t));
+    *in_game = data[sizeof(int32_t)];
+    memcpy(username, data + sizeof(int32_t) + 2, name_length);
+    username[name_length] = '\0';
+    return sizeof(int32_t) + 2 + name_length;
 }
 
-void sendUserList(int fd, char usernames[MAX_CLIENTS][USERNAME_LENGTH], int32_t user_ids[MAX_CLIENTS], int32_t usernames_count, char in_game[MAX_CLIENTS]) {
+void sendUserList(int fd, char (*usernames)[USERNAME_LENGTH], int32_t* user_ids, int32_t usernames_count, char* in_game) {
 
-    // send number of users, then usernames, then ids
-    int32_t message_type = SEND_USER_LIST;
+    // send number of users, length of the entries, then the entries
+    // the entries are encoded after room for the longest header, which is then written right before them
+    size_t header_room = 16;
+    char* buffer = malloc(header_room + (size_t)usernames_count * USER_LIST_ENTRY_MAX_LENGTH);
+    if (buffer == NULL) return;
+    size_t entries_length = 0;
+    for (int i = 0; i < usernames_count; ++i) {
+        entries_length += encodeUserListEntry(buffer + header_room + entries_length, user_ids[i], in_game[i], usernames[i]);
+    }
 
-    ssize_t message_length = sizeof(message_type) * 2 + usernames_count*USERNAME_LENGTH*sizeof(char) + sizeof(usernames_count)*usernames_count + sizeof(char)*usernames_count;
-    char* buffer = calloc(1, message_length);
-    char* writing_adress = buffer;
-    memcpy(writing_adress, &message_type, sizeof(message_type));
-    writing_adress += sizeof(message_type);
-    memcpy(writing_adress, &usernames_count, sizeof(usernames_count));
-    writing_adress += sizeof(usernames_count);
-    memcpy(writing_adress, usernames, usernames_count*USERNAME_LENGTH*sizeof(char));
-    writing_adress += usernames_count*USERNAME_LENGTH*sizeof(char);
-    memcpy(writing_adress, user_ids, sizeof(int32_t)*usernames_count);
-    writing_adress += sizeof(int32_t)*usernames_count;
-    memcpy(writing_adress, in_game, sizeof(char)*usernames_count);
+    int protocol = connectionProtocol(fd);
+    char header[16];
+    size_t header_length = encodeUserListHeader(header, protocol, usernames_count, entries_length);
+    memcpy(buffer + header_room - header_length, header, header_length);
 
-    send(fd, buffer, message_length, 0);
+    transmit(fd, protocol, buffer + header_room - header_length, header_length + entries_length);
+    free(buffer);
 }
 
 void sendMessageMatchResponse(int fd, int response) {
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        int32_t response;
-    } MessageWithHeader;
-    MessageWithHeader message_with_header;
-
-    message_with_header.message_type = MATCH_RESPONSE;
-    message_with_header.response = response;
-    send(fd, &message_with_header, sizeof(message_with_header),0);
+    int32_t message = response;
+    emitMessage(fd, MATCH_RESPONSE, &message, sizeof(message));
 }
 
 void sendMessageMatchProposition(int fd, MessageMatchProposition message) {
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageMatchProposition message;
-    } MessageWithHeader;
-
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = MATCH_PROPOSITION;
-    message_with_header.message = message;
-
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+    emitMessage(fd, MATCH_PROPOSITION, &message, sizeof(message));
 }
 
 void sendMessageMatchCancellation(int fd) {
-    int32_t msg = MATCH_CANCELLATION;
-    send(fd, &msg, sizeof(msg), 0);
+    emitMessage(fd, MATCH_CANCELLATION, NULL, 0);
 }
 
 void sendMessageGameIllegalMove(int fd) {
-    int32_t msg = GAME_ILLEGAL_MOVE;
-    send(fd, &msg, sizeof(msg), 0);
+    emitMessage(fd, GAME_ILLEGAL_MOVE, NULL, 0);
 }
 
 void sendMessageChat(int fd, MessageChat message) {
-
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageChat message;
-    } MessageWithHeader;
-
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = CHAT_MESSAGE;
-    message_with_header.message = message;
-    send(fd, &message_with_header, sizeof(MessageWithHeader), 0);
+    emitMessage(fd, CHAT_MESSAGE, &message, sizeof(message));
 }
 
 void sendMessageSpectatorJoin(int fd, MessageSpectatorJoin message) {
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageSpectatorJoin message;
-    } MessageWithHeader;
-
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = SPECTATOR_JOIN;
-    message_with_header.message = message;
-
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+    emitMessage(fd, SPECTATOR_JOIN, &message, sizeof(message));
 }
 
 void sendMessageSpectatorLeave(int fd, MessageSpectatorLeave message) {
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageSpectatorLeave message;
-    } MessageWithHeader;
-
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = SPECTATOR_LEAVE;
-    message_with_header.message = message;
-
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+    emitMessage(fd, SPECTATOR_LEAVE, &message, sizeof(message));
 }
 
 void sendMessageObserve(int fd, MessageObserve message) {
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageObserve message;
-    } MessageWithHeader;
-
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = OBSERVE_GAME;
-    message_with_header.message = message;
-
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+    emitMessage(fd, OBSERVE_GAME, &message, sizeof(message));
 }
 
 void sendMessageStopObserving(int fd) {
-    int32_t message_type = STOP_OBSERVING;
-    send(fd, &message_type, sizeof(int32_t), 0);
+    emitMessage(fd, STOP_OBSERVING, NULL, 0);
 }
 
-void sendMessageObservationStart(int fd, MessageObservationStart message) {
-    typedef struct MessageWithHeader {
-        int32_t message_type;
-        MessageObservationStart message;
-    } MessageWithHeader;
+void sendMessageSubscribeLobby(int fd) {
+    emitMessage(fd, SUBSCRIBE_LOBBY, NULL, 0);
+}
 
-    MessageWithHeader message_with_header;
-    message_with_header.message_type = OBSERVATION_START;
-    message_with_header.message = message;
+void sendMessageUnsubscribeLobby(int fd) {
+    emitMessage(fd, UNSUBSCRIBE_LOBBY, NULL, 0);
+}
 
-    send(fd, &message_with_header, sizeof(message_with_header), 0);
+void sendMessageObservationStart(int fd, MessageObservationStart message) {
+    emitMessage(fd, OBSERVATION_START, &message, sizeof(message));
 }
 
+void sendMessageHello(int fd, MessageHello message) {
+    emitMessage(fd, HELLO, &message, sizeof(message));
+}
 
-// void sendMessageXXX(int fd, MessageXXX message) {
+void sendMessageGameMoveApplied(int fd, MessageGameMoveApplied message) {
+    emitMessage(fd, GAME_MOVE_APPLIED, &message, sizeof(message));
+}
 
-//     typedef struct MessageWithHeader {
-//         int32_t message_type;
-//         MessageXXX message;
-//     } MessageWithHeader;
+void sendMessageGameSnapshotRequest(int fd) {
+    emitMessage(fd, GAME_SNAPSHOT_REQUEST, NULL, 0);
+}
 
-//     MessageWithHeader message_with_header;
-//     message_with_header.message_type = USER_REGISTRATION;
-//     message_with_header.message = message;
 
-//     send(fd, &message_with_header, sizeof(message_with_header), 0);
+// void sendMessageXXX(int fd, MessageXXX message) {
+//     emitMessage(fd, XXX, &message, sizeof(message));
 // }
-
+// (and add the fields of MessageXXX to layouts for the compact protocol)
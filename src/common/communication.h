@@ -9,7 +9,6 @@
 #include <signal.h>
 
 #include "game.h"
-#define MAX_CLIENTS 1024
 #define MAX_CHAT_MESSAGE_LENTGH 1024
 
 
@@ -32,7 +31,15 @@ typedef enum MessageType {
     OBSERVATION_START,      // server -> observer
     STOP_OBSERVING,         // observer -> server
     SPECTATOR_JOIN,         // server -> client1 & client2
-    SPECTATOR_LEAVE         // server -> client1 & client2
+    SPECTATOR_LEAVE,        // server -> client1 & client2
+    SUBSCRIBE_LOBBY,        // client -> server (answered with SEND_USER_LIST, then presence deltas)
+    UNSUBSCRIBE_LOBBY,      // client -> server
+    USER_JOINED,            // server -> subscribed clients
+    USER_LEFT,              // server -> subscribed clients
+    USER_STATUS,            // server -> subscribed clients
+    HELLO,                  // client -> server (highest protocol understood) | server -> client (protocol used from now on)
+    GAME_MOVE_APPLIED,      // server -> compact clients, instead of GAME_UPDATE
+    GAME_SNAPSHOT_REQUEST   // client -> server (answered with GAME_UPDATE)
 } MessageType;
 
 
@@ -92,12 +99,106 @@ typedef struct MessageSpectatorLeave {
     int32_t spectator_id;
 } MessageSpectatorLeave;
 
+typedef struct MessageUserJoined {
+    int32_t user_id;
+    int32_t in_game;
+    char username[USERNAME_LENGTH];
+} MessageUserJoined;
+
+typedef struct MessageUserLeft {
+    int32_t user_id;
+} MessageUserLeft;
+
+typedef struct MessageUserStatus {
+    int32_t user_id;
+    int32_t in_game;
+} MessageUserStatus;
+
 typedef struct MessageObservationStart {
     char usernames[2][USERNAME_LENGTH];
     int32_t ids[2];
     GameSnapshot snapshot;
 } MessageObservationStart;
 
+typedef struct MessageHello {
+    int32_t protocol;
+} MessageHello;
+
+typedef struct MessageGameMoveApplied {
+    int32_t selected_house;
+    int32_t sequence;       // number of moves played in the game, this one included
+    int32_t checksum;       // snapshotChecksum of the snapshot after the move
+} MessageGameMoveApplied;
+
+
+// Wire protocols.
+// A connection starts in PROTOCOL_LEGACY: every message is an int32_t type followed by its fixed-size struct,
+// with its snapshot widened to a LegacySnapshot, the layout GameSnapshot had before it was packed.
+// A client that sends HELLO (in the legacy encoding) is answered with the protocol both sides use from then on.
+// PROTOCOL_COMPACT frames are: varint payload length, then the payload: uint8_t type and the struct fields,
+// int32_t as zigzag varints, strings as a varint length and their bytes, boards as one byte per house.
+// Compact frames are decoded back into the legacy encoding, so the message handlers do not depend on the protocol.
+#define PROTOCOL_LEGACY 0
+#define PROTOCOL_COMPACT 1
+#define PROTOCOL_COUNT 2
+
+typedef struct LegacySnapshot {
+    uint32_t houses[12];
+    uint32_t turn;
+    uint32_t points[2];
+} LegacySnapshot;
+// 60 bytes, what the clients that do not send HELLO read for every GameSnapshot
+_Static_assert(sizeof(LegacySnapshot) == 60, "LegacySnapshot is fixed by the legacy protocol");
+
+// messages sent to BROADCAST_FD are encoded once per protocol and each encoding is given to the message sink,
+// messages sent to PROTOCOL_BROADCAST_FD(protocol) only once, for that protocol
+#define BROADCAST_FD -1
+#define PROTOCOL_BROADCAST_FD(protocol) (-2 - (protocol))
+
+
+#define USER_LIST_ENTRY_MAX_LENGTH (sizeof(int32_t) + 2 + USERNAME_LENGTH)
+
+// longest message a client can send (header included), used to size the reassembly buffers
+#define MAX_MESSAGE_LENGTH (sizeof(int32_t) + sizeof(MessageChat))
+
+// longest frame of any message but SEND_USER_LIST, in either protocol
+#define MAX_FRAME_LENGTH (MAX_MESSAGE_LENGTH + 16)
+
+typedef void (*MessageSink)(int fd, int protocol, const void* data, size_t length);
+
+void setMessageSink(MessageSink sink);
+// redirects every sendMessageXXX call to sink instead of writing to the socket directly
+// the sink must copy data, it is only valid for the duration of the call
+// messages sent to BROADCAST_FD or PROTOCOL_BROADCAST_FD are only given to the sink
+
+void setConnectionProtocol(int fd, int protocol);
+int connectionProtocol(int fd);
+// protocol used to encode the messages sent to fd, PROTOCOL_LEGACY until set
+
+size_t encodeFrame(char* out, int protocol, int32_t message_type, const void* message, size_t message_length);
+// encodes a message given as its legacy struct (SEND_USER_LIST: count, entries length, entries) and returns the frame length
+// out must hold MAX_FRAME_LENGTH bytes (SEND_USER_LIST: 16 bytes more than its legacy encoding)
+
+size_t encodeUserListHeader(char* out, int protocol, int32_t user_count, size_t entries_length);
+// writes the part of a SEND_USER_LIST frame preceding its entries (at most 16 bytes) and returns its length
+
+int compactFrameLength(const void* data, size_t available, size_t max_length);
+// returns the full length (prefix included) of the compact frame starting at data,
+// 0 if more bytes are needed to read its length, -1 if the length prefix is invalid or above max_length
+
+ssize_t decodeCompactFrame(const void* frame, size_t frame_length, void* out, size_t out_capacity);
+// decodes a complete compact frame into its legacy encoding (int32_t type, then the struct) in out
+// returns the legacy length, or -1 if the frame is malformed or does not fit in out_capacity
+
+size_t legacyBodyLength(int32_t message_type);
+// length of the body following the type of a message in PROTOCOL_LEGACY, 0 if it has none (not for SEND_USER_LIST)
+
+void decodeLegacyBody(int32_t message_type, const void* body, void* message);
+// converts the body of a message received in PROTOCOL_LEGACY into its struct, narrowing its snapshot
+
+int expectedMessageLength(int32_t message_type);
+// returns the full length (header included) of a client -> server message of the given type
+// returns -1 if the type is unknown
 
 int isMessageComplete(int32_t message_type, ssize_t r);
 // returns the difference between message expected lentgh and actual received lentgh
@@ -115,7 +216,16 @@ void sendMessageGameMove(int fd, MessageGameMove message);
 void sendMessageGameIllegalMove(int fd);
 
 void sendMessageGetUserList(int fd);
-void sendUserList(int fd, char usernames[MAX_CLIENTS][USERNAME_LENGTH], int32_t user_ids[MAX_CLIENTS], int32_t usernames_count, char in_game[MAX_CLIENTS]);
+void sendUserList(int fd, char (*usernames)[USERNAME_LENGTH], int32_t* user_ids, int32_t usernames_count, char* in_game);
+// SEND_USER_LIST layout: header, int32_t user count, int32_t entries length in bytes, then the entries back to back
+
+size_t encodeUserListEntry(char* out, int32_t user_id, char in_game, const char username[USERNAME_LENGTH]);
+// writes a user list entry in out (at most USER_LIST_ENTRY_MAX_LENGTH bytes) and returns its length
+// entry layout: int32_t user id, uint8_t in game, uint8_t username length, username bytes (not NUL-terminated)
+
+size_t decodeUserListEntry(const char* data, size_t length, int32_t* user_id, char* in_game, char username[USERNAME_LENGTH]);
+// reads the entry at the start of data, username is NUL-terminated
+// returns the length of the entry, or 0 if data is too short to hold it
 
 void sendMessageMatchResponse(int fd, int response);
 void sendMessageMatchProposition(int fd, MessageMatchProposition message);
@@ -127,4 +237,11 @@ void sendMessageObserve(int fd, MessageObserve message);
 void sendMessageObservationStart(int fd, MessageObservationStart message);
 void sendMessageStopObserving(int fd);
 void sendMessageSpectatorJoin(int fd, MessageSpectatorJoin message);
-void sendMessageSpectatorLeave(int fd, MessageSpectatorLeave message);
\ No newline at end of file
+void sendMessageSpectatorLeave(int fd, MessageSpectatorLeave message);
+
+void sendMessageHello(int fd, MessageHello message);
+void sendMessageGameMoveApplied(int fd, MessageGameMoveApplied message);
+void sendMessageGameSnapshotRequest(int fd);
+
+void sendMessageSubscribeLobby(int fd);
+void sendMessageUnsubscribeLobby(int fd);
\ No newline at end of file
@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "endgame.h"
+
+// ways[h][s]: number of ways to spread s seeds over h houses
+// skip[h][s][k]: boards ranked before the ones holding k seeds in a house followed by h houses, s seeds in all
+static uint64_t ways[12][ENDGAME_MAX_SEEDS + 1];
+static uint64_t skip[12][ENDGAME_MAX_SEEDS + 1][ENDGAME_MAX_SEEDS + 2];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+
+static void initTables() {
+    for (int s = 0; s <= ENDGAME_MAX_SEEDS; ++s) ways[0][s] = (s == 0);
+    for (int h = 1; h < 12; ++h) {
+        for (int s = 0; s <= ENDGAME_MAX_SEEDS; ++s) {
+            // the first of the h houses holds 0 to s seeds
+            ways[h][s] = 0;
+            for (int v = 0; v <= s; ++v) ways[h][s] += ways[h - 1][s - v];
+        }
+    }
+    for (int h = 0; h < 12; ++h) {
+        for (int s = 0; s <= ENDGAME_MAX_SEEDS; ++s) {
+            skip[h][s][0] = 0;
+            for (int k = 1; k <= s + 1; ++k) skip[h][s][k] = skip[h][s][k - 1] + ways[h][s - k + 1];
+        }
+    }
+}
+
+static int boardSeeds(const Board* board) {
+    int seeds = 0;
+    for (int i = 0; i < 12; ++i) seeds += board->seeds[i];
+    return seeds;
+}
+
+uint64_t endgameBoardCount(int seeds) {
+    pthread_once(&tables_once, initTables);
+    // the 12 houses are the first one followed by 11 others
+    return skip[11][seeds][seeds + 1];
+}
+
+int endgameLowestPoints(int total_seeds, int seeds) {
+    int points = total_seeds - seeds - 11;
+    return (points > 0) ? points : 0;
+}
+
+int endgamePointClasses(int total_seeds, int seeds) {
+    int points = total_seeds - seeds;
+    int highest = (points < 11) ? points : 11;
+    int classes = highest - endgameLowestPoints(total_seeds, seeds) + 1;
+    return (classes > 0) ? classes : 0;
+}
+
+uint64_t endgameLayerOffset(int total_seeds, int seeds) {
+    uint64_t offset = 0;
+    for (int s = 0; s < seeds; ++s) offset += endgamePointClasses(total_seeds, s) * endgameBoardCount(s);
+    return offset;
+}
+
+uint64_t endgameBoardRank(const Board* board, int seeds) {
+    pthread_once(&tables_once, initTables);
+    uint64_t rank = 0;
+    for (int i = 0; i < 11; ++i) {
+        rank += skip[11 - i][seeds][board->seeds[i]];
+        seeds -= board->seeds[i];
+    }
+    return rank;
+}
+
+void endgameBoardUnrank(uint64_t rank, int seeds, Board* board) {
+    pthread_once(&tables_once, initTables);
+    for (int i = 0; i < 11; ++i) {
+        int v = 0;
+        while (rank >= ways[11 - i][seeds - v]) {
+            rank -= ways[11 - i][seeds - v];
+            v++;
+        }
+        board->seeds[i] = v;
+        seeds -= v;
+    }
+    board->seeds[11] = seeds;
+}
+
+int64_t endgameIndex(const GameSnapshot* snapshot, int total_seeds, int max_seeds) {
+    int seeds = boardSeeds(&snapshot->board);
+    if (seeds > max_seeds || snapshot->points[BOTTOM] >= 12 || snapshot->points[TOP] >= 12) return -1;
+    if (seeds + snapshot->points[BOTTOM] + snapshot->points[TOP] != total_seeds) return -1;
+
+    GameSnapshot position = *snapshot;
+    if (position.turn == TOP) mirrorSnapshot(&position, &position);
+
+    // the points of the other side follow from those of the side to play
+    uint64_t point_class = position.points[BOTTOM] - endgameLowestPoints(total_seeds, seeds);
+    return endgameLayerOffset(total_seeds, seeds) + point_class * endgameBoardCount(seeds)
+        + endgameBoardRank(&position.board, seeds);
+}
+
+EndgameDatabase* openEndgameDatabase(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat status;
+    if (fstat(fd, &status) < 0 || (size_t)status.st_size < sizeof(EndgameHeader)) {
+        close(fd);
+        return NULL;
+    }
+    void* mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    // the header must match the size of the file
+    const EndgameHeader* header = mapping;
+    if (memcmp(header->magic, ENDGAME_MAGIC, sizeof(header->magic)) != 0
+        || header->max_seeds > ENDGAME_MAX_SEEDS || header->total_seeds > 48
+        || header->positions != endgameLayerOffset(header->total_seeds, header->max_seeds + 1)
+        || (size_t)status.st_size != sizeof(EndgameHeader) + header->positions) {
+        munmap(mapping, status.st_size);
+        return NULL;
+    }
+
+    EndgameDatabase* database = malloc(sizeof(EndgameDatabase));
+    if (database == NULL) {
+        munmap(mapping, status.st_size);
+        return NULL;
+    }
+    database->max_seeds = header->max_seeds;
+    database->total_seeds = header->total_seeds;
+    database->values = (const uint8_t*)mapping + sizeof(EndgameHeader);
+    database->mapping = mapping;
+    database->mapping_size = status.st_size;
+    return database;
+}
+
+void closeEndgameDatabase(EndgameDatabase* database) {
+    if (database == NULL) return;
+    munmap(database->mapping, database->mapping_size);
+    free(database);
+}
+
+bool probeEndgame(const EndgameDatabase* database, const GameSnapshot* snapshot, EndgameResult* result) {
+    if (database == NULL) return false;
+    int64_t index = endgameIndex(snapshot, database->total_seeds, database->max_seeds);
+    if (index < 0) return false;
+
+    int value = database->values[index];
+    result->outcome = ENDGAME_IS_WIN(value) ? 1 : ENDGAME_IS_LOSS(value) ? -1 : 0;
+    result->plies = (value == ENDGAME_DRAW) ? 0 : ENDGAME_PLIES(value);
+    return true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// Endgame database: the exact result of every position with at most max_seeds seeds left on the board, in a game
+// played with total_seeds seeds, solved offline by build_endgame (src/tools) and read through mmap, so only the
+// probed pages are ever loaded.
+//
+// The seeds on the board and the points always add up to total_seeds, so the points of the side to play fix those
+// of the other side, and neither reaches 12 (the game would be over). A position is stored from the point of view
+// of the side to play (TOP positions are mirrored first), at
+//   endgameLayerOffset(total_seeds, seeds)
+//     + (points of the side to play - endgameLowestPoints(total_seeds, seeds)) * endgameBoardCount(seeds) + rank
+// where the rank numbers the ways to spread the seeds over the 12 houses: a perfect hash, without collisions or gaps.
+// Each position takes one byte: 0 for a draw, else who wins and in how many plies with best play.
+//
+// With 48 seeds in the game and a win at 12 points, a game in progress keeps at least 26 seeds on the board:
+// a database only has positions to hold for games set up with fewer seeds.
+
+
+#define ENDGAME_MAGIC "AWALEDB2"
+#define ENDGAME_MAX_SEEDS 12       // largest database the index supports, 30 MB at most
+#define ENDGAME_MAX_PLIES 126      // longest win a value can hold
+
+// one byte per position, from the point of view of the side to play
+#define ENDGAME_DRAW 0
+#define ENDGAME_WIN(plies) (1 + (plies))
+#define ENDGAME_LOSS(plies) (128 + (plies))
+#define ENDGAME_IS_WIN(value) ((value) >= 1 && (value) < 128)
+#define ENDGAME_IS_LOSS(value) ((value) >= 128)
+#define ENDGAME_PLIES(value) (ENDGAME_IS_LOSS(value) ? (value) - 128 : (value) - 1)
+
+typedef struct EndgameHeader {
+    char magic[8];          // ENDGAME_MAGIC, without the terminating 0
+    uint32_t max_seeds;
+    uint32_t total_seeds;
+    uint64_t positions;     // number of values following the header, endgameLayerOffset(total_seeds, max_seeds + 1)
+} EndgameHeader;
+
+typedef struct EndgameDatabase {
+    int max_seeds;
+    int total_seeds;
+    const uint8_t* values;  // indexed by endgameIndex
+    void* mapping;
+    size_t mapping_size;
+} EndgameDatabase;
+
+typedef struct EndgameResult {
+    int outcome;            // 1 if the side to play wins, -1 if it loses, 0 for a draw
+    int plies;              // moves until the end of the game with best play, 0 for a draw
+} EndgameResult;
+
+
+uint64_t endgameBoardCount(int seeds);
+// number of boards holding exactly this many seeds
+
+int endgamePointClasses(int total_seeds, int seeds);
+// number of points the side to play can have with this many seeds on the board, the game not being over
+
+int endgameLowestPoints(int total_seeds, int seeds);
+// fewest points the side to play can have with this many seeds on the board, the other side having 11 at most
+
+uint64_t endgameLayerOffset(int total_seeds, int seeds);
+// index of the first position with this many seeds on the board, also the number of positions with fewer
+
+uint64_t endgameBoardRank(const Board* board, int seeds);
+// rank of a board holding seeds seeds, in [0, endgameBoardCount(seeds))
+
+void endgameBoardUnrank(uint64_t rank, int seeds, Board* board);
+// inverse of endgameBoardRank
+
+int64_t endgameIndex(const GameSnapshot* snapshot, int total_seeds, int max_seeds);
+// index of a snapshot in a database of max_seeds for total_seeds, -1 if it is not covered:
+// more than max_seeds seeds on the board, a player already has 12 points, or the game has another number of seeds
+
+EndgameDatabase* openEndgameDatabase(const char* path);
+// maps a file written by build_endgame, NULL if it is missing or invalid
+
+void closeEndgameDatabase(EndgameDatabase* database);
+
+bool probeEndgame(const EndgameDatabase* database, const GameSnapshot* snapshot, EndgameResult* result);
+// fills result with the exact result of the snapshot, returns false if the database does not cover it
+// read only: safe to call from several threads at once
@@ -0,0 +1,325 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "engine.h"
+
+#define POINT_SCORE 16          // score unit: 1/16 point, so the mobility term only breaks ties
+#define NO_MOVE 15
+#define LIMIT_CHECK_INTERVAL 1023 // nodes between two reads of the clock
+
+#define BOUND_EXACT 0
+#define BOUND_LOWER 1           // score >= stored score (beta cutoff)
+#define BOUND_UPPER 2           // score <= stored score (no move raised alpha)
+
+// entry data: score (16 bits), depth (8), bound (2), move (4), generation (8)
+#define PACK_ENTRY(score, depth, bound, move, generation) \
+    ((uint64_t)(uint16_t)(score) | (uint64_t)(depth) << 16 | (uint64_t)(bound) << 24 \
+    | (uint64_t)(move) << 26 | (uint64_t)((generation) & 0xff) << 30)
+#define ENTRY_SCORE(data) ((int16_t)((data) & 0xffff))
+#define ENTRY_DEPTH(data) ((int)((data) >> 16 & 0xff))
+#define ENTRY_BOUND(data) ((int)((data) >> 24 & 0x3))
+#define ENTRY_MOVE(data) ((int)((data) >> 26 & 0xf))
+#define ENTRY_GENERATION(data) ((unsigned)((data) >> 30 & 0xff))
+
+// about 2 million nodes per second on one core: a hard move takes about 100 ms, a medium one 15 ms
+static const EngineLimits bot_levels[BOT_LEVEL_COUNT] = {
+    [BOT_EASY] = { 300, 2, 50 },
+    [BOT_MEDIUM] = { 30000, 8, 200 },
+    [BOT_HARD] = { 200000, ENGINE_MAX_PLY, 500 },
+};
+
+static const EndgameDatabase* endgame_database = NULL;
+
+typedef struct SearchContext {
+    const EngineLimits* limits;
+    TranspositionTable* table;
+    unsigned generation;
+    uint64_t nodes;
+    struct timespec deadline;
+    bool can_stop;          // false while searching depth 1
+    bool stopped;
+} SearchContext;
+
+
+void setEndgameDatabase(const EndgameDatabase* database) {
+    endgame_database = database;
+}
+
+EngineLimits botLevelLimits(BotLevel level) {
+    if (level < 0 || level >= BOT_LEVEL_COUNT) level = BOT_MEDIUM;
+    return bot_levels[level];
+}
+
+TranspositionTable* createTranspositionTable(int size_log2) {
+    TranspositionTable* table = malloc(sizeof(TranspositionTable));
+    if (table == NULL) return NULL;
+    table->entries = malloc(sizeof(TranspositionEntry) << size_log2);
+    if (table->entries == NULL) {
+        free(table);
+        return NULL;
+    }
+    table->mask = ((uint64_t)1 << size_log2) - 1;
+    atomic_init(&table->generation, 0);
+    clearTranspositionTable(table);
+    return table;
+}
+
+void freeTranspositionTable(TranspositionTable* table) {
+    if (table == NULL) return;
+    free(table->entries);
+    free(table);
+}
+
+void clearTranspositionTable(TranspositionTable* table) {
+    // an all-zero entry matches the key 0 only with a depth of 0, which never cuts
+    memset(table->entries, 0, sizeof(TranspositionEntry) * (table->mask + 1));
+}
+
+static bool probeEntry(TranspositionTable* table, uint64_t hash, uint64_t* data) {
+    TranspositionEntry* entry = &table->entries[hash & table->mask];
+    uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    uint64_t value = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    if ((check ^ value) != hash) return false;
+    *data = value;
+    return true;
+}
+
+static void storeEntry(SearchContext* context, uint64_t hash, int score, int depth, int bound, int move) {
+    TranspositionEntry* entry = &context->table->entries[hash & context->table->mask];
+    uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    uint64_t old = atomic_load_explicit(&entry->data, memory_order_relaxed);
+    // keep a deeper result of the same position or of the current search
+    bool same_position = (check ^ old) == hash;
+    bool current = ENTRY_GENERATION(old) == (context->generation & 0xff);
+    if ((same_position || current) && ENTRY_DEPTH(old) > depth + 2) return;
+    if (same_position && move == NO_MOVE) move = ENTRY_MOVE(old);
+
+    uint64_t data = PACK_ENTRY(score, depth, bound, move, context->generation);
+    atomic_store_explicit(&entry->check, hash ^ data, memory_order_relaxed);
+    atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+}
+
+// win scores depend on the distance to the root: the table stores them relative to the position instead
+static int scoreToTable(int score, int ply) {
+    if (score > ENGINE_WIN_SCORE - ENGINE_MAX_PLY) return score + ply;
+    if (score < -ENGINE_WIN_SCORE + ENGINE_MAX_PLY) return score - ply;
+    return score;
+}
+
+static int scoreFromTable(int score, int ply) {
+    if (score > ENGINE_WIN_SCORE - ENGINE_MAX_PLY) return score - ply;
+    if (score < -ENGINE_WIN_SCORE + ENGINE_MAX_PLY) return score + ply;
+    return score;
+}
+
+int evaluateSnapshot(const GameSnapshot* snapshot) {
+    Side side = snapshot->turn;
+    int points = (int)snapshot->points[side] - (int)snapshot->points[!side];
+
+    // a side with many playable houses is harder to starve
+    GameSnapshot other = *snapshot;
+    other.turn = !side;
+    int mobility = __builtin_popcount(generateLegalMoves(snapshot)) - __builtin_popcount(generateLegalMoves(&other));
+
+    return points * POINT_SCORE + mobility;
+}
+
+static int finalScore(const GameSnapshot* snapshot, int ply) {
+    // the side to play has no legal move (a player reaching 12 points is handled by the caller)
+    Side winner = whoHasWon(*snapshot);
+    if (winner == NO_SIDE) return 0;
+    return (winner == snapshot->turn) ? ENGINE_WIN_SCORE - ply : -ENGINE_WIN_SCORE + ply;
+}
+
+static int endgameScore(const EndgameResult* exact, int ply) {
+    // same scale as finalScore: a win sooner is worth more
+    if (exact->outcome == 0) return 0;
+    int score = ENGINE_WIN_SCORE - (ply + exact->plies);
+    return (exact->outcome > 0) ? score : -score;
+}
+
+static void checkLimits(SearchContext* context) {
+    if (!context->can_stop) return;
+    if (context->limits->max_nodes > 0 && context->nodes >= context->limits->max_nodes) {
+        context->stopped = true;
+        return;
+    }
+    if (context->limits->max_time_ms > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > context->deadline.tv_sec
+            || (now.tv_sec == context->deadline.tv_sec && now.tv_nsec >= context->deadline.tv_nsec)) {
+            context->stopped = true;
+        }
+    }
+}
+
+typedef struct Child {
+    GameSnapshot snapshot;
+    uint64_t hash;
+    int house;
+    int result;             // makeMove result, 1 if the move wins the game
+    int order;              // higher is searched first
+} Child;
+
+static int generateChildren(const GameSnapshot* snapshot, uint64_t hash, int first_move, Child children[6]) {
+    // plays every legal move into children, sorted by decreasing order
+    Side side = snapshot->turn;
+    int moves = generateLegalMoves(snapshot);
+    int first_house = (side == TOP) ? 6 : 0;
+    int count = 0;
+
+    while (moves) {
+        int house = first_house + __builtin_ctz(moves);
+        moves &= moves - 1;
+
+        Child* child = &children[count++];
+        MoveUndo undo;
+        child->snapshot = *snapshot;
+        child->result = makeMove(&child->snapshot, house, &undo);
+        child->hash = hash ^ undo.hash_delta;
+        child->house = house;
+        child->order = (house == first_move) ? 1000 : child->snapshot.points[side] - snapshot->points[side];
+
+        // insertion sort, there are at most 6 children
+        for (int i = count - 1; i > 0 && children[i].order > children[i - 1].order; --i) {
+            Child swap = children[i];
+            children[i] = children[i - 1];
+            children[i - 1] = swap;
+        }
+    }
+    return count;
+}
+
+static int search(SearchContext* context, const GameSnapshot* snapshot, uint64_t hash, int depth, int ply, int alpha, int beta) {
+    if ((++context->nodes & LIMIT_CHECK_INTERVAL) == 0) checkLimits(context);
+    if (context->stopped) return 0;
+
+    if (generateLegalMoves(snapshot) == 0) return finalScore(snapshot, ply);
+    EndgameResult exact;
+    if (probeEndgame(endgame_database, snapshot, &exact)) return endgameScore(&exact, ply);
+    if (depth <= 0 || ply >= ENGINE_MAX_PLY) return evaluateSnapshot(snapshot);
+
+    int table_move = NO_MOVE;
+    uint64_t data;
+    if (context->table != NULL && probeEntry(context->table, hash, &data)) {
+        table_move = ENTRY_MOVE(data);
+        if (ENTRY_DEPTH(data) >= depth) {
+            int score = scoreFromTable(ENTRY_SCORE(data), ply);
+            int bound = ENTRY_BOUND(data);
+            if (bound == BOUND_EXACT
+                || (bound == BOUND_LOWER && score >= beta)
+                || (bound == BOUND_UPPER && score <= alpha)) {
+                return score;
+            }
+        }
+    }
+
+    Child children[6];
+    int count = generateChildren(snapshot, hash, table_move, children);
+
+    int original_alpha = alpha;
+    int best_score = -ENGINE_WIN_SCORE - 1;
+    int best_move = NO_MOVE;
+    for (int i = 0; i < count; ++i) {
+        int score = (children[i].result == 1)
+            ? ENGINE_WIN_SCORE - (ply + 1)
+            : -search(context, &children[i].snapshot, children[i].hash, depth - 1, ply + 1, -beta, -alpha);
+        if (context->stopped) return 0;
+
+        if (score > best_score) {
+            best_score = score;
+            best_move = children[i].house;
+        }
+        if (score > alpha) alpha = score;
+        if (alpha >= beta) break;
+    }
+
+    if (context->table != NULL) {
+        int bound = (best_score >= beta) ? BOUND_LOWER : (best_score > original_alpha) ? BOUND_EXACT : BOUND_UPPER;
+        storeEntry(context, hash, scoreToTable(best_score, ply), depth, bound, best_move);
+    }
+    return best_score;
+}
+
+static bool endgameMove(const GameSnapshot* snapshot, EngineResult* result) {
+    // plays the move of the database if it covers the root, returns false otherwise
+    EndgameResult exact;
+    if (!probeEndgame(endgame_database, snapshot, &exact)) return false;
+
+    Child children[6];
+    int count = generateChildren(snapshot, 0, NO_MOVE, children);
+    result->score = -ENGINE_WIN_SCORE - 1;
+    for (int i = 0; i < count; ++i) {
+        int score = ENGINE_WIN_SCORE - 1;
+        if (children[i].result != 1) {
+            probeEndgame(endgame_database, &children[i].snapshot, &exact);
+            score = -endgameScore(&exact, 1);
+        }
+        if (score > result->score) {
+            result->score = score;
+            result->house = children[i].house;
+        }
+    }
+    result->depth = 1;
+    result->nodes = count;
+    result->from_endgame = true;
+    return true;
+}
+
+EngineResult searchBestMove(const GameSnapshot* snapshot, const EngineLimits* limits, TranspositionTable* table) {
+    SearchContext context;
+    memset(&context, 0, sizeof(context));
+    context.limits = limits;
+    context.table = table;
+    if (table != NULL) context.generation = atomic_fetch_add(&table->generation, 1) + 1;
+    clock_gettime(CLOCK_MONOTONIC, &context.deadline);
+    context.deadline.tv_sec += limits->max_time_ms / 1000;
+    context.deadline.tv_nsec += (long)(limits->max_time_ms % 1000) * 1000000;
+    if (context.deadline.tv_nsec >= 1000000000) {
+        context.deadline.tv_sec++;
+        context.deadline.tv_nsec -= 1000000000;
+    }
+
+    EngineResult result = { -1, 0, 0, 0, false };
+    if (generateLegalMoves(snapshot) == 0) return result;
+    if (endgameMove(snapshot, &result)) return result;
+
+    uint64_t hash = snapshotHash(snapshot);
+    int max_depth = (limits->max_depth > 0 && limits->max_depth <= ENGINE_MAX_PLY) ? limits->max_depth : ENGINE_MAX_PLY;
+    int best_move = NO_MOVE;
+
+    for (int depth = 1; depth <= max_depth; ++depth) {
+        context.can_stop = (depth > 1);
+
+        Child children[6];
+        int count = generateChildren(snapshot, hash, best_move, children);
+        int alpha = -ENGINE_WIN_SCORE - 1;
+        int depth_best_move = children[0].house;
+        for (int i = 0; i < count; ++i) {
+            int score = (children[i].result == 1)
+                ? ENGINE_WIN_SCORE - 1
+                : -search(&context, &children[i].snapshot, children[i].hash, depth - 1, 1, -ENGINE_WIN_SCORE - 1, -alpha);
+            if (context.stopped) break;
+            if (score > alpha) {
+                alpha = score;
+                depth_best_move = children[i].house;
+            }
+        }
+        if (context.stopped) break;
+
+        best_move = depth_best_move;
+        result.house = best_move;
+        result.score = alpha;
+        result.depth = depth;
+
+        // a forced win or loss was found, searching deeper cannot change it
+        if (alpha > ENGINE_WIN_SCORE - ENGINE_MAX_PLY || alpha < -ENGINE_WIN_SCORE + ENGINE_MAX_PLY) break;
+    }
+
+    result.nodes = context.nodes;
+    return result;
+}
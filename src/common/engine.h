@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "game.h"
+#include "endgame.h"
+
+// Alpha-beta search over GameSnapshots, used by the server bots.
+// The search only works on bare snapshots (makeMove / applyMove), never on a Game, and does not allocate:
+// children live on the stack, 16 bytes each.
+//
+// Iterative deepening: depth 1, 2, ... are searched until a limit is hit, the best move of the last
+// completed depth is played. Moves are ordered with the transposition table move first, then captures.
+//
+// The transposition table can be shared by several searches running at the same time in different threads:
+// each entry is two 64-bit words written without locks, the first one being the key xor the second one,
+// so a torn entry (words from two different writes) fails the key check and is ignored.
+//
+// Positions covered by the endgame database are not searched: their exact score is read from it, and a root
+// position it covers gets its move without any search.
+
+
+#define ENGINE_MAX_PLY 128
+#define ENGINE_WIN_SCORE 30000 // score of a won position, minus the number of plies to reach it
+
+typedef enum BotLevel {
+    BOT_EASY = 0,
+    BOT_MEDIUM,
+    BOT_HARD,
+    BOT_LEVEL_COUNT,
+} BotLevel;
+
+typedef struct EngineLimits {
+    uint64_t max_nodes;     // the search stops after this many nodes (0: no limit)
+    int max_depth;          // in plies, at most ENGINE_MAX_PLY
+    int max_time_ms;        // the search stops after this many milliseconds (0: no limit)
+} EngineLimits;
+// depth 1 is always searched in full, so a move is returned whatever the limits
+
+typedef struct EngineResult {
+    int house;              // best move found, -1 if the side to play has no legal move
+    int score;              // from the point of view of the side to play, in 1/16 points
+    int depth;              // last depth searched in full
+    uint64_t nodes;         // positions visited
+    bool from_endgame;      // the move was read from the endgame database, nothing was searched
+} EngineResult;
+
+typedef struct TranspositionEntry {
+    _Atomic uint64_t check;  // hash ^ data
+    _Atomic uint64_t data;   // packed score, depth, bound, move and generation
+} TranspositionEntry;
+
+typedef struct TranspositionTable {
+    TranspositionEntry* entries;
+    uint64_t mask;          // entry count - 1
+    atomic_uint generation; // incremented by each search, older entries are replaced first
+} TranspositionTable;
+
+
+EngineLimits botLevelLimits(BotLevel level);
+// node, depth and time budget of a difficulty level, the node budget keeps a move under a few milliseconds
+
+TranspositionTable* createTranspositionTable(int size_log2);
+// table of 2^size_log2 entries of 16 bytes, NULL if memory is exhausted
+
+void freeTranspositionTable(TranspositionTable* table);
+
+void clearTranspositionTable(TranspositionTable* table);
+// must not be called while a search uses the table
+
+EngineResult searchBestMove(const GameSnapshot* snapshot, const EngineLimits* limits, TranspositionTable* table);
+// searches the best move of the side to play, table may be NULL
+// safe to call from several threads at once, sharing the same table
+
+void setEndgameDatabase(const EndgameDatabase* database);
+// database probed by every search from now on, NULL to stop probing
+// must be set before searches start, the database is then only read
+
+int evaluateSnapshot(const GameSnapshot* snapshot);
+// static evaluation from the point of view of the side to play, in 1/16 points
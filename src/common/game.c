@@ -4,62 +4,288 @@
 #include <string.h>
 
 #include "game.h"
+#include "pool.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define HASHED_BYTES 15 // houses, turn and points: the whole snapshot but its padding
+
+// users and games are created and destroyed all the time by the server, they come from slab pools
+static Pool user_pool = POOL_INITIALIZER(User, 256);
+static Pool game_pool = POOL_INITIALIZER(Game, 128);
 
 User* createUser(const char name[], int fd) {
     static int id_count = 0;
 
-    User* user = (User*) calloc(1, sizeof(User));
+    User* user = (User*) poolAlloc(&user_pool);
+    if (user == NULL) return NULL;
     strcpy(user->username, name);
     user->fd = fd;
     user->id = id_count++;
+    user->observer_slot = -1;
+    user->bot_profile = -1;
 
     return user;
 }
 
 Game* initGame(User * user1, User * user2) {
 
-    Game* game = (Game*) calloc(1, sizeof(Game));
+    Game* game = (Game*) poolAlloc(&game_pool);
+    if (game == NULL) return NULL;
 
     // create players
     game->players[0] = user1;
     game->players[1] = user2;
     
-    // fill houses with 4 seeds
-    for (int i = 0; i < 12; ++i) {
-        game->snapshot.board.houses[i].seeds = 4;
-    }
-    game->snapshot.turn = BOTTOM;
-    game->snapshot.points[0] = 0;
-    game->snapshot.points[1] = 0;
+    setupGame(game);
 
     return game;
 }
 
 void setupGame(Game* game) {
     // fill houses with 4 seeds
-    for (int i = 0; i < 12; ++i) {
-        game->snapshot.board.houses[i].seeds = 4;
-    }
+    memset(&game->snapshot, 0, sizeof(GameSnapshot));
+    memset(game->snapshot.board.seeds, 4, sizeof(game->snapshot.board.seeds));
     game->snapshot.turn = BOTTOM;
-    game->snapshot.points[0] = 0;
-    game->snapshot.points[1] = 0;
+    game->sequence = 0;
+    game->hash = snapshotHash(&game->snapshot);
+    game->recorded_moves = 0;
+}
+
+
+void freeGame(Game* game) {
+    if (game == NULL) return;
+    free(game->observers);
+    free(game->moves);
+    poolFree(&game_pool, game);
+}
+
+void freeUser(User* user) {
+    poolFree(&user_pool, user);
+}
+
+void setPendingGame(User* user, Game* game) {
+    user->pending_game = game;
+    user->pending_generation = (game != NULL) ? poolGeneration(game) : 0;
+}
+
+Game* pendingGame(User* user) {
+    if (user->pending_game != NULL && !poolIsLive(user->pending_game, user->pending_generation)) {
+        fprintf(stderr, "error: user %d (%s) kept a pointer to a freed game invite.\n", user->id, user->username);
+        setPendingGame(user, NULL);
+    }
+    return user->pending_game;
+}
+
+void printObjectPoolStats(FILE* out) {
+    printPoolStats(out, &user_pool);
+    printPoolStats(out, &game_pool);
+}
+
+bool addGameObserver(Game* game, User* observer) {
+    if (game->observers_count >= game->observers_capacity) {
+        int new_capacity = game->observers_capacity ? game->observers_capacity * 2 : 8;
+        User** grown = realloc(game->observers, new_capacity * sizeof(User*));
+        if (grown == NULL) return false;
+        game->observers = grown;
+        game->observers_capacity = new_capacity;
+    }
+    observer->observer_slot = game->observers_count;
+    observer->observed_game = game;
+    game->observers[game->observers_count++] = observer;
+    return true;
 }
 
+void removeGameObserver(Game* game, User* observer) {
+    int slot = observer->observer_slot;
+    if (slot < 0 || slot >= game->observers_count || game->observers[slot] != observer) return;
+
+    // the last observer takes the freed slot
+    User* last = game->observers[--game->observers_count];
+    game->observers[slot] = last;
+    last->observer_slot = slot;
+    observer->observed_game = NULL;
+    observer->observer_slot = -1;
+}
 
 int next_house(int house) {
     return (house+1)%12;
 }
 
 int precedent_house(int house) {
-    return (house-1)%12;
+    return (house+11)%12;
+}
+
+// sowing_distance[origin][house] is the rank of house in the sowing order starting after origin:
+// 0 for the next house, 10 for the one before origin.
+// origin itself and the 4 bytes after the board get 0x7f, so they never receive seeds.
+static const uint8_t sowing_distance[12][16] = {
+#define D(o, h) ((h) == (o) ? 0x7f : ((h) - (o) + 11) % 12)
+#define ROW(o) { D(o,0), D(o,1), D(o,2), D(o,3), D(o,4), D(o,5), D(o,6), D(o,7), D(o,8), D(o,9), D(o,10), D(o,11), \
+    0x7f, 0x7f, 0x7f, 0x7f }
+    ROW(0), ROW(1), ROW(2), ROW(3), ROW(4), ROW(5), ROW(6), ROW(7), ROW(8), ROW(9), ROW(10), ROW(11),
+#undef ROW
+#undef D
+};
+
+static void spreadSeeds(GameSnapshot* snapshot, int origin, int seeds, int direction) {
+    // adds (direction 1) or removes (direction -1) the seeds sown from origin, origin itself is left as it is
+    // a lap gives one seed to each of the 11 other houses, so instead of walking seed by seed every house
+    // gets the number of full laps, and the first (seeds % 11) houses after origin get one more:
+    // the cost does not depend on the number of seeds
+    uint8_t laps = seeds / 11;
+    uint8_t remainder = seeds % 11;
+
+#ifdef __SSE2__
+    __m128i distance = _mm_loadu_si128((const __m128i*)sowing_distance[origin]);
+    __m128i state = _mm_loadu_si128((const __m128i*)snapshot);
+    // distance < 11 selects the houses other than origin, distance < remainder the ones of the partial lap
+    __m128i lap_houses = _mm_cmplt_epi8(distance, _mm_set1_epi8(11));
+    __m128i extra_houses = _mm_cmplt_epi8(distance, _mm_set1_epi8(remainder));
+    __m128i sown = _mm_add_epi8(_mm_and_si128(lap_houses, _mm_set1_epi8(laps)),
+                                _mm_and_si128(extra_houses, _mm_set1_epi8(1)));
+    state = (direction > 0) ? _mm_add_epi8(state, sown) : _mm_sub_epi8(state, sown);
+    _mm_storeu_si128((__m128i*)snapshot, state);
+#else
+    const uint8_t* distance = sowing_distance[origin];
+    for (int i = 0; i < 12; ++i) {
+        snapshot->board.seeds[i] += direction * (laps * (distance[i] < 11) + (distance[i] < remainder));
+    }
+#endif
+}
+
+static int sowSeeds(GameSnapshot* snapshot, int origin) {
+    // sows the seeds of origin and returns the last house filled
+    int seeds = snapshot->board.seeds[origin];
+    spreadSeeds(snapshot, origin, seeds, 1);
+    snapshot->board.seeds[origin] = 0;
+
+    return (origin + 1 + (seeds - 1) % 11) % 12;
+}
+
+static int playHouse(GameSnapshot* snapshot, Side turn, int selected_house, MoveUndo* undo);
+
+static void recordMove(Game* game, int house) {
+    // the history stops at the first allocation failure, recorded_moves then stays behind sequence
+    if (game->recorded_moves != game->sequence) return;
+    if (game->recorded_moves >= game->moves_capacity) {
+        int new_capacity = game->moves_capacity ? game->moves_capacity * 2 : 64;
+        uint8_t* grown = realloc(game->moves, new_capacity);
+        if (grown == NULL) return;
+        game->moves = grown;
+        game->moves_capacity = new_capacity;
+    }
+    game->moves[game->recorded_moves++] = house;
 }
 
 int playMove(Game* game, Side turn, int selected_house) {
+    MoveUndo undo;
+    int result = playHouse(&game->snapshot, turn, selected_house, &undo);
+    if (result >= 0) {
+        recordMove(game, selected_house);
+        game->sequence++;
+        game->hash ^= undo.hash_delta;
+    }
+    return result;
+}
+
+// pseudo-random key of each (snapshot byte, value) pair: splitmix64 of the pair
+// the table is computed by the compiler, so there is nothing to initialize or share between threads
+// values are masked to 6 bits, a house never holds more than 48 seeds
+#define MIX1(x) ((x) * 0x9e3779b97f4a7c15ull)
+#define MIX2(z) (((z) ^ ((z) >> 30)) * 0xbf58476d1ce4e5b9ull)
+#define MIX3(z) (((z) ^ ((z) >> 27)) * 0x94d049bb133111ebull)
+#define MIX4(z) ((z) ^ ((z) >> 31))
+#define KEY(p, v) MIX4(MIX3(MIX2(MIX1((uint64_t)(p) << 8 | (uint64_t)(v)))))
+#define KEYS8(p, v) KEY(p, v), KEY(p, v + 1), KEY(p, v + 2), KEY(p, v + 3), \
+    KEY(p, v + 4), KEY(p, v + 5), KEY(p, v + 6), KEY(p, v + 7)
+#define KEYS(p) { KEYS8(p, 0), KEYS8(p, 8), KEYS8(p, 16), KEYS8(p, 24), \
+    KEYS8(p, 32), KEYS8(p, 40), KEYS8(p, 48), KEYS8(p, 56) }
+static const uint64_t zobrist_keys[HASHED_BYTES][64] = {
+    KEYS(0), KEYS(1), KEYS(2), KEYS(3), KEYS(4), KEYS(5), KEYS(6), KEYS(7),
+    KEYS(8), KEYS(9), KEYS(10), KEYS(11), KEYS(12), KEYS(13), KEYS(14),
+};
+#undef KEYS
+#undef KEYS8
+#undef KEY
+
+static uint64_t zobristKey(int position, int value) {
+    return zobrist_keys[position][value & 63];
+}
+
+static uint64_t hashDifference(const GameSnapshot* before, const GameSnapshot* after) {
+    // xor of the keys of the bytes that changed, old value out and new value in
+#ifdef __SSE2__
+    __m128i a = _mm_loadu_si128((const __m128i*)before);
+    __m128i b = _mm_loadu_si128((const __m128i*)after);
+    int changed = ~_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0x7fff;
+#else
+    int changed = 0;
+    for (int i = 0; i < HASHED_BYTES; ++i) {
+        changed |= (((const uint8_t*)before)[i] != ((const uint8_t*)after)[i]) << i;
+    }
+#endif
+    uint64_t delta = 0;
+    while (changed) {
+        int i = __builtin_ctz(changed);
+        delta ^= zobristKey(i, ((const uint8_t*)before)[i]) ^ zobristKey(i, ((const uint8_t*)after)[i]);
+        changed &= changed - 1;
+    }
+    return delta;
+}
+
+uint64_t snapshotHash(const GameSnapshot* snapshot) {
+    uint64_t hash = 0;
+    for (int i = 0; i < HASHED_BYTES; ++i) {
+        hash ^= zobristKey(i, ((const uint8_t*)snapshot)[i]);
+    }
+    return hash;
+}
+
+void mirrorSnapshot(const GameSnapshot* snapshot, GameSnapshot* out) {
+    GameSnapshot mirrored;
+    for (int i = 0; i < 12; ++i) {
+        mirrored.board.seeds[i] = snapshot->board.seeds[(i + 6) % 12];
+    }
+    mirrored.turn = !snapshot->turn;
+    mirrored.points[BOTTOM] = snapshot->points[TOP];
+    mirrored.points[TOP] = snapshot->points[BOTTOM];
+    mirrored.unused = 0;
+    *out = mirrored;
+}
+
+uint64_t canonicalSnapshotHash(const GameSnapshot* snapshot) {
+    if (snapshot->turn == BOTTOM) return snapshotHash(snapshot);
+    GameSnapshot mirrored;
+    mirrorSnapshot(snapshot, &mirrored);
+    return snapshotHash(&mirrored);
+}
+
+int32_t snapshotChecksum(const GameSnapshot* snapshot) {
+    // FNV-1a over the houses, the turn and the points, folded to 16 bits to stay short on the wire
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 12; ++i) {
+        hash ^= snapshot->board.seeds[i];
+        hash *= 16777619u;
+    }
+    hash ^= (uint32_t)snapshot->turn;
+    hash *= 16777619u;
+    hash ^= snapshot->points[BOTTOM] | (snapshot->points[TOP] << 8);
+    hash *= 16777619u;
+    return (int32_t)((hash >> 16) ^ (hash & 0xffff));
+}
+
+static int playHouse(GameSnapshot* snapshot, Side turn, int selected_house, MoveUndo* undo) {
 
     // check inputs
     if (turn != TOP && turn != BOTTOM) {
         return -1;
     }
+    if (selected_house < 0 || selected_house > 11) {
+        return -1;
+    }
     if (turn == TOP && selected_house < 6) {
         return -2;
     }
@@ -67,29 +293,32 @@ int playMove(Game* game, Side turn, int selected_house) {
         return -3;
     }
     
-    if (game->snapshot.board.houses[selected_house].seeds == 0) {
+    if (snapshot->board.seeds[selected_house] == 0) {
         return -4;
     }
 
+    GameSnapshot before = *snapshot;
+    int result = 0;
+    undo->house = selected_house;
+    undo->seeds = snapshot->board.seeds[selected_house];
+    undo->turn = snapshot->turn;
+    undo->captured_houses = 0;
+    undo->captured_threes = 0;
+
     // play the move : dispatch the seeds
-    int seeds_to_dispatch = game->snapshot.board.houses[selected_house].seeds;
-    int house_to_fill = selected_house;
-    while (seeds_to_dispatch > 0) {
-        house_to_fill = next_house(house_to_fill);
-        if (house_to_fill == selected_house) continue;
-        ++(game->snapshot.board.houses[house_to_fill].seeds);
-        --seeds_to_dispatch;
-    }
-    game->snapshot.board.houses[selected_house].seeds = 0;
+    int house_to_fill = sowSeeds(snapshot, selected_house);
+    undo->last_house = house_to_fill;
 
     // check if there were seeds captured
     bool capturableSeeds = true;
     int house_to_check = house_to_fill;
     while (capturableSeeds) {
-        int seeds = game->snapshot.board.houses[house_to_check].seeds;
+        int seeds = snapshot->board.seeds[house_to_check];
         if ( house_ownership(house_to_check) != turn && (seeds == 2 || seeds == 3) ) {
-            game->snapshot.points[turn] += game->snapshot.board.houses[house_to_check].seeds;
-            game->snapshot.board.houses[house_to_check].seeds = 0;
+            snapshot->points[turn] += seeds;
+            snapshot->board.seeds[house_to_check] = 0;
+            if (seeds == 3) undo->captured_threes |= 1 << undo->captured_houses;
+            undo->captured_houses++;
         }
         else {
             capturableSeeds = false;
@@ -98,14 +327,87 @@ int playMove(Game* game, Side turn, int selected_house) {
     }
     
     //game ends whenever a player reaches 12 points
-    if (game->snapshot.points[turn] >= 12) {
-        return 1;
+    if (snapshot->points[turn] >= 12) {
+        result = 1;
+    }
+    else {
+        // turn is over, change game turn
+        snapshot->turn = !(snapshot->turn);
     }
 
-    // turn is over, change game turn
-    game->snapshot.turn = !(game->snapshot.turn);
-    
-    return 0;
+    // only the houses sown or captured, the turn and the score changed: their keys are enough to update the hash
+    undo->hash_delta = hashDifference(&before, snapshot);
+    return result;
+}
+
+int playSnapshotMove(GameSnapshot* snapshot, Side turn, int selected_house) {
+    MoveUndo undo;
+    return playHouse(snapshot, turn, selected_house, &undo);
+}
+
+int applyMove(const GameSnapshot* snapshot, int selected_house, GameSnapshot* out) {
+    *out = *snapshot;
+    MoveUndo undo;
+    int result = playHouse(out, snapshot->turn, selected_house, &undo);
+    if (result < 0) *out = *snapshot;
+    return result;
+}
+
+int makeMove(GameSnapshot* snapshot, int selected_house, MoveUndo* undo) {
+    return playHouse(snapshot, snapshot->turn, selected_house, undo);
+}
+
+void unmakeMove(GameSnapshot* snapshot, const MoveUndo* undo) {
+    // give the captured seeds back, from the last house sown backwards
+    Side player = undo->turn;
+    int house = undo->last_house;
+    for (int i = 0; i < undo->captured_houses; ++i) {
+        int seeds = (undo->captured_threes >> i & 1) ? 3 : 2;
+        snapshot->board.seeds[house] = seeds;
+        snapshot->points[player] -= seeds;
+        house = precedent_house(house);
+    }
+
+    spreadSeeds(snapshot, undo->house, undo->seeds, -1);
+    snapshot->board.seeds[undo->house] = undo->seeds;
+    snapshot->turn = player;
+}
+
+int generateLegalMoves(const GameSnapshot* snapshot) {
+    int first_house = (snapshot->turn == TOP) ? 6 : 0;
+#ifdef __SSE2__
+    // one bit per byte of the snapshot, set for the houses holding seeds
+    __m128i state = _mm_loadu_si128((const __m128i*)snapshot);
+    int filled = ~_mm_movemask_epi8(_mm_cmpeq_epi8(state, _mm_setzero_si128()));
+    return (filled >> first_house) & 0x3f;
+#else
+    int moves = 0;
+    for (int i = 0; i < 6; ++i) {
+        moves |= (snapshot->board.seeds[first_house + i] != 0) << i;
+    }
+    return moves;
+#endif
+}
+
+bool isTerminal(const GameSnapshot* snapshot) {
+    return snapshot->points[BOTTOM] >= 12 || snapshot->points[TOP] >= 12 || generateLegalMoves(snapshot) == 0;
+}
+
+char isGameOver(GameSnapshot snapshot) {
+    return isTerminal(&snapshot);
+}
+
+Side whoHasWon(GameSnapshot snapshot) {
+    if (snapshot.points[BOTTOM] >= 12) return BOTTOM;
+    if (snapshot.points[TOP] >= 12) return TOP;
+
+    // the side to play has no seeds left: each player takes the seeds remaining on its side
+    int totals[2] = { snapshot.points[BOTTOM], snapshot.points[TOP] };
+    for (int i = 0; i < 12; ++i) {
+        totals[house_ownership(i)] += snapshot.board.seeds[i];
+    }
+    if (totals[BOTTOM] == totals[TOP]) return NO_SIDE;
+    return (totals[BOTTOM] > totals[TOP]) ? BOTTOM : TOP;
 }
 
 Side house_ownership(int house) {
@@ -126,14 +428,14 @@ void simpleGamePrinting(Game* game) {
 
     // print top side
     for (int i = 11; i > 5; --i) {
-        printf(" %d ", game->snapshot.board.houses[i].seeds);
+        printf(" %d ", game->snapshot.board.seeds[i]);
     }
 
     printf("\n");
 
     // print bottom side
     for (int i = 0; i < 6; ++i) {
-        printf(" %d ", game->snapshot.board.houses[i].seeds);
+        printf(" %d ", game->snapshot.board.seeds[i]);
     }
     printf("\n\n");
 }
@@ -142,14 +444,14 @@ void simpleSnapshotPrinting(GameSnapshot* snapshot) {
 
     // print top side
     for (int i = 11; i > 5; --i) {
-        printf(" %d ", snapshot->board.houses[i].seeds);
+        printf(" %d ", snapshot->board.seeds[i]);
     }
 
     printf("\n");
 
     // print bottom side
     for (int i = 0; i < 6; ++i) {
-        printf(" %d ", snapshot->board.houses[i].seeds);
+        printf(" %d ", snapshot->board.seeds[i]);
     }
     printf("\n\n");
 }
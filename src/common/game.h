@@ -1,10 +1,12 @@
 #pragma once 
 
+#include <stdint.h>
+#include <stdio.h>
+
 
 // constants 
 
 #define USERNAME_LENGTH 100 // or 25 4-bytes UTF-8 chars
-#define MAX_OBSERVERS 10
 #define true 1
 #define false 0
 #define bool char
@@ -12,10 +14,6 @@
 // data structures 
 typedef struct Game Game;
 
-typedef struct House {
-    unsigned int seeds;
-} House;
-
 typedef enum Side {
     BOTTOM = 0,
     TOP = 1,
@@ -27,12 +25,15 @@ typedef struct User {
     int fd;
     char username[USERNAME_LENGTH];
     Game* active_game;
-    Game* pending_game;     // placeholder for when an invitation is received
+    Game* pending_game;     // placeholder for when an invitation is received, use pendingGame() to read it
+    uint32_t pending_generation; // pool generation of pending_game when it was set
     Game* observed_game; 
+    int observer_slot;      // index in observed_game->observers
+    int bot_profile;        // index of the profile of a bot played by the server (see bots.c), -1 for a human
 } User;
 
 typedef struct Board {
-    House houses[12];
+    uint8_t seeds[12];      // 48 seeds in total, a byte per house is enough
 } Board;
 // houses are filled the following way in the array;
 //  11 10 9  8  7  6
@@ -40,17 +41,37 @@ typedef struct Board {
 
 typedef struct GameSnapshot {
     Board board; 
-    Side turn;              // whose turn it is;
-    unsigned int points[2]; 
+    uint8_t turn;           // whose turn it is (a Side)
+    uint8_t points[2]; 
+    uint8_t unused;         // pads the snapshot to 16 bytes, always 0
 } GameSnapshot; 
+// 16 bytes: a snapshot is copied, sent and sown with a single 128-bit register
+_Static_assert(sizeof(GameSnapshot) == 16, "GameSnapshot must stay 16 bytes");
+
+typedef struct MoveUndo {
+    uint8_t house;          // house played
+    uint8_t seeds;          // seeds it held
+    uint8_t last_house;     // last house sown, the captures go backwards from it
+    uint8_t turn;           // side that played
+    uint8_t captured_houses; // number of houses captured (at most 6)
+    uint8_t captured_threes; // bit i is set if the i-th captured house held 3 seeds, 2 otherwise
+    uint64_t hash_delta;    // snapshotHash before the move ^ snapshotHash after it
+} MoveUndo;
+// what makeMove changed in a snapshot, enough for unmakeMove to restore it
 
 typedef struct Game {
     bool accepted_game;
     bool cancelled_game;
     User* players[2];      // players[TOP] and players[BOTTOM]
-    User* observers[MAX_OBSERVERS];
+    User** observers;       // grown on demand
     int observers_count;
+    int observers_capacity;
     GameSnapshot snapshot;
+    int32_t sequence;       // number of moves played
+    uint64_t hash;          // snapshotHash(&snapshot), kept up to date by playMove
+    uint8_t* moves;         // houses played, grown on demand
+    int32_t moves_capacity;
+    int32_t recorded_moves; // moves kept in moves, less than sequence once memory was exhausted
 } Game;
 
 
@@ -60,27 +81,86 @@ void simpleGamePrinting(Game* game);
 // simply print the state of a game
 
 Game* initGame(User* user1, User* user2);
-// init a game between users
+// init a game between users, allocated from the game pool (NULL if memory is exhausted)
 
 void setupGame(Game* game);
 
+void freeGame(Game* game);
+// give a game back to the pool and free its observer set (not the users)
+
+void setPendingGame(User* user, Game* game);
+// sets (or clears with NULL) the invitation of an user, remembering the game generation
+
+Game* pendingGame(User* user);
+// returns the pending game of an user, or NULL
+// a pending game freed without clearing the user is reported, cleared and NULL is returned
+
+bool addGameObserver(Game* game, User* observer);
+// adds observer to the observer set and sets its observed game
+// returns false if memory is exhausted
+
+void removeGameObserver(Game* game, User* observer);
+// removes observer from the observer set in O(1) and clears its observed game
+
 User* createUser(const char name[], int fd) ;
-// create an user with a name and a unique id
+// create an user with a name and a unique id, allocated from the user pool (NULL if memory is exhausted)
+
+void freeUser(User* user);
+// give an user back to the pool
+
+void printObjectPoolStats(FILE* out);
+// print the occupancy of the user and game pools
 
 int playMove(Game* game, Side turn, int selected_house);
-// play the action of a move and updates the game snapshot
+// play the action of a move and updates the game snapshot, the house is added to game->moves
 // returns:
 // - a negative value if the move was not allowed
 // - 0 if move was valid
 // - 1 if game reached the end (user reached 12 points)
 
+int playSnapshotMove(GameSnapshot* snapshot, Side turn, int selected_house);
+// same as playMove on a bare snapshot, used by clients to replay the moves announced by the server
+
+int applyMove(const GameSnapshot* snapshot, int selected_house, GameSnapshot* out);
+// plays selected_house for the side whose turn it is into out, snapshot is left untouched
+// returns the same values as playMove, out is a copy of snapshot if the move was not allowed
+
+int makeMove(GameSnapshot* snapshot, int selected_house, MoveUndo* undo);
+// plays selected_house for the side whose turn it is in place, and fills undo if the move was allowed
+// returns the same values as playMove
+
+void unmakeMove(GameSnapshot* snapshot, const MoveUndo* undo);
+// takes back the last move made on snapshot by makeMove
+// moves must be unmade in the reverse order they were made
+
+uint64_t snapshotHash(const GameSnapshot* snapshot);
+// 64-bit Zobrist hash of the houses, the turn and the points
+// computed from scratch, a search should rather xor the hash_delta of each MoveUndo
+
+void mirrorSnapshot(const GameSnapshot* snapshot, GameSnapshot* out);
+// swaps the TOP and BOTTOM sides: houses, turn and points (snapshot and out may be the same)
+
+uint64_t canonicalSnapshotHash(const GameSnapshot* snapshot);
+// hash of the snapshot seen from the side to play, a position and its mirror get the same key
+
+int32_t snapshotChecksum(const GameSnapshot* snapshot);
+// 16-bit hash of a snapshot, lets a client replaying moves detect that it drifted from the server
+
 void finishGame(Game* game);
 
+int generateLegalMoves(const GameSnapshot* snapshot);
+// returns the moves of the side whose turn it is as a 6-bit mask
+// bit i stands for the i-th house of that side (house i for BOTTOM, house 6 + i for TOP)
+
+bool isTerminal(const GameSnapshot* snapshot);
+// tells whether the game is over: a player reached 12 points, or the side to play has no legal move
+
 char isGameOver(GameSnapshot snapshot);
-// tells whether the game is over by checking if any of the players has more than 12 points 
+// same as isTerminal
 
 Side whoHasWon(GameSnapshot snapshot);
-// return which player has won
+// return which player has won a finished game, NO_SIDE on a draw
+// when the side to play has no legal move, each player adds the seeds left on its side to its points
 
 void simpleSnapshotPrinting(GameSnapshot* snapshot);
 
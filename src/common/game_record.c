@@ -0,0 +1,83 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <string.h>
+
+#include "game_record.h"
+
+
+bool writeGameRecordHeader(FILE* file, uint64_t seed, int seeds_per_house, int player_count, const char* const names[]) {
+    GameRecordFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GAME_RECORD_MAGIC, sizeof(header.magic));
+    header.seed = seed;
+    header.player_count = player_count;
+    header.seeds_per_house = seeds_per_house;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) return false;
+
+    for (int i = 0; i < player_count; ++i) {
+        char name[GAME_RECORD_NAME_LENGTH] = { 0 };
+        memcpy(name, names[i], strnlen(names[i], GAME_RECORD_NAME_LENGTH));
+        if (fwrite(name, GAME_RECORD_NAME_LENGTH, 1, file) != 1) return false;
+    }
+    return true;
+}
+
+size_t encodeGameRecord(uint8_t* out, const GameRecord* record, const uint8_t houses[]) {
+    memcpy(out, record, sizeof(GameRecord));
+    uint8_t* moves = out + sizeof(GameRecord);
+    memset(moves, 0, (record->move_count + 1) / 2);
+    for (int i = 0; i < record->move_count; ++i) moves[i / 2] |= (houses[i] % 6) << (4 * (i % 2));
+    return GAME_RECORD_LENGTH(record->move_count);
+}
+
+bool writeGameRecord(FILE* file, const GameRecord* record, const uint8_t houses[]) {
+    uint8_t encoded[GAME_RECORD_LENGTH(GAME_RECORD_MAX_MOVES)];
+    size_t length = encodeGameRecord(encoded, record, houses);
+    return fwrite(encoded, length, 1, file) == 1;
+}
+
+bool readGameRecordHeader(FILE* file, GameRecordFileHeader* header, char names[][GAME_RECORD_NAME_LENGTH + 1]) {
+    if (fread(header, sizeof(GameRecordFileHeader), 1, file) != 1) return false;
+    if (memcmp(header->magic, GAME_RECORD_MAGIC, sizeof(header->magic)) != 0) return false;
+    if (header->seeds_per_house == 0) header->seeds_per_house = GAME_RECORD_SEEDS_PER_HOUSE;
+
+    for (int i = 0; i < header->player_count; ++i) {
+        char name[GAME_RECORD_NAME_LENGTH];
+        if (fread(name, GAME_RECORD_NAME_LENGTH, 1, file) != 1) return false;
+        if (names == NULL) continue;
+        memcpy(names[i], name, GAME_RECORD_NAME_LENGTH);
+        names[i][GAME_RECORD_NAME_LENGTH] = '\0';
+    }
+    return true;
+}
+
+int readGameRecord(FILE* file, GameRecord* record, uint8_t houses[GAME_RECORD_MAX_MOVES]) {
+    size_t read = fread(record, 1, sizeof(GameRecord), file);
+    if (read == 0) return 0;
+    if (read != sizeof(GameRecord)) return -1;
+
+    uint8_t moves[(GAME_RECORD_MAX_MOVES + 1) / 2];
+    int size = (record->move_count + 1) / 2;
+    if (size > 0 && fread(moves, size, 1, file) != 1) return -1;
+
+    // the sides alternate from BOTTOM: odd moves are played by TOP
+    for (int i = 0; i < record->move_count; ++i) {
+        houses[i] = ((moves[i / 2] >> (4 * (i % 2))) & 0x0f) + ((i % 2) ? 6 : 0);
+    }
+    return 1;
+}
+
+void initialGameRecordSnapshot(int seeds_per_house, GameSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(GameSnapshot));
+    memset(snapshot->board.seeds, seeds_per_house, sizeof(snapshot->board.seeds));
+    snapshot->turn = BOTTOM;
+}
+
+int replayGameRecord(const GameRecord* record, const uint8_t houses[], int seeds_per_house, GameSnapshot* snapshot) {
+    initialGameRecordSnapshot(seeds_per_house, snapshot);
+
+    for (int i = 0; i < record->move_count; ++i) {
+        if (isTerminal(snapshot) || playSnapshotMove(snapshot, snapshot->turn, houses[i]) < 0) return i;
+    }
+    return record->move_count;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game.h"
+
+// Binary files of finished games, written by selfplay (src/tools) and read back to replay or study them.
+// A file is a GameRecordFileHeader, the names of its players, then the games one after the other until the end
+// of the file, so that games can be appended to an existing file.
+//
+// Every game of a file starts from the same board, the header giving the seeds in each house (4 for the standard
+// game), with BOTTOM to play, and the sides alternate: a move is stored as
+// the index of the house on the side of its player (0 to 5), on 4 bits, two moves per byte (low half first).
+// Integers are written in the byte order of the machine, like the endgame database.
+
+
+#define GAME_RECORD_MAGIC "AWALEGR1"
+#define GAME_RECORD_NAME_LENGTH 16      // bytes per player name, padded with 0
+#define GAME_RECORD_MAX_PLAYERS 255
+#define GAME_RECORD_NO_PLAYER 255       // player not listed in the file
+#define GAME_RECORD_MAX_MOVES 65535
+#define GAME_RECORD_SEEDS_PER_HOUSE 4  // of the standard game, and of the files written before the header held it
+#define GAME_RECORD_LENGTH(move_count) (sizeof(GameRecord) + ((move_count) + 1) / 2) // bytes of a game in a file
+
+typedef struct GameRecordFileHeader {
+    char magic[8];          // GAME_RECORD_MAGIC, without the terminating 0
+    uint64_t seed;          // seed of the run that played the games, 0 if none
+    uint8_t player_count;   // names of GAME_RECORD_NAME_LENGTH bytes following the header
+    uint8_t seeds_per_house; // at the start of every game, 0 in older files, read as GAME_RECORD_SEEDS_PER_HOUSE
+    uint8_t unused[6];
+} GameRecordFileHeader;
+
+typedef struct GameRecord {
+    uint16_t move_count;    // followed by (move_count + 1) / 2 bytes of moves
+    uint8_t players[2];     // players[BOTTOM] and players[TOP], indices in the player names of the file
+    uint8_t winner;         // a Side, NO_SIDE on a draw
+    uint8_t points[2];      // at the end of the game
+    uint8_t unused;
+} GameRecord;
+
+
+bool writeGameRecordHeader(FILE* file, uint64_t seed, int seeds_per_house, int player_count, const char* const names[]);
+// writes the header of a new file, longer names are cut
+// returns false on a write error
+
+bool writeGameRecord(FILE* file, const GameRecord* record, const uint8_t houses[]);
+// appends a game, houses being the record->move_count houses played (0 to 11)
+// returns false on a write error
+
+size_t encodeGameRecord(uint8_t* out, const GameRecord* record, const uint8_t houses[]);
+// encodes a game as writeGameRecord writes it into out, which must hold GAME_RECORD_LENGTH(record->move_count)
+// bytes, and returns that length
+
+bool readGameRecordHeader(FILE* file, GameRecordFileHeader* header, char names[][GAME_RECORD_NAME_LENGTH + 1]);
+// reads the header of a file and the names of its players (0 terminated), names may be NULL
+// header->seeds_per_house is set to GAME_RECORD_SEEDS_PER_HOUSE for a file written before it was stored
+// returns false if the file is not a game record file
+
+int readGameRecord(FILE* file, GameRecord* record, uint8_t houses[GAME_RECORD_MAX_MOVES]);
+// reads the next game and the houses played (0 to 11)
+// returns 1 if a game was read, 0 at the end of the file, -1 if the file is truncated
+
+void initialGameRecordSnapshot(int seeds_per_house, GameSnapshot* snapshot);
+// board every game of a file starts from, seeds_per_house seeds in each house and BOTTOM to play
+
+int replayGameRecord(const GameRecord* record, const uint8_t houses[], int seeds_per_house, GameSnapshot* snapshot);
+// plays the moves of a game from its initial board into snapshot
+// returns the number of moves played, less than record->move_count if a move is not allowed
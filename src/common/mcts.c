@@ -0,0 +1,271 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "mcts.h"
+
+#define EXPLORATION 1.0         // UCT exploration constant, scores being in [0, 1]
+#define EXPAND_VISITS 2         // a leaf is expanded on its second visit, a first playout tells little
+#define MAX_PLAYOUT_PLIES 200   // a playout without captures can go on forever, the leader then wins
+#define MAX_TREE_DEPTH 256
+#define PLAYOUT_BATCH 64        // playouts a thread claims at once from the shared counter, the clock is read once per batch
+#define CACHE_LINE 64
+#define ROOT_STRIDE (CACHE_LINE / sizeof(MctsNode)) // the root and its children are a cache line apart
+
+typedef struct MctsSearch {
+    const GameSnapshot* root;
+    const MctsLimits* limits;
+    MctsTree* tree;
+    struct timespec deadline;
+    atomic_uint_fast64_t playouts; // playouts claimed by the threads, by batches
+    atomic_int stopped;
+} MctsSearch;
+
+typedef struct MctsThread {
+    MctsSearch* search;
+    pthread_t thread;
+    uint64_t random_state;
+} MctsThread;
+
+
+MctsTree* createMctsTree(uint32_t capacity) {
+    MctsTree* tree = malloc(sizeof(MctsTree));
+    if (tree == NULL) return NULL;
+    // aligned so that the root and each of its children start a cache line
+    void* nodes;
+    if (posix_memalign(&nodes, CACHE_LINE, sizeof(MctsNode) * capacity) != 0) {
+        free(tree);
+        return NULL;
+    }
+    tree->nodes = nodes;
+    tree->capacity = capacity;
+    atomic_init(&tree->used, 0);
+    return tree;
+}
+
+void freeMctsTree(MctsTree* tree) {
+    if (tree == NULL) return;
+    free(tree->nodes);
+    free(tree);
+}
+
+static void initNode(MctsNode* node, int house) {
+    atomic_init(&node->visits, 0);
+    atomic_init(&node->score, 0);
+    atomic_init(&node->children, MCTS_UNEXPANDED);
+    node->child_count = 0;
+    node->child_stride = 1;
+    node->house = house;
+}
+
+static uint64_t nextRandom(MctsThread* thread) {
+    // xorshift64*, one state per thread
+    uint64_t x = thread->random_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    thread->random_state = x;
+    return x * 0x2545f4914f6cdd1dull;
+}
+
+static Side playout(MctsThread* thread, GameSnapshot* snapshot) {
+    // plays random moves in place until the end of the game, returns the winner
+    for (int ply = 0; ply < MAX_PLAYOUT_PLIES; ++ply) {
+        int moves = generateLegalMoves(snapshot);
+        if (moves == 0) return whoHasWon(*snapshot);
+
+        // drop a random number of the lowest moves, then play the lowest one left
+        for (int skip = nextRandom(thread) % __builtin_popcount(moves); skip > 0; --skip) moves &= moves - 1;
+        int house = ((snapshot->turn == TOP) ? 6 : 0) + __builtin_ctz(moves);
+
+        MoveUndo undo;
+        if (makeMove(snapshot, house, &undo) == 1) return undo.turn;
+    }
+    if (snapshot->points[BOTTOM] == snapshot->points[TOP]) return NO_SIDE;
+    return (snapshot->points[BOTTOM] > snapshot->points[TOP]) ? BOTTOM : TOP;
+}
+
+static bool expandNode(MctsTree* tree, MctsNode* node, const GameSnapshot* snapshot, int stride) {
+    // called by the thread that set node->children to MCTS_EXPANDING, the children are stride nodes apart
+    int moves = generateLegalMoves(snapshot);
+    int count = __builtin_popcount(moves);
+    uint32_t first = atomic_fetch_add(&tree->used, count * stride);
+    if (first + count * stride > tree->capacity) {
+        // arena full: the node stays a leaf for good
+        atomic_store(&node->children, MCTS_EXPANDING);
+        return false;
+    }
+
+    int first_house = (snapshot->turn == TOP) ? 6 : 0;
+    for (int i = 0; i < count; ++i) {
+        initNode(&tree->nodes[first + i * stride], first_house + __builtin_ctz(moves));
+        moves &= moves - 1;
+    }
+    node->child_count = count;
+    node->child_stride = stride;
+    atomic_store_explicit(&node->children, first, memory_order_release);
+    return true;
+}
+
+static MctsNode* selectChild(MctsTree* tree, MctsNode* node, int first, uint64_t node_visits) {
+    // UCT, children never visited first
+    double log_visits = log((double)node_visits + 1);
+    MctsNode* best = NULL;
+    double best_value = -1;
+    for (int i = 0; i < node->child_count; ++i) {
+        MctsNode* child = &tree->nodes[first + i * node->child_stride];
+        uint32_t visits = atomic_load_explicit(&child->visits, memory_order_relaxed);
+        if (visits == 0) return child;
+        uint32_t score = atomic_load_explicit(&child->score, memory_order_relaxed);
+        double value = score / (2.0 * visits) + EXPLORATION * sqrt(log_visits / visits);
+        if (value > best_value) {
+            best_value = value;
+            best = child;
+        }
+    }
+    return best;
+}
+
+static bool limitReached(MctsSearch* search) {
+    if (atomic_load_explicit(&search->stopped, memory_order_relaxed)) return true;
+    if (search->limits->max_time_ms <= 0) return false;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > search->deadline.tv_sec
+        || (now.tv_sec == search->deadline.tv_sec && now.tv_nsec >= search->deadline.tv_nsec)) {
+        atomic_store(&search->stopped, 1);
+        return true;
+    }
+    return false;
+}
+
+static void runPlayout(MctsThread* thread) {
+    MctsSearch* search = thread->search;
+    MctsTree* tree = search->tree;
+    MctsNode* path[MAX_TREE_DEPTH];
+    Side movers[MAX_TREE_DEPTH]; // side that played the move leading to path[i]
+    int depth = 0;
+
+    GameSnapshot snapshot = *search->root;
+    MctsNode* node = &tree->nodes[0];
+    path[0] = node;
+    movers[0] = NO_SIDE;
+
+    Side winner = NO_SIDE;
+    bool finished = false;
+    while (depth < MAX_TREE_DEPTH - 1) {
+        if (generateLegalMoves(&snapshot) == 0) {
+            winner = whoHasWon(snapshot);
+            finished = true;
+            break;
+        }
+
+        int first = atomic_load_explicit(&node->children, memory_order_acquire);
+        if (first == MCTS_UNEXPANDED && atomic_load_explicit(&node->visits, memory_order_relaxed) >= EXPAND_VISITS) {
+            int expected = MCTS_UNEXPANDED;
+            if (atomic_compare_exchange_strong(&node->children, &expected, MCTS_EXPANDING)
+                && expandNode(tree, node, &snapshot, 1)) {
+                first = atomic_load_explicit(&node->children, memory_order_acquire);
+            }
+        }
+        // a leaf, or a node another thread is expanding: the playout starts here
+        if (first < 0) break;
+
+        // the root does not count its visits, the playouts claimed so far stand for them
+        uint64_t visits = (depth == 0) ? atomic_load_explicit(&search->playouts, memory_order_relaxed)
+            : atomic_load_explicit(&node->visits, memory_order_relaxed);
+        node = selectChild(tree, node, first, visits);
+        atomic_fetch_add_explicit(&node->visits, 1, memory_order_relaxed);
+        path[++depth] = node;
+        movers[depth] = snapshot.turn;
+
+        MoveUndo undo;
+        if (makeMove(&snapshot, node->house, &undo) == 1) {
+            winner = undo.turn;
+            finished = true;
+            break;
+        }
+    }
+    if (!finished) winner = playout(thread, &snapshot);
+
+    // the visits were counted on the way down
+    for (int i = 1; i <= depth; ++i) {
+        int score = (winner == NO_SIDE) ? 1 : (winner == movers[i]) ? 2 : 0;
+        if (score) atomic_fetch_add_explicit(&path[i]->score, score, memory_order_relaxed);
+    }
+}
+
+static void* searchThread(void* arg) {
+    MctsThread* thread = arg;
+    MctsSearch* search = thread->search;
+    uint64_t max_playouts = search->limits->max_playouts;
+    for (;;) {
+        uint64_t started = atomic_fetch_add_explicit(&search->playouts, PLAYOUT_BATCH, memory_order_relaxed);
+        if (max_playouts > 0 && started >= max_playouts) break;
+        if (limitReached(search)) break;
+        uint64_t count = PLAYOUT_BATCH;
+        if (max_playouts > 0 && max_playouts - started < count) count = max_playouts - started;
+        for (uint64_t i = 0; i < count; ++i) runPlayout(thread);
+    }
+    return NULL;
+}
+
+MctsResult searchMcts(const GameSnapshot* snapshot, const MctsLimits* limits, MctsTree* tree) {
+    MctsResult result = { -1, 0, 0, 0 };
+    if (generateLegalMoves(snapshot) == 0 || tree->capacity == 0) return result;
+
+    MctsSearch search;
+    search.root = snapshot;
+    search.limits = limits;
+    search.tree = tree;
+    atomic_init(&search.playouts, 0);
+    atomic_init(&search.stopped, 0);
+    clock_gettime(CLOCK_MONOTONIC, &search.deadline);
+    search.deadline.tv_sec += limits->max_time_ms / 1000;
+    search.deadline.tv_nsec += (long)(limits->max_time_ms % 1000) * 1000000;
+    if (search.deadline.tv_nsec >= 1000000000) {
+        search.deadline.tv_sec++;
+        search.deadline.tv_nsec -= 1000000000;
+    }
+
+    atomic_store(&tree->used, ROOT_STRIDE);
+    initNode(&tree->nodes[0], 0);
+    // expand the root at once, so that every thread starts below it
+    atomic_store(&tree->nodes[0].children, MCTS_EXPANDING);
+    if (!expandNode(tree, &tree->nodes[0], snapshot, ROOT_STRIDE)) return result;
+
+    int thread_count = (limits->threads > 1) ? limits->threads : 1;
+    MctsThread threads[thread_count];
+    uint64_t seed = limits->seed ? limits->seed : (uint64_t)search.deadline.tv_nsec ^ snapshotHash(snapshot);
+    for (int i = 0; i < thread_count; ++i) {
+        threads[i].search = &search;
+        threads[i].random_state = (seed + i) * 0x9e3779b97f4a7c15ull | 1;
+    }
+    for (int i = 1; i < thread_count; ++i) {
+        if (pthread_create(&threads[i].thread, NULL, searchThread, &threads[i]) != 0) thread_count = i;
+    }
+    searchThread(&threads[0]);
+    for (int i = 1; i < thread_count; ++i) pthread_join(threads[i].thread, NULL);
+
+    // the most visited move is the most reliable one
+    MctsNode* root = &tree->nodes[0];
+    uint32_t best_visits = 0;
+    for (int i = 0; i < root->child_count; ++i) {
+        MctsNode* child = &tree->nodes[root->children + i * root->child_stride];
+        if (result.house < 0 || child->visits > best_visits) {
+            best_visits = child->visits;
+            result.house = child->house;
+            result.win_rate = best_visits ? child->score / (2.0 * best_visits) : 0;
+        }
+        // every playout goes through one child of the root
+        result.playouts += child->visits;
+    }
+    result.nodes = atomic_load(&tree->used);
+    if (result.nodes > tree->capacity) result.nodes = tree->capacity;
+    return result;
+}
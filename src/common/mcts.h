@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "game.h"
+
+// Monte-Carlo tree search over GameSnapshots, the other engine of the server bots.
+// Each playout walks down the tree with UCT, expands the leaf it reaches, plays random moves until the end of
+// the game and adds the result to the nodes of its path. The most visited move of the root is played.
+//
+// Several threads can grow the same tree without locks: node statistics are atomic counters, a node is expanded
+// by the thread that wins a compare-and-swap on it, and its children are carved out of the tree arena with
+// an atomic add. A playout counts as a visit, with no score, from the moment it goes through a node until it
+// ends (virtual loss), so the threads spread over different branches instead of following each other.
+// Every playout goes through the root and one of its children: these nodes get a cache line each, so that
+// threads updating different children do not invalidate each other's lines, and the root does not count its
+// visits (the playouts started, claimed from a shared counter by batches, stand for them).
+
+
+#define MCTS_UNEXPANDED -1
+#define MCTS_EXPANDING -2
+#define MCTS_TREE_CAPACITY(playouts) ((playouts) * 6 + 28) // arena a search of this many playouts never fills
+
+typedef struct MctsNode {
+    _Atomic uint32_t visits; // playouts through the node, those still running included
+    _Atomic uint32_t score;  // 2 per win, 1 per draw, for the side that played the move leading to the node
+    _Atomic int32_t children; // index of the first child in the arena, or MCTS_UNEXPANDED / MCTS_EXPANDING
+    uint8_t child_count;    // set before children is published
+    uint8_t child_stride;   // nodes from one child to the next in the arena
+    uint8_t house;          // move leading to the node
+} MctsNode;
+
+typedef struct MctsTree {
+    MctsNode* nodes;        // arena, nodes[0] is the root
+    uint32_t capacity;
+    _Atomic uint32_t used;
+} MctsTree;
+
+typedef struct MctsLimits {
+    uint64_t max_playouts;  // the search stops after this many playouts (0: no limit)
+    int max_time_ms;        // the search stops after this many milliseconds (0: no limit)
+    int threads;            // threads growing the tree, the calling thread included
+    uint64_t seed;          // seed of the random playouts (0: drawn from the clock)
+} MctsLimits;
+// at least one limit must be set
+// with a seed, no time limit and a single thread, a search always returns the same move
+
+typedef struct MctsResult {
+    int house;              // most visited move, -1 if the side to play has no legal move
+    double win_rate;        // of the side to play through that move, a draw counting as half a win
+    uint64_t playouts;
+    uint32_t nodes;         // nodes of the tree used by the search
+} MctsResult;
+
+
+MctsTree* createMctsTree(uint32_t capacity);
+// arena of capacity nodes of 16 bytes, NULL if memory is exhausted
+// a search needs 28 nodes for the root and its children, then at most 6 nodes per playout (MCTS_TREE_CAPACITY),
+// it stops expanding the tree when the arena is full
+
+void freeMctsTree(MctsTree* tree);
+
+MctsResult searchMcts(const GameSnapshot* snapshot, const MctsLimits* limits, MctsTree* tree);
+// searches the move of the side to play, tree is cleared first and must not be shared with another search
+// the threads are started by the call and joined before it returns
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#include "pool.h"
+
+struct PoolSlot {
+    PoolSlot* next_free;    // only meaningful while the slot is free
+    uint32_t generation;    // odd while allocated
+    alignas(max_align_t) unsigned char object[];
+};
+
+
+static PoolSlot* slotOf(const void* object) {
+    return (PoolSlot*)((char*)object - offsetof(PoolSlot, object));
+}
+
+static size_t slotSize(const Pool* pool) {
+    size_t align = alignof(max_align_t);
+    return sizeof(PoolSlot) + (pool->object_size + align - 1) / align * align;
+}
+
+static int growPool(Pool* pool) {
+    if (pool->slab_count == pool->slabs_capacity) {
+        int new_capacity = pool->slabs_capacity ? pool->slabs_capacity * 2 : 8;
+        char** grown = realloc(pool->slabs, new_capacity * sizeof(char*));
+        if (grown == NULL) return -1;
+        pool->slabs = grown;
+        pool->slabs_capacity = new_capacity;
+    }
+
+    char* slab = malloc(slotSize(pool) * pool->objects_per_slab);
+    if (slab == NULL) return -1;
+    pool->slabs[pool->slab_count++] = slab;
+    pool->bump = slab;
+    pool->bump_remaining = pool->objects_per_slab;
+    return 0;
+}
+
+void* poolAlloc(Pool* pool) {
+    PoolSlot* slot;
+    if (pool->free_list != NULL) {
+        slot = pool->free_list;
+        pool->free_list = slot->next_free;
+    }
+    else {
+        if (pool->bump_remaining == 0 && growPool(pool) < 0) return NULL;
+        slot = (PoolSlot*)pool->bump;
+        slot->generation = 0;
+        pool->bump += slotSize(pool);
+        pool->bump_remaining--;
+    }
+
+    slot->next_free = NULL;
+    slot->generation++;
+    memset(slot->object, 0, pool->object_size);
+
+    pool->live++;
+    pool->allocations++;
+    if (pool->live > pool->peak) pool->peak = pool->live;
+    return slot->object;
+}
+
+void poolFree(Pool* pool, void* object) {
+    if (object == NULL) return;
+    PoolSlot* slot = slotOf(object);
+    if ((slot->generation & 1) == 0) {
+        fprintf(stderr, "error: %s pool: object %p freed twice.\n", pool->name, object);
+        return;
+    }
+
+    slot->generation++;
+    slot->next_free = pool->free_list;
+    pool->free_list = slot;
+    pool->live--;
+}
+
+uint32_t poolGeneration(const void* object) {
+    return slotOf(object)->generation;
+}
+
+int poolIsLive(const void* object, uint32_t generation) {
+    return object != NULL && (generation & 1) && slotOf(object)->generation == generation;
+}
+
+PoolStats poolStats(const Pool* pool) {
+    PoolStats stats;
+    stats.live = pool->live;
+    stats.peak = pool->peak;
+    stats.capacity = (size_t)pool->slab_count * pool->objects_per_slab;
+    stats.allocations = pool->allocations;
+    stats.bytes = stats.capacity * slotSize(pool);
+    return stats;
+}
+
+void printPoolStats(FILE* out, const Pool* pool) {
+    PoolStats stats = poolStats(pool);
+    fprintf(out, "%s pool: %zu live (peak %zu) / %zu slots, %zu allocations, %zu KiB in %d slabs.\n",
+        pool->name, stats.live, stats.peak, stats.capacity, stats.allocations, stats.bytes / 1024, pool->slab_count);
+}
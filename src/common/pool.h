@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Slab pool of fixed-size objects.
+// Objects are carved out of large slabs by bumping a pointer, and freed objects go on a free list reused first,
+// so a long-running server allocating and freeing thousands of them never returns to malloc once warmed up.
+// Slabs are never given back: the memory held is bounded by the peak number of live objects.
+//
+// Every object carries a generation counter, odd while allocated and incremented on each allocation and free.
+// Saving it next to a pointer gives a handle that can tell whether the object was freed (and maybe reused) since.
+
+
+typedef struct PoolSlot PoolSlot;
+
+typedef struct Pool {
+    const char* name;
+    size_t object_size;
+    size_t objects_per_slab;
+
+    // private state, zero-initialized
+    char** slabs;
+    int slab_count;
+    int slabs_capacity;
+    char* bump;             // next never-used slot of the last slab
+    size_t bump_remaining;
+    PoolSlot* free_list;
+    size_t live;
+    size_t peak;
+    size_t allocations;
+} Pool;
+
+#define POOL_INITIALIZER(type, per_slab) { #type, sizeof(type), (per_slab) }
+
+typedef struct PoolStats {
+    size_t live;            // objects currently allocated
+    size_t peak;            // highest value of live
+    size_t capacity;        // objects the allocated slabs can hold
+    size_t allocations;     // total number of poolAlloc calls that succeeded
+    size_t bytes;           // memory held by the slabs
+} PoolStats;
+
+
+void* poolAlloc(Pool* pool);
+// returns a zeroed object, or NULL if memory is exhausted
+
+void poolFree(Pool* pool, void* object);
+// gives the object back to the pool, freeing NULL or an already freed object is reported and ignored
+
+uint32_t poolGeneration(const void* object);
+// generation of an object allocated from a pool, odd while it is allocated
+
+int poolIsLive(const void* object, uint32_t generation);
+// returns 1 if the object is still the allocation whose generation was saved, 0 if it was freed since
+// the object memory is never unmapped, so this is safe to call on a stale pointer
+
+PoolStats poolStats(const Pool* pool);
+void printPoolStats(FILE* out, const Pool* pool);
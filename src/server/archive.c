@@ -0,0 +1,141 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "archive.h"
+#include "log.h"
+#include "../common/game_record.h"
+
+static FILE* archive = NULL;
+static pthread_t writer;
+
+// games encoded by the loop and not yet taken by the writer
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending_ready = PTHREAD_COND_INITIALIZER;
+static uint8_t* pending = NULL;
+static size_t pending_length = 0;
+static size_t pending_capacity = 0;
+static int stopping = 0;
+static int failed = 0;     // set by the writer on a write error, nothing is queued any more
+
+
+static void* writerMain(void* arg) {
+    (void)arg;
+    // the writer takes the pending buffer and gives its own empty one back, the file is written without the lock
+    uint8_t* batch = NULL;
+    size_t batch_capacity = 0;
+
+    pthread_mutex_lock(&pending_lock);
+    for (;;) {
+        while (pending_length == 0 && !stopping) pthread_cond_wait(&pending_ready, &pending_lock);
+        if (pending_length == 0) break; // stopping, every game is written
+
+        uint8_t* taken = pending;
+        size_t taken_capacity = pending_capacity;
+        size_t length = pending_length;
+        pending = batch;
+        pending_capacity = batch_capacity;
+        pending_length = 0;
+        batch = taken;
+        batch_capacity = taken_capacity;
+        pthread_mutex_unlock(&pending_lock);
+
+        bool ok = fwrite(batch, 1, length, archive) == length && fflush(archive) == 0;
+
+        pthread_mutex_lock(&pending_lock);
+        if (!ok) {
+            failed = 1;
+            pending_length = 0;
+            logError("Cannot write to the game archive, archiving stopped.");
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pending_lock);
+    free(batch);
+    return NULL;
+}
+
+static bool reservePending(size_t length) {
+    // called with the lock held
+    size_t needed = pending_length + length;
+    if (needed <= pending_capacity) return true;
+    if (needed > ARCHIVE_MAX_PENDING) return false;
+    size_t capacity = pending_capacity ? pending_capacity * 2 : 4096;
+    while (capacity < needed) capacity *= 2;
+    uint8_t* grown = realloc(pending, capacity);
+    if (grown == NULL) return false;
+    pending = grown;
+    pending_capacity = capacity;
+    return true;
+}
+
+
+bool openGameArchive(const char* path) {
+    archive = fopen(path, "ab");
+    if (archive == NULL) return false;
+    // in append mode the position starts at the end of the file
+    if (fseek(archive, 0, SEEK_END) != 0 || (ftell(archive) == 0 && !writeGameRecordHeader(archive, 0, GAME_RECORD_SEEDS_PER_HOUSE, 0, NULL))
+        || fflush(archive) != 0) {
+        fclose(archive);
+        archive = NULL;
+        return false;
+    }
+    stopping = 0;
+    failed = 0;
+    if (pthread_create(&writer, NULL, writerMain, NULL) != 0) {
+        fclose(archive);
+        archive = NULL;
+        return false;
+    }
+    return true;
+}
+
+void archiveGame(const Game* game) {
+    if (archive == NULL) return;
+    if (game->recorded_moves != game->sequence || game->sequence > GAME_RECORD_MAX_MOVES) {
+        logWarn("Game between %s and %s not archived, its moves were not all recorded.",
+            game->players[BOTTOM]->username, game->players[TOP]->username);
+        return;
+    }
+
+    GameRecord record;
+    record.move_count = game->sequence;
+    record.players[BOTTOM] = GAME_RECORD_NO_PLAYER;
+    record.players[TOP] = GAME_RECORD_NO_PLAYER;
+    record.winner = whoHasWon(game->snapshot);
+    record.points[BOTTOM] = game->snapshot.points[BOTTOM];
+    record.points[TOP] = game->snapshot.points[TOP];
+    record.unused = 0;
+
+    pthread_mutex_lock(&pending_lock);
+    bool dropped = !failed && !reservePending(GAME_RECORD_LENGTH(record.move_count));
+    if (!failed && !dropped) {
+        pending_length += encodeGameRecord(pending + pending_length, &record, game->moves);
+        pthread_cond_signal(&pending_ready);
+    }
+    pthread_mutex_unlock(&pending_lock);
+
+    if (dropped) {
+        logWarn("Game between %s and %s not archived, the archive is not written fast enough.",
+            game->players[BOTTOM]->username, game->players[TOP]->username);
+    }
+}
+
+void closeGameArchive() {
+    if (archive == NULL) return;
+    pthread_mutex_lock(&pending_lock);
+    stopping = 1;
+    pthread_cond_signal(&pending_ready);
+    pthread_mutex_unlock(&pending_lock);
+    pthread_join(writer, NULL);
+
+    fclose(archive);
+    archive = NULL;
+    free(pending);
+    pending = NULL;
+    pending_length = 0;
+    pending_capacity = 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "../common/game.h"
+
+// Archive of the games finished on the server, appended to a game record file (see game_record.h) that
+// build_book turns into the opening book of the bots. The players are not named in the file.
+// The loop only encodes a finished game into a pending buffer: a background thread writes the pending games and
+// flushes them at once, so that the file stays complete if the server is killed, without the loop waiting on
+// the disk. If the writer falls ARCHIVE_MAX_PENDING bytes behind, the games are dropped instead of piling up.
+
+#define GAME_ARCHIVE_PATH "games.awr"
+#define ARCHIVE_MAX_PENDING (1 << 20)
+
+
+bool openGameArchive(const char* path);
+// opens the archive for appending, writing the file header if it is new, and starts its writer thread
+// returns false if it cannot be written, the games are then not archived
+
+void archiveGame(const Game* game);
+// appends a finished game, unless its move history is incomplete (memory exhausted during the game)
+
+void closeGameArchive();
+// writes the pending games and stops the writer thread
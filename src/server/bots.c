@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "bots.h"
+#include "user_directory.h"
+#include "lobby.h"
+#include "log.h"
+
+// about 7 microseconds per playout in the opening: an MCTS move takes about as long as a hard alpha-beta move
+// the easy bot keeps its weak openings
+static const BotProfile profiles[BOT_COUNT] = {
+    { "bot_facile", BOT_ALPHA_BETA, BOT_EASY, 0, false },
+    { "bot_moyen", BOT_ALPHA_BETA, BOT_MEDIUM, 0, true },
+    { "bot_difficile", BOT_ALPHA_BETA, BOT_HARD, 0, true },
+    { "bot_mcts", BOT_MCTS, 0, 15000, true },
+};
+
+static User* bots[BOT_COUNT];
+static TranspositionTable* table = NULL; // shared by every bot game
+static OpeningBook* book = NULL;
+
+
+bool startBots() {
+    table = createTranspositionTable(BOT_TABLE_SIZE_LOG2);
+    if (table == NULL) return false;
+
+    book = openOpeningBook(OPENING_BOOK_PATH);
+    if (book != NULL) {
+        logInfo("Opening book mapped, %llu moves in the first %d plies.", (unsigned long long)book->count, book->max_plies);
+    }
+
+    for (int profile = 0; profile < BOT_COUNT; ++profile) {
+        User* bot = createUser(profiles[profile].name, BOT_FD);
+        if (bot == NULL) return false;
+        bot->bot_profile = profile;
+        if (!registerUser(bot)) {
+            freeUser(bot);
+            return false;
+        }
+        if (!lobbyUserJoined(bot)) {
+            unregisterUser(bot);
+            freeUser(bot);
+            return false;
+        }
+        bots[profile] = bot;
+    }
+    return true;
+}
+
+void stopBots() {
+    for (int profile = 0; profile < BOT_COUNT; ++profile) {
+        if (bots[profile] == NULL) continue;
+        lobbyUserLeft(bots[profile]);
+        unregisterUser(bots[profile]);
+        freeUser(bots[profile]);
+        bots[profile] = NULL;
+    }
+    freeTranspositionTable(table);
+    table = NULL;
+    closeOpeningBook(book);
+    book = NULL;
+}
+
+bool isBot(const User* user) {
+    return user != NULL && user->bot_profile >= 0;
+}
+
+User* createBotPlayer(const User* bot) {
+    User* player = createUser(bot->username, BOT_FD);
+    if (player == NULL) return NULL;
+    player->bot_profile = bot->bot_profile;
+    return player;
+}
+
+void freeBotPlayer(User* player) {
+    if (!isBot(player)) return;
+    for (int profile = 0; profile < BOT_COUNT; ++profile) {
+        if (bots[profile] == player) return; // registered bots live as long as the server
+    }
+    freeUser(player);
+}
+
+static int chooseMctsMove(const GameSnapshot* snapshot, const BotProfile* bot) {
+    // the worker threads already search several games at once: one thread per tree
+    MctsLimits limits = { bot->playouts, 0, 1, 0 };
+    MctsTree* tree = createMctsTree(MCTS_TREE_CAPACITY(bot->playouts));
+    if (tree == NULL) {
+        logError("cannot allocate the tree of %s, it searches with alpha-beta instead.", bot->name);
+        EngineLimits fallback = botLevelLimits(BOT_MEDIUM);
+        return searchBestMove(snapshot, &fallback, table).house;
+    }
+    MctsResult result = searchMcts(snapshot, &limits, tree);
+    freeMctsTree(tree);
+    logDebug("%s plays %d (%llu playouts, %u nodes, win rate %.2f).",
+        bot->name, result.house, (unsigned long long)result.playouts, result.nodes, result.win_rate);
+    return result.house;
+}
+
+int chooseBotMove(const GameSnapshot* snapshot, int profile) {
+    const BotProfile* bot = &profiles[profile];
+    if (bot->use_book) {
+        int house = chooseBookMove(book, snapshot);
+        if (house >= 0) {
+            logDebug("%s plays %d from the opening book.", bot->name, house);
+            return house;
+        }
+    }
+    if (bot->engine == BOT_MCTS) return chooseMctsMove(snapshot, bot);
+
+    EngineLimits limits = botLevelLimits(bot->level);
+    EngineResult result = searchBestMove(snapshot, &limits, table);
+    logDebug("%s plays %d (depth %d, %llu nodes, score %d).",
+        bot->name, result.house, result.depth, (unsigned long long)result.nodes, result.score);
+    return result.house;
+}
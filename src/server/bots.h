@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../common/engine.h"
+#include "../common/mcts.h"
+#include "../common/book.h"
+
+// Opponents played by the server.
+// One bot user per profile is registered at startup and listed like any user. Challenging it with a
+// MATCH_REQUEST starts a game right away against a copy of the bot made for this game (not registered, no
+// connection), so that a bot can play any number of games at once. A profile picks the engine of the bot and
+// its budget: alpha-beta bots share one transposition table, MCTS bots grow a tree per move. In the opening,
+// the bots that use the book play its best move without searching.
+
+#define BOT_FD -1 // fd of the bot users, nothing must ever be sent to it
+#define BOT_TABLE_SIZE_LOG2 18 // 4 MiB transposition table
+#define OPENING_BOOK_PATH "book.db" // optional, written by build_book
+#define BOT_COUNT 4
+
+typedef enum BotEngine {
+    BOT_ALPHA_BETA = 0,
+    BOT_MCTS,
+} BotEngine;
+
+typedef struct BotProfile {
+    const char* name;
+    BotEngine engine;
+    BotLevel level;         // search budget of an alpha-beta bot
+    uint64_t playouts;      // playout budget of an MCTS bot
+    bool use_book;          // plays the moves of the opening book when there is one
+} BotProfile;
+
+
+bool startBots();
+// registers one bot user per profile and maps the opening book if there is one
+// returns false if memory is exhausted
+
+void stopBots();
+// unregisters and frees the bot users
+
+bool isBot(const User* user);
+// true for the registered bot users and their per-game copies
+
+User* createBotPlayer(const User* bot);
+// copy of a registered bot to play a game, NULL if memory is exhausted
+
+void freeBotPlayer(User* player);
+// frees a copy made by createBotPlayer, does nothing for other users
+
+int chooseBotMove(const GameSnapshot* snapshot, int profile);
+// searches the move of the side to play with the engine and budget of a bot profile
+// only reads the snapshot, the book and the shared transposition table: safe to call from a worker thread
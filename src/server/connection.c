@@ -0,0 +1,379 @@
+#include "connection.h"
+
+#define RING_MASK (INPUT_BUFFER_SIZE - 1)
+
+// connections indexed by file descriptor, so that messages addressed to an fd can be queued
+static Connection** connections_by_fd = NULL;
+static int connections_by_fd_capacity = 0;
+
+// every open connection, in no particular order (conn->slot is the index of conn)
+static Connection** all_connections = NULL;
+static int connection_count = 0;
+static int all_connections_capacity = 0;
+
+// connections with output queued during the current loop iteration
+static Connection* dirty_head = NULL;
+
+// messages sent to BROADCAST_FD, waiting for takeBroadcastBuffer, one encoding per protocol
+static char* broadcast_data[PROTOCOL_COUNT];
+static size_t broadcast_length[PROTOCOL_COUNT];
+static size_t broadcast_capacity[PROTOCOL_COUNT];
+static bool broadcast_lost[PROTOCOL_COUNT]; // a message could not be captured, the recipients must be dropped
+
+// input buffer lent to the connection being read, so that idle connections do not own one
+static RingBuffer scratch_input;
+
+Connection* createConnection(int fd) {
+    if (fd >= connections_by_fd_capacity) {
+        int new_capacity = connections_by_fd_capacity ? connections_by_fd_capacity : 64;
+        while (new_capacity <= fd) new_capacity *= 2;
+        Connection** grown = realloc(connections_by_fd, new_capacity * sizeof(Connection*));
+        if (grown == NULL) return NULL;
+        memset(grown + connections_by_fd_capacity, 0, (new_capacity - connections_by_fd_capacity) * sizeof(Connection*));
+        connections_by_fd = grown;
+        connections_by_fd_capacity = new_capacity;
+    }
+
+    if (connection_count >= all_connections_capacity) {
+        int new_capacity = all_connections_capacity ? all_connections_capacity * 2 : 64;
+        Connection** grown = realloc(all_connections, new_capacity * sizeof(Connection*));
+        if (grown == NULL) return NULL;
+        all_connections = grown;
+        all_connections_capacity = new_capacity;
+    }
+
+    Connection* conn = (Connection*) calloc(1, sizeof(Connection));
+    if (conn == NULL) return NULL;
+    conn->fd = fd;
+    conn->lobby_slot = -1;
+    connections_by_fd[fd] = conn;
+    conn->slot = connection_count;
+    all_connections[connection_count++] = conn;
+    return conn;
+}
+
+SharedBuffer* createSharedBuffer(size_t length) {
+    SharedBuffer* buffer = malloc(sizeof(SharedBuffer) + length);
+    if (buffer == NULL) return NULL;
+    buffer->refcount = 1;
+    buffer->length = length;
+    return buffer;
+}
+
+void retainSharedBuffer(SharedBuffer* buffer) {
+    ++buffer->refcount;
+}
+
+void releaseSharedBuffer(SharedBuffer* buffer) {
+    if (--buffer->refcount == 0) free(buffer);
+}
+
+static void freeChunk(OutputChunk* chunk) {
+    if (chunk->shared != NULL) releaseSharedBuffer(chunk->shared);
+    free(chunk);
+}
+
+static void unlinkDirty(Connection* conn) {
+    if (!conn->dirty) return;
+    if (conn->prev_dirty != NULL) conn->prev_dirty->next_dirty = conn->next_dirty;
+    else dirty_head = conn->next_dirty;
+    if (conn->next_dirty != NULL) conn->next_dirty->prev_dirty = conn->prev_dirty;
+    conn->prev_dirty = NULL;
+    conn->next_dirty = NULL;
+    conn->dirty = false;
+}
+
+static void linkDirty(Connection* conn) {
+    if (conn->dirty) return;
+    conn->dirty = true;
+    conn->prev_dirty = NULL;
+    conn->next_dirty = dirty_head;
+    if (dirty_head != NULL) dirty_head->prev_dirty = conn;
+    dirty_head = conn;
+}
+
+void destroyConnection(Connection* conn) {
+    unlinkDirty(conn);
+    if (conn->fd >= 0 && conn->fd < connections_by_fd_capacity && connections_by_fd[conn->fd] == conn) {
+        connections_by_fd[conn->fd] = NULL;
+    }
+
+    // swap with the last connection to keep the table dense
+    Connection* last = all_connections[--connection_count];
+    all_connections[conn->slot] = last;
+    last->slot = conn->slot;
+
+    OutputChunk* chunk = conn->output.head;
+    while (chunk != NULL) {
+        OutputChunk* next = chunk->next;
+        freeChunk(chunk);
+        chunk = next;
+    }
+    if (conn->input != &scratch_input) free(conn->input);
+    free(conn);
+}
+
+Connection* connectionFromFd(int fd) {
+    if (fd < 0 || fd >= connections_by_fd_capacity) return NULL;
+    return connections_by_fd[fd];
+}
+
+int connectionCount() {
+    return connection_count;
+}
+
+Connection* connectionAt(int slot) {
+    return all_connections[slot];
+}
+
+
+// copies len bytes starting at offset from the read position, without consuming them
+static void ringPeek(const RingBuffer* ring, size_t offset, void* dst, size_t len) {
+    size_t start = (ring->head + offset) & RING_MASK;
+    size_t first_part = INPUT_BUFFER_SIZE - start;
+    if (first_part > len) first_part = len;
+    memcpy(dst, ring->data + start, first_part);
+    memcpy((char*)dst + first_part, ring->data, len - first_part);
+}
+
+static void ringConsume(RingBuffer* ring, size_t len) {
+    ring->head = (ring->head + len) & RING_MASK;
+    ring->length -= len;
+    if (ring->length == 0) ring->head = 0; // keep the next read contiguous when possible
+}
+
+ssize_t readIntoConnection(Connection* conn) {
+    if (conn->input == NULL) {
+        scratch_input.head = 0;
+        scratch_input.length = 0;
+        conn->input = &scratch_input;
+    }
+    RingBuffer* ring = conn->input;
+    size_t free_space = INPUT_BUFFER_SIZE - ring->length;
+    if (free_space == 0) {
+        // cannot happen as long as every complete frame is extracted after each read
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    // the free space may wrap around the end of the buffer: fill both parts at once
+    size_t tail = (ring->head + ring->length) & RING_MASK;
+    struct iovec iov[2];
+    int iovcnt = 1;
+    iov[0].iov_base = ring->data + tail;
+    if (tail + free_space <= INPUT_BUFFER_SIZE) {
+        iov[0].iov_len = free_space;
+    }
+    else {
+        iov[0].iov_len = INPUT_BUFFER_SIZE - tail;
+        iov[1].iov_base = ring->data;
+        iov[1].iov_len = free_space - iov[0].iov_len;
+        iovcnt = 2;
+    }
+
+    ssize_t r = readv(conn->fd, iov, iovcnt);
+    if (r > 0) ring->length += r;
+    return r;
+}
+
+static int extractCompactFrame(Connection* conn, char frame[MAX_MESSAGE_LENGTH], int32_t* message_type, ssize_t* frame_length) {
+    RingBuffer* ring = conn->input;
+    char compact[MAX_FRAME_LENGTH];
+
+    size_t prefix_length = (ring->length < 5) ? ring->length : 5;
+    ringPeek(ring, 0, compact, prefix_length);
+    int length = compactFrameLength(compact, prefix_length, MAX_FRAME_LENGTH);
+    if (length < 0) return -1;
+    if (length == 0 || ring->length < (size_t)length) return 0; // partial frame, wait for the rest
+
+    ringPeek(ring, 0, compact, length);
+    ringConsume(ring, length);
+
+    // handlers only see the legacy encoding
+    ssize_t decoded = decodeCompactFrame(compact, length, frame, MAX_MESSAGE_LENGTH);
+    if (decoded < 0) return -1;
+    memcpy(message_type, frame, sizeof(int32_t));
+    if (expectedMessageLength(*message_type) != decoded) return -1;
+    *frame_length = decoded;
+    return 1;
+}
+
+int extractFrame(Connection* conn, char frame[MAX_MESSAGE_LENGTH], int32_t* message_type, ssize_t* frame_length) {
+    RingBuffer* ring = conn->input;
+    if (ring == NULL || ring->length == 0) return 0;
+    if (connectionProtocol(conn->fd) == PROTOCOL_COMPACT) return extractCompactFrame(conn, frame, message_type, frame_length);
+    if (ring->length < sizeof(int32_t)) return 0;
+
+    ringPeek(ring, 0, message_type, sizeof(int32_t));
+    int expected = expectedMessageLength(*message_type);
+    if (expected < 0) return -1;
+    if (ring->length < (size_t)expected) return 0; // partial frame, wait for the rest
+
+    ringPeek(ring, 0, frame, expected);
+    ringConsume(ring, expected);
+    *frame_length = expected;
+    return 1;
+}
+
+int settleInput(Connection* conn) {
+    RingBuffer* ring = conn->input;
+    if (ring == NULL) return 0;
+
+    if (ring->length == 0) {
+        if (ring != &scratch_input) free(ring);
+        conn->input = NULL;
+    }
+    else if (ring == &scratch_input) {
+        // a partial frame must survive until the next read: give the connection its own buffer
+        RingBuffer* own = malloc(sizeof(RingBuffer));
+        if (own == NULL) {
+            // without the partial frame the next bytes cannot be parsed
+            conn->input = NULL;
+            return -1;
+        }
+        ringPeek(ring, 0, own->data, ring->length);
+        own->head = 0;
+        own->length = ring->length;
+        conn->input = own;
+    }
+    return 0;
+}
+
+
+// reserves a chunk at the end of the queue of conn, with inline_length bytes of inline storage
+static OutputChunk* appendChunk(Connection* conn, size_t length, size_t inline_length) {
+    if (conn->overflowed) return NULL;
+    linkDirty(conn);
+
+    // slices count as much as inline bytes: a queued slice keeps its shared buffer alive
+    OutputQueue* queue = &conn->output;
+    OutputChunk* chunk = NULL;
+    if (queue->pending + length <= MAX_PENDING_OUTPUT && queue->chunks < MAX_PENDING_CHUNKS) {
+        chunk = malloc(sizeof(OutputChunk) + inline_length);
+    }
+    if (chunk == NULL) {
+        // the peer does not read fast enough (or we ran out of memory): stop queueing, it will be dropped on flush
+        conn->overflowed = true;
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->length = length;
+
+    if (queue->tail != NULL) queue->tail->next = chunk;
+    else queue->head = chunk;
+    queue->tail = chunk;
+    queue->pending += length;
+    queue->chunks++;
+    return chunk;
+}
+
+static void captureBroadcast(int protocol, const void* data, size_t length) {
+    // once a message is lost, the next ones are useless: the recipients will be dropped
+    if (broadcast_lost[protocol]) return;
+    size_t needed = broadcast_length[protocol] + length;
+    if (needed > broadcast_capacity[protocol]) {
+        size_t new_capacity = broadcast_capacity[protocol] ? broadcast_capacity[protocol] * 2 : 2048;
+        while (new_capacity < needed) new_capacity *= 2;
+        char* grown = realloc(broadcast_data[protocol], new_capacity);
+        if (grown == NULL) {
+            broadcast_lost[protocol] = true;
+            return;
+        }
+        broadcast_data[protocol] = grown;
+        broadcast_capacity[protocol] = new_capacity;
+    }
+    memcpy(broadcast_data[protocol] + broadcast_length[protocol], data, length);
+    broadcast_length[protocol] = needed;
+}
+
+SharedBuffer* takeBroadcastBuffer(int protocol, bool* lost) {
+    size_t length = broadcast_length[protocol];
+    *lost = broadcast_lost[protocol];
+    broadcast_lost[protocol] = false;
+    broadcast_length[protocol] = 0;
+    if (length == 0 || *lost) return NULL;
+    SharedBuffer* buffer = createSharedBuffer(length);
+    if (buffer == NULL) *lost = true;
+    else memcpy(buffer->data, broadcast_data[protocol], length);
+    return buffer;
+}
+
+void queueMessage(int fd, int protocol, const void* data, size_t length) {
+    if (fd < 0) {
+        // BROADCAST_FD or PROTOCOL_BROADCAST_FD
+        captureBroadcast(protocol, data, length);
+        return;
+    }
+    Connection* conn = connectionFromFd(fd);
+    if (conn == NULL) return;
+
+    OutputChunk* chunk = appendChunk(conn, length, length);
+    if (chunk == NULL) return;
+    chunk->shared = NULL;
+    chunk->data = chunk->inline_data;
+    memcpy(chunk->inline_data, data, length);
+}
+
+void queueSharedSlice(Connection* conn, SharedBuffer* buffer, size_t offset, size_t length) {
+    if (length == 0) return;
+
+    OutputChunk* chunk = appendChunk(conn, length, 0);
+    if (chunk == NULL) return;
+    retainSharedBuffer(buffer);
+    chunk->shared = buffer;
+    chunk->data = buffer->data + offset;
+}
+
+void dropConnectionOutput(Connection* conn) {
+    conn->overflowed = true;
+    linkDirty(conn);
+}
+
+int flushConnection(Connection* conn) {
+    unlinkDirty(conn);
+    if (conn->overflowed) return -1;
+
+    OutputQueue* queue = &conn->output;
+    while (queue->head != NULL) {
+        struct iovec iov[FLUSH_IOV_COUNT];
+        int iovcnt = 0;
+        size_t offset = queue->head_offset;
+        for (OutputChunk* chunk = queue->head; chunk != NULL && iovcnt < FLUSH_IOV_COUNT; chunk = chunk->next) {
+            iov[iovcnt].iov_base = (char*) chunk->data + offset;
+            iov[iovcnt].iov_len = chunk->length - offset;
+            offset = 0;
+            ++iovcnt;
+        }
+
+        ssize_t w = writev(conn->fd, iov, iovcnt);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 1;
+            return -1;
+        }
+
+        // release every fully written chunk, remember where we stopped in the last one
+        queue->pending -= w;
+        size_t written = w + queue->head_offset;
+        while (queue->head != NULL && written >= queue->head->length) {
+            OutputChunk* done = queue->head;
+            written -= done->length;
+            queue->head = done->next;
+            queue->chunks--;
+            freeChunk(done);
+        }
+        if (queue->head == NULL) queue->tail = NULL;
+        queue->head_offset = written;
+    }
+    return 0;
+}
+
+Connection* popDirtyConnection() {
+    Connection* conn = dirty_head;
+    if (conn != NULL) unlinkDirty(conn);
+    return conn;
+}
+
+bool hasPendingOutput(Connection* conn) {
+    return conn->output.head != NULL;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "../common/communication.h"
+
+#define INPUT_BUFFER_SIZE 8192 // must be a power of two and hold at least MAX_MESSAGE_LENGTH bytes
+#define MAX_PENDING_OUTPUT (4 << 20) // a peer that lets more bytes than this pile up is dropped, a user list must fit
+#define MAX_PENDING_CHUNKS 4096 // nor may it let more messages than this pile up, each costs a chunk header
+#define FLUSH_IOV_COUNT 64 // max number of queued messages written per writev call
+
+
+// data structures
+
+typedef struct RingBuffer {
+    char data[INPUT_BUFFER_SIZE];
+    size_t head;        // index of the first unread byte
+    size_t length;      // number of unread bytes
+} RingBuffer;
+
+typedef struct SharedBuffer {
+    int refcount;       // one reference per owner and per queued slice
+    size_t length;
+    char data[];
+} SharedBuffer;
+
+typedef struct OutputChunk {
+    struct OutputChunk* next;
+    SharedBuffer* shared;   // buffer referenced by this chunk, NULL if the bytes are stored inline
+    const char* data;       // first byte to write (in shared->data or inline_data)
+    size_t length;
+    char inline_data[];
+} OutputChunk;
+
+typedef struct OutputQueue {
+    OutputChunk* head;
+    OutputChunk* tail;
+    size_t head_offset;     // bytes of head already written
+    size_t pending;         // total bytes still to write, shared slices included
+    size_t chunks;          // number of chunks in the queue
+} OutputQueue;
+
+typedef struct Connection {
+    int fd;
+    int slot;           // index of the connection in the table of open connections
+    bool watching_output; // EPOLLOUT is currently requested for this socket
+    User* user;         // NULL until the client sent a USER_CREATION
+    RingBuffer* input;  // bytes received but not yet handled, only allocated while a partial frame is pending
+    OutputQueue output; // messages produced but not yet written to the socket
+    bool overflowed;    // output exceeded MAX_PENDING_OUTPUT or MAX_PENDING_CHUNKS, the connection must be dropped
+    int lobby_slot;     // index in the lobby subscribers, -1 if not subscribed
+    bool dirty;         // output was queued during the current loop iteration
+    struct Connection* prev_dirty;
+    struct Connection* next_dirty;
+} Connection;
+
+
+// --- Connection lifecycle ---
+
+Connection* createConnection(int fd);
+// creates a connection and registers it so that connectionFromFd can find it
+
+void destroyConnection(Connection* conn);
+// unregisters the connection and frees its buffers, does not close the socket nor free the user
+
+Connection* connectionFromFd(int fd);
+// returns NULL if no connection uses this file descriptor
+
+int connectionCount();
+Connection* connectionAt(int slot);
+// iterate over every open connection (0 <= slot < connectionCount())
+
+
+// --- Stream framing ---
+
+ssize_t readIntoConnection(Connection* conn);
+// reads everything the ring buffer can hold with a single readv call
+// a connection without pending partial frame borrows a shared buffer, settleInput must be called once done reading
+// returns the same values as recv
+
+int settleInput(Connection* conn);
+// gives back the borrowed input buffer, or copies the remaining partial frame into a buffer owned by the connection
+// returns -1 if memory is exhausted: the partial frame is lost and the connection must be closed
+
+int extractFrame(Connection* conn, char frame[MAX_MESSAGE_LENGTH], int32_t* message_type, ssize_t* frame_length);
+// pops the next complete message out of the input buffer and copies it (header included) in frame, in the legacy encoding
+// returns:
+// - 1 if a message was extracted
+// - 0 if the buffered bytes do not form a complete message yet
+// - -1 if the message type is unknown or a compact frame is malformed (the stream cannot be resynchronized)
+
+
+// --- Shared buffers ---
+
+SharedBuffer* createSharedBuffer(size_t length);
+// returns a buffer with a single reference, owned by the caller
+
+void retainSharedBuffer(SharedBuffer* buffer);
+void releaseSharedBuffer(SharedBuffer* buffer);
+// the buffer is freed when its last reference is released
+
+
+// --- Output queueing ---
+
+void queueMessage(int fd, int protocol, const void* data, size_t length);
+// MessageSink used by the server: copies the message (encoded with protocol) at the end of the output queue of fd
+// nothing is written to the socket until flushConnection is called
+
+SharedBuffer* takeBroadcastBuffer(int protocol, bool* lost);
+// returns the messages sent to BROADCAST_FD since the last call encoded with protocol, in a buffer owned by the caller (NULL if none)
+// lost is set if some of them could not be kept (memory exhausted): NULL is returned, the recipients must be dropped
+// the same buffer can then be queued on every recipient using that protocol with queueSharedSlice
+
+void queueSharedSlice(Connection* conn, SharedBuffer* buffer, size_t offset, size_t length);
+// queues length bytes of buffer starting at offset without copying them, the queue holds a reference until they are written
+// the buffer must not be modified while it has other references than the caller's
+
+void dropConnectionOutput(Connection* conn);
+// marks conn as overflowed because a message meant for it was lost, it is closed by its next flush
+
+int flushConnection(Connection* conn);
+// writes as much of the output queue as the socket accepts, coalescing queued messages in writev calls
+// returns:
+// - 0 if the queue is empty
+// - 1 if some output is still pending (wait for EPOLLOUT)
+// - -1 if the connection is broken or overflowed and must be closed
+
+Connection* popDirtyConnection();
+// returns a connection that queued output since it was last flushed, or NULL if there is none
+
+bool hasPendingOutput(Connection* conn);
@@ -0,0 +1,234 @@
+#include "lobby.h"
+#include "user_directory.h"
+#include "log.h"
+
+// the encoding is the entries part of SEND_USER_LIST (see encodeUserListEntry), in user directory order
+static SharedBuffer* encoded = NULL;
+static size_t encoded_capacity = 0;
+static size_t encoded_length = 0;
+static int lobby_count = 0;
+static bool stale = false; // a change could not be patched in, the encoding is rebuilt from the directory when next sent
+
+// offsets[i] is the position of the entry of userAt(i) in the encoding
+static size_t* offsets = NULL;
+static int offsets_capacity = 0;
+
+// connections that receive the changes (conn->lobby_slot is the index of conn)
+static Connection** subscribers = NULL;
+static int subscriber_count = 0;
+static int subscribers_capacity = 0;
+
+// messages describing the changes of the current loop iteration, back to back, once per protocol
+static char* changes[PROTOCOL_COUNT];
+static size_t changes_length[PROTOCOL_COUNT];
+static size_t changes_capacity[PROTOCOL_COUNT];
+
+static void recordChange(int32_t message_type, const void* message, size_t length) {
+    if (subscriber_count == 0) return; // nobody would receive it
+
+    for (int protocol = 0; protocol < PROTOCOL_COUNT; ++protocol) {
+        size_t needed = changes_length[protocol] + MAX_FRAME_LENGTH;
+        if (needed > changes_capacity[protocol]) {
+            size_t new_capacity = changes_capacity[protocol] ? changes_capacity[protocol] * 2 : 4096;
+            while (new_capacity < needed) new_capacity *= 2;
+            char* grown = realloc(changes[protocol], new_capacity);
+            if (grown == NULL) return;
+            changes[protocol] = grown;
+            changes_capacity[protocol] = new_capacity;
+        }
+        changes_length[protocol] += encodeFrame(changes[protocol] + changes_length[protocol], protocol, message_type, message, length);
+    }
+}
+
+static size_t entryLength(size_t offset) {
+    return sizeof(int32_t) + 2 + (unsigned char)encoded->data[offset + sizeof(int32_t) + 1];
+}
+
+static bool makeWritable(size_t needed) {
+    // copy on write: slices of the current buffer may still be queued on some connections
+    if (encoded != NULL && encoded->refcount == 1 && encoded_capacity >= needed) return true;
+
+    size_t new_capacity = encoded_capacity;
+    if (new_capacity < needed) {
+        new_capacity = new_capacity ? new_capacity * 2 : 64 * USER_LIST_ENTRY_MAX_LENGTH;
+        while (new_capacity < needed) new_capacity *= 2;
+    }
+    SharedBuffer* copy = createSharedBuffer(new_capacity);
+    if (copy == NULL) return false;
+    if (encoded != NULL) {
+        memcpy(copy->data, encoded->data, encoded_length);
+        releaseSharedBuffer(encoded);
+    }
+    encoded = copy;
+    encoded_capacity = new_capacity;
+    return true;
+}
+
+static bool reserveEntries(int count) {
+    if (count <= offsets_capacity) return true;
+    int new_capacity = offsets_capacity ? offsets_capacity : 64;
+    while (new_capacity < count) new_capacity *= 2;
+    size_t* grown = realloc(offsets, new_capacity * sizeof(size_t));
+    if (grown == NULL) return false;
+    offsets = grown;
+    offsets_capacity = new_capacity;
+    return true;
+}
+
+static bool rebuildEncoding() {
+    // encodes the whole user directory again, after a change that could not be patched in
+    int n = userCount();
+    if (!reserveEntries(n) || !makeWritable((size_t)n * USER_LIST_ENTRY_MAX_LENGTH)) return false;
+    encoded_length = 0;
+    for (int i = 0; i < n; ++i) {
+        User* user = userAt(i);
+        offsets[i] = encoded_length;
+        encoded_length += encodeUserListEntry(encoded->data + encoded_length, user->id, (user->active_game != NULL), user->username);
+    }
+    encoded->length = encoded_length;
+    lobby_count = n;
+    stale = false;
+    return true;
+}
+
+bool lobbyUserJoined(User* user) {
+    if (!stale) {
+        int n = lobby_count;
+        if (!reserveEntries(n + 1) || !makeWritable(encoded_length + USER_LIST_ENTRY_MAX_LENGTH)) return false;
+
+        // new users are appended, like in the user directory
+        offsets[n] = encoded_length;
+        encoded_length += encodeUserListEntry(encoded->data + encoded_length, user->id, (user->active_game != NULL), user->username);
+        encoded->length = encoded_length;
+        lobby_count = n + 1;
+    }
+
+    MessageUserJoined joined;
+    memset(&joined, 0, sizeof(joined));
+    joined.user_id = user->id;
+    joined.in_game = (user->active_game != NULL);
+    snprintf(joined.username, USERNAME_LENGTH, "%s", user->username);
+    recordChange(USER_JOINED, &joined, sizeof(joined));
+    return true;
+}
+
+void lobbyUserLeft(User* user) {
+    int index = userIndex(user);
+    if (index < 0 || (!stale && index >= lobby_count)) return;
+    MessageUserLeft left = { user->id };
+    recordChange(USER_LEFT, &left, sizeof(left));
+    if (stale) return;
+    if (!makeWritable(encoded_length)) {
+        stale = true;
+        return;
+    }
+
+    int last = lobby_count - 1;
+    char* data = encoded->data;
+    size_t removed_offset = offsets[index];
+    size_t removed_length = entryLength(removed_offset);
+
+    if (index != last) {
+        // the last entry takes the freed index, like in the user directory:
+        // the entries in between shift by the difference of length between the two entries
+        char moved[USER_LIST_ENTRY_MAX_LENGTH];
+        size_t moved_length = entryLength(offsets[last]);
+        memcpy(moved, data + offsets[last], moved_length);
+
+        size_t between_start = removed_offset + removed_length;
+        memmove(data + removed_offset + moved_length, data + between_start, offsets[last] - between_start);
+        memcpy(data + removed_offset, moved, moved_length);
+
+        long shift = (long)moved_length - (long)removed_length;
+        if (shift != 0) {
+            for (int i = index + 1; i < last; ++i) offsets[i] += shift;
+        }
+    }
+
+    encoded_length -= removed_length;
+    encoded->length = encoded_length;
+    lobby_count = last;
+}
+
+void lobbyUserStatusChanged(User* user) {
+    int index = userIndex(user);
+    if (index < 0 || (!stale && index >= lobby_count)) return;
+    if (!stale) {
+        if (makeWritable(encoded_length)) encoded->data[offsets[index] + sizeof(int32_t)] = (user->active_game != NULL);
+        else stale = true;
+    }
+
+    MessageUserStatus status = { user->id, (user->active_game != NULL) };
+    recordChange(USER_STATUS, &status, sizeof(status));
+}
+
+void sendLobbySnapshot(Connection* requester) {
+    if (stale && !rebuildEncoding()) {
+        // an empty list rather than a wrong one, the client asks again later
+        logError("Cannot rebuild the user list, an empty list is sent to %d.", requester->fd);
+        lobby_count = 0;
+        encoded_length = 0;
+    }
+    int n = lobby_count;
+    int self = (requester->user != NULL) ? userIndex(requester->user) : -1;
+    if (self >= n) self = -1;
+
+    // the requester's own entry is left out: the entries are sent in two slices around it
+    size_t self_offset = (self >= 0) ? offsets[self] : encoded_length;
+    size_t self_length = (self >= 0) ? entryLength(self_offset) : 0;
+
+    int protocol = connectionProtocol(requester->fd);
+    char header[16];
+    size_t header_length = encodeUserListHeader(header, protocol, (self >= 0) ? n - 1 : n, encoded_length - self_length);
+    queueMessage(requester->fd, protocol, header, header_length);
+    if (n == 0) return;
+
+    queueSharedSlice(requester, encoded, 0, self_offset);
+    queueSharedSlice(requester, encoded, self_offset + self_length, encoded_length - self_offset - self_length);
+}
+
+void lobbySubscribe(Connection* conn) {
+    // changes already recorded during this iteration will be received twice, clients apply them idempotently
+    sendLobbySnapshot(conn);
+    if (conn->lobby_slot >= 0) return;
+
+    if (subscriber_count >= subscribers_capacity) {
+        int new_capacity = subscribers_capacity ? subscribers_capacity * 2 : 64;
+        Connection** grown = realloc(subscribers, new_capacity * sizeof(Connection*));
+        if (grown == NULL) return;
+        subscribers = grown;
+        subscribers_capacity = new_capacity;
+    }
+    conn->lobby_slot = subscriber_count;
+    subscribers[subscriber_count++] = conn;
+}
+
+void lobbyUnsubscribe(Connection* conn) {
+    if (conn->lobby_slot < 0) return;
+    Connection* last = subscribers[--subscriber_count];
+    subscribers[conn->lobby_slot] = last;
+    last->lobby_slot = conn->lobby_slot;
+    conn->lobby_slot = -1;
+}
+
+void publishLobbyChanges() {
+    if (changes_length[PROTOCOL_LEGACY] == 0) return;
+
+    SharedBuffer* batches[PROTOCOL_COUNT];
+    for (int protocol = 0; protocol < PROTOCOL_COUNT; ++protocol) {
+        batches[protocol] = NULL;
+        if (subscriber_count > 0) {
+            batches[protocol] = createSharedBuffer(changes_length[protocol]);
+            if (batches[protocol] != NULL) memcpy(batches[protocol]->data, changes[protocol], changes_length[protocol]);
+        }
+        changes_length[protocol] = 0;
+    }
+
+    for (int i = 0; i < subscriber_count; ++i) {
+        SharedBuffer* batch = batches[connectionProtocol(subscribers[i]->fd)];
+        if (batch != NULL) queueSharedSlice(subscribers[i], batch, 0, batch->length);
+    }
+    for (int protocol = 0; protocol < PROTOCOL_COUNT; ++protocol) {
+        if (batches[protocol] != NULL) releaseSharedBuffer(batches[protocol]);
+    }
+}
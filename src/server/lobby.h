@@ -0,0 +1,35 @@
+#pragma once
+
+#include "connection.h"
+
+// Pre-encoded body of the SEND_USER_LIST message, listing every registered user in the order of the user directory.
+// It is patched whenever a user joins, leaves or enters/leaves a game, so that answering a GET_USER_LIST
+// only queues slices of this shared buffer instead of rebuilding and copying the whole list.
+//
+// Subscribed connections receive the list once, then only the changes (USER_JOINED, USER_LEFT, USER_STATUS).
+// The changes of a loop iteration are encoded once and the same buffer is queued on every subscriber.
+// A departure or status change that cannot be patched in (memory exhausted) marks the encoding stale: it is
+// rebuilt from the user directory before the list is next sent.
+
+
+bool lobbyUserJoined(User* user);
+// must be called right after registerUser succeeded
+// returns false if memory is exhausted, the user must then be unregistered before anything else changes
+
+void lobbyUserLeft(User* user);
+// must be called right before unregisterUser (both move the last user to the freed index)
+
+void lobbyUserStatusChanged(User* user);
+// must be called whenever user->active_game switches between NULL and a game
+
+void sendLobbySnapshot(Connection* requester);
+// queues a SEND_USER_LIST message listing every user but the requester's own entry
+
+void lobbySubscribe(Connection* conn);
+// sends the current list to conn, then pushes it every change until it unsubscribes
+
+void lobbyUnsubscribe(Connection* conn);
+// does nothing if conn is not subscribed, must be called before destroying a subscribed connection
+
+void publishLobbyChanges();
+// queues the changes recorded since the last call on every subscriber, to be called once per loop iteration
@@ -0,0 +1,154 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "log.h"
+
+#define SLOT_MASK (LOG_RING_SLOTS - 1)
+#define BATCH_SIZE 65536 // bytes written per fwrite call at most
+#define IDLE_SLEEP_NS 5000000 // 5 ms, flusher pause when the ring is empty
+
+// bounded multi-producer queue: a slot can be written when its sequence equals the write position,
+// and read when it equals the read position + 1
+typedef struct LogSlot {
+    atomic_size_t sequence;
+    int level;
+    struct timespec time;
+    int length;
+    char line[LOG_LINE_LENGTH];
+} LogSlot;
+
+static LogSlot slots[LOG_RING_SLOTS];
+static atomic_size_t write_position;
+static size_t read_position; // only touched by the flusher
+
+static atomic_size_t dropped_lines;
+static atomic_int stopping;
+static int started = 0;
+static pthread_t flusher;
+static FILE* output = NULL;
+
+static const char* level_names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+
+
+static int formatPrefix(char* dst, size_t size, int level, const struct timespec* time) {
+    struct tm tm;
+    localtime_r(&time->tv_sec, &tm);
+    return snprintf(dst, size, "%02d:%02d:%02d.%03ld %-5s ",
+        tm.tm_hour, tm.tm_min, tm.tm_sec, time->tv_nsec / 1000000, level_names[level]);
+}
+
+static int drainSlots(char* batch) {
+    // copies ready lines into batch and writes them at once, returns the number of lines written
+    size_t used = 0;
+    int lines = 0;
+    for (;;) {
+        LogSlot* slot = &slots[read_position & SLOT_MASK];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != read_position + 1) break;
+        // worst case size of a formatted line: prefix + text + newline
+        if (used + LOG_LINE_LENGTH + 64 > BATCH_SIZE) break;
+
+        used += formatPrefix(batch + used, 64, slot->level, &slot->time);
+        memcpy(batch + used, slot->line, slot->length);
+        used += slot->length;
+        batch[used++] = '\n';
+
+        atomic_store_explicit(&slot->sequence, read_position + LOG_RING_SLOTS, memory_order_release);
+        read_position++;
+        lines++;
+    }
+
+    size_t dropped = atomic_exchange(&dropped_lines, 0);
+    if (dropped > 0) used += snprintf(batch + used, 64, "%zu log lines dropped\n", dropped);
+
+    if (used > 0) {
+        fwrite(batch, 1, used, output);
+        fflush(output);
+    }
+    return lines;
+}
+
+static void* flusherMain(void* arg) {
+    (void)arg;
+    static char batch[BATCH_SIZE + 64];
+    struct timespec idle = { 0, IDLE_SLEEP_NS };
+
+    for (;;) {
+        if (drainSlots(batch) > 0) continue;
+        if (atomic_load(&stopping)) break;
+        nanosleep(&idle, NULL);
+    }
+    // lines logged while stopping
+    while (drainSlots(batch) > 0);
+    return NULL;
+}
+
+int logStart(FILE* out) {
+    output = out;
+    for (size_t i = 0; i < LOG_RING_SLOTS; ++i) atomic_init(&slots[i].sequence, i);
+    atomic_init(&write_position, 0);
+    read_position = 0;
+    atomic_init(&stopping, 0);
+
+    if (pthread_create(&flusher, NULL, flusherMain, NULL) != 0) return -1;
+    started = 1;
+    return 0;
+}
+
+void logStop() {
+    if (!started) return;
+    atomic_store(&stopping, 1);
+    pthread_join(flusher, NULL);
+    started = 0;
+}
+
+void logWrite(int level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+
+    if (!started) {
+        // no flusher: write synchronously
+        FILE* out = output ? output : stdout;
+        vfprintf(out, format, args);
+        fputc('\n', out);
+        va_end(args);
+        return;
+    }
+
+    // claim a slot
+    size_t position = atomic_load_explicit(&write_position, memory_order_relaxed);
+    LogSlot* slot;
+    for (;;) {
+        slot = &slots[position & SLOT_MASK];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&write_position, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) break;
+        }
+        else if (diff < 0) {
+            // ring full, the flusher is behind
+            atomic_fetch_add(&dropped_lines, 1);
+            va_end(args);
+            return;
+        }
+        else {
+            position = atomic_load_explicit(&write_position, memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    clock_gettime(CLOCK_REALTIME, &slot->time);
+    int length = vsnprintf(slot->line, LOG_LINE_LENGTH, format, args);
+    if (length < 0) length = 0;
+    if (length >= LOG_LINE_LENGTH) length = LOG_LINE_LENGTH - 1;
+    slot->length = length;
+    va_end(args);
+
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+}
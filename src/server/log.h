@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdio.h>
+
+// Asynchronous logging.
+// Callers only format their line into a slot of a lock-free ring, a background thread writes the slots
+// to the output in batches. A full ring drops lines (and counts them) instead of blocking the caller.
+// Lines below LOG_LEVEL are removed at compile time, with their arguments: build with -D LOG_LEVEL=0 to get debug lines.
+
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_RING_SLOTS 4096 // must be a power of two
+#define LOG_LINE_LENGTH 256 // longer lines are truncated
+
+
+int logStart(FILE* out);
+// starts the flusher thread writing to out, returns -1 on failure (lines are then written synchronously)
+
+void logStop();
+// writes every pending line and stops the flusher thread
+
+void logWrite(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+// formats a line into the ring, prefer the macros below which are compiled out under LOG_LEVEL
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define logDebug(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define logDebug(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define logInfo(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define logInfo(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define logWarn(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define logWarn(...) ((void)0)
+#endif
+
+#define logError(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
@@ -1,6 +1,6 @@
 /* server.c
  *
- * Simple multi-client echo server using poll().
+ * Multi-client Awale server using epoll().
  *
  * Build: gcc -o server server.c
  * Run:   ./server 12345
@@ -15,6 +15,8 @@
 
 // CONNECTION LOGIC
 static volatile sig_atomic_t keep_running = 1;
+static int epoll_fd = -1;
+static char worker_wakeup_tag; // epoll data of the workers eventfd, the listening socket uses NULL and clients their connection
 
 void int_handler(int _) { (void)_; keep_running = 0; }
 
@@ -24,104 +26,339 @@ int set_nonblocking(int fd) {
     return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
 }
 
-void disconnectUser(int* user_index, int fd, User* users[MAX_CLIENTS], struct pollfd *pfds, int * nfds) {
-
-    if (users[*user_index] == NULL) {
-        // user already disconnected
-        return;
+static void logGameBoard(Game* game) {
+    // debug only: one line per board instead of the multi-line simpleGamePrinting
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+    char houses[12 * 4 + 1];
+    int length = 0;
+    for (int i = 0; i < 12; ++i) {
+        length += snprintf(houses + length, sizeof(houses) - length, " %u", game->snapshot.board.seeds[i]);
     }
+    logDebug("%s (BOTTOM) vs %s (TOP), %s to play, points %u-%u, houses%s",
+        game->players[BOTTOM]->username, game->players[TOP]->username,
+        game->snapshot.turn == BOTTOM ? "BOTTOM" : "TOP",
+        game->snapshot.points[BOTTOM], game->snapshot.points[TOP], houses);
+#else
+    (void)game;
+#endif
+}
 
-    printf("Client %d with fd %d disconnected.\n", *user_index, fd);
-    close(fd);  
+void disconnectUser(Connection* conn) {
+
+    logInfo("Client %d with fd %d disconnected.", conn->slot, conn->fd);
+    close(conn->fd); // also removes it from the epoll set
+    lobbyUnsubscribe(conn);
 
     // deallocate user if it exists
-    if (users[*user_index] != NULL) {
+    if (conn->user != NULL) {
         // end active game it there is one
-        printf("Removing corresponding user.\n");
-        if (users[*user_index]->active_game != NULL) {
-            printf("Cancelling a game as a result.\n");
-            cancel_game(users[*user_index]->active_game);
+        logInfo("Removing corresponding user.");
+        if (conn->user->active_game != NULL) {
+            logInfo("Cancelling a game as a result.");
+            cancel_game(conn->user->active_game);
+        }
+        if (pendingGame(conn->user) != NULL) {
+            logInfo("Cancelling a game as a result.");
+            cancel_invite(pendingGame(conn->user));
         }
-        if (users[*user_index]->pending_game != NULL) {
-            printf("Cancelling a game as a result.\n");
-            cancel_invite(users[*user_index]->pending_game);
+        if (conn->user->observed_game != NULL) {
+            remove_observer(conn->user);
         }
-        free(users[*user_index]);
-        users[*user_index] = NULL;
+        lobbyUserLeft(conn->user);
+        unregisterUser(conn->user);
+        freeUser(conn->user);
+        conn->user = NULL;
+    }
+    setConnectionProtocol(conn->fd, PROTOCOL_LEGACY); // the fd number will be reused
+    destroyConnection(conn);
+}
+
+void watchOutput(Connection* conn, bool enable) {
+    // in edge-triggered mode EPOLLOUT is registered once and for all
+    if (EDGE_TRIGGERED || conn->watching_output == enable) return;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | (enable ? EPOLLOUT : 0);
+    ev.data.ptr = conn;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
+        logError("epoll_ctl: %s", strerror(errno));
+        return;
     }
+    conn->watching_output = enable;
+}
 
-    // remove this pfds entry by shifting
-    pfds[*user_index] = pfds[*nfds - 1];
-    pfds[*nfds - 1].fd = -1;
-    pfds[*nfds - 1].events = 0;
-    pfds[*nfds - 1].revents = 0;  
+static int drainConnection(Connection* conn) {
+    // returns -1 if the connection must be closed
+    char frame[MAX_MESSAGE_LENGTH];
 
-    users[*user_index] = users[*nfds-1];
-    users[*nfds-1] = NULL;
-    --(*nfds);
-    --(*user_index); // check the moved one on next iteration
+    // level-triggered: one read per wakeup is enough, epoll reports the socket again if data is left
+    // edge-triggered: the socket must be drained until EAGAIN
+    do {
+        ssize_t r = readIntoConnection(conn);
+        if (r < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            if (errno != ECONNRESET) logError("recv: %s", strerror(errno));
+            return -1;
+        } else if (r == 0) {
+            // client closed
+            return -1;
+        }
+
+        // standard case : handle every complete message that was received, partial ones stay buffered
+        logDebug("Received %ld bytes from fd %d", (long) r, conn->fd);
+        int32_t message_type = -1;
+        ssize_t frame_length;
+        int status;
+        while ((status = extractFrame(conn, frame, &message_type, &frame_length)) > 0) {
+            void* message_ptr = (void*) (frame + sizeof(int32_t));
+            int success = handleMessage(message_type, message_ptr, frame_length, conn);
+
+            if (success < 0) {
+                logWarn("Something went wrong handling message from user with file descriptor %d", conn->fd);
+            }
+        }
+        if (status < 0) {
+            logWarn("unknown or malformed message (type %d) from fd %d, closing connection.", message_type, conn->fd);
+            return -1;
+        }
+    } while (EDGE_TRIGGERED);
+
+    return 0;
+}
+
+int readFromConnection(Connection* conn) {
+    // returns -1 if the connection must be closed
+    int res = drainConnection(conn);
+    if (settleInput(conn) < 0) {
+        logError("Cannot keep the partial message of fd %d, closing connection.", conn->fd);
+        return -1;
+    }
+    return res;
+}
+
+void setActiveGame(User* user, Game* game) {
+    bool was_in_game = (user->active_game != NULL);
+    user->active_game = game;
+    if (was_in_game != (game != NULL)) lobbyUserStatusChanged(user);
+}
+
+void broadcastToGame(Game* game, User* except) {
+    // queues the messages captured on BROADCAST_FD to both players and every observer but except,
+    // encoding them once per protocol whatever the number of spectators
+    SharedBuffer* buffers[PROTOCOL_COUNT];
+    bool lost[PROTOCOL_COUNT];
+    for (int protocol = 0; protocol < PROTOCOL_COUNT; ++protocol) buffers[protocol] = takeBroadcastBuffer(protocol, &lost[protocol]);
+
+    for (int i = -2; i < game->observers_count; ++i) {
+        User* recipient = (i < 0) ? game->players[i + 2] : game->observers[i];
+        if (recipient == except) continue;
+        Connection* conn = connectionFromFd(recipient->fd);
+        if (conn == NULL) continue;
+        int protocol = connectionProtocol(recipient->fd);
+        // a recipient missing a message would no longer agree with the server on the game, it is closed instead
+        if (lost[protocol]) dropConnectionOutput(conn);
+        else if (buffers[protocol] != NULL) queueSharedSlice(conn, buffers[protocol], 0, buffers[protocol]->length);
+    }
+
+    for (int protocol = 0; protocol < PROTOCOL_COUNT; ++protocol) {
+        if (buffers[protocol] != NULL) releaseSharedBuffer(buffers[protocol]);
+    }
 }
 
 void cancel_invite(Game* game) {
     if (game == NULL) return;
     game->cancelled_game = true;
-    game->players[BOTTOM]->pending_game = NULL;
-    game->players[TOP]->pending_game = NULL;
+    setPendingGame(game->players[BOTTOM], NULL);
+    setPendingGame(game->players[TOP], NULL);
     sendMessageMatchCancellation(game->players[BOTTOM]->fd);
     sendMessageMatchCancellation(game->players[TOP]->fd);
-    free(game);
+    freeGame(game);
 }
 
 void cancel_game(Game* game) {
     if (game == NULL) return;
     game->cancelled_game = true;
-    game->players[BOTTOM]->active_game = NULL;
-    game->players[TOP]->active_game = NULL;
-    sendMessageMatchCancellation(game->players[BOTTOM]->fd);
-    sendMessageMatchCancellation(game->players[TOP]->fd);
+    setActiveGame(game->players[BOTTOM], NULL);
+    setActiveGame(game->players[TOP], NULL);
+    sendMessageMatchCancellation(BROADCAST_FD);
+    broadcastToGame(game, NULL);
 
     for (int i = 0; i < game->observers_count; ++i) {
-        sendMessageMatchCancellation(game->observers[i]->fd);
+        game->observers[i]->observed_game = NULL;
+        game->observers[i]->observer_slot = -1;
+    }
+    freeBotPlayer(game->players[BOTTOM]);
+    freeBotPlayer(game->players[TOP]);
+    freeGame(game);
+}
+
+void end_game(Game* game) {
+    Side winner = whoHasWon(game->snapshot);
+    if (winner == NO_SIDE) {
+        logInfo("Game between %s and %s ended in a draw.", game->players[BOTTOM]->username, game->players[TOP]->username);
+    }
+    else {
+        logInfo("User %d (%s) won the game !", game->players[winner]->id, game->players[winner]->username);
+    }
+    MessageGameEnd end_message;
+    end_message.winner = winner;
+    end_message.final_snapshot = game->snapshot;
+    sendMessageGameEnd(BROADCAST_FD, end_message);
+    broadcastToGame(game, NULL); // players and observers
+    archiveGame(game);
+
+    // remove active game from users
+    setActiveGame(game->players[BOTTOM], NULL);
+    setActiveGame(game->players[TOP], NULL);
+    setPendingGame(game->players[BOTTOM], NULL);
+    setPendingGame(game->players[TOP], NULL);
+
+    // remove observers
+    for (int i = 0; i < game->observers_count; ++i) {
+        game->observers[i]->observed_game = NULL;
+        game->observers[i]->observer_slot = -1;
+    }
+    freeBotPlayer(game->players[BOTTOM]);
+    freeBotPlayer(game->players[TOP]);
+    freeGame(game);
+}
+
+int play_game_move(Game* game, User* player, int selected_house) {
+    // check it was the right user that played the move, and that the move is legal before touching the game
+    int success_code;
+    int side_house = selected_house - (game->snapshot.turn == TOP ? 6 : 0);
+    if (side_house < 0 || side_house > 5 || !(generateLegalMoves(&game->snapshot) >> side_house & 1)) {
+        success_code = -4;
+    }
+    else if (player != game->players[game->snapshot.turn]) {
+        success_code = -5;
     }
-    free(game);
+    else {
+        success_code = playMove(game, game->snapshot.turn, selected_house);
+    }
+
+    if (success_code < 0) {
+        logDebug("Move is illegal, notifying sender (failure code %d).", success_code);
+        if (!isBot(player)) sendMessageGameIllegalMove(player->fd);
+        return -1;
+    }
+    if (success_code == 0 && !isTerminal(&game->snapshot)) {
+        logDebug("Valid move played by %s, game updated.", player->username);
+        // compact clients replay the move themselves, legacy ones get the whole snapshot
+        MessageGameMoveApplied applied;
+        applied.selected_house = selected_house;
+        applied.sequence = game->sequence;
+        applied.checksum = snapshotChecksum(&game->snapshot);
+        sendMessageGameMoveApplied(PROTOCOL_BROADCAST_FD(PROTOCOL_COMPACT), applied);
+
+        MessageGameUpdate update;
+        update.snapshot = game->snapshot;
+        sendMessageGameUpdate(PROTOCOL_BROADCAST_FD(PROTOCOL_LEGACY), update);
+        broadcastToGame(game, NULL); // players and observers
+        logGameBoard(game);
+        return 0;
+    }
+
+    // game was won by current user (success code 1), or the next player has no move left
+    logGameBoard(game);
+    end_game(game);
+    return 1;
+}
+
+// a bot move is searched by a worker thread on a copy of the snapshot, then played by the loop
+typedef struct BotMoveJob {
+    Job job;
+    Game* game;
+    uint32_t game_generation;   // pool generation of game, tells whether it was freed meanwhile
+    int32_t sequence;           // moves played in the game when the search started
+    GameSnapshot snapshot;
+    int profile;                // bot_profile of the bot to play
+    int house;                  // result of the search
+} BotMoveJob;
+
+static Pool bot_job_pool = POOL_INITIALIZER(BotMoveJob, 64); // only used by the loop thread
+
+static void searchBotMove(Job* job) {
+    BotMoveJob* bot_job = (BotMoveJob*)job;
+    bot_job->house = chooseBotMove(&bot_job->snapshot, bot_job->profile);
+}
+
+static void applyBotMove(Job* job) {
+    BotMoveJob* bot_job = (BotMoveJob*)job;
+    // the game may have been cancelled while the bot was thinking, and its memory reused by another game
+    Game* game = bot_job->game;
+    if (poolIsLive(game, bot_job->game_generation) && game->sequence == bot_job->sequence) {
+        play_game_move(game, game->players[game->snapshot.turn], bot_job->house);
+    }
+    poolFree(&bot_job_pool, bot_job);
 }
 
-void add_observer(User* observer, User* player_to_observe) {
-    Game * game = player_to_observe->active_game;
-    game->observers[game->observers_count] = observer;
-    game->observers_count++;
-    observer->observed_game = game;
+void play_bot_turn(Game* game) {
+    User* bot = game->players[game->snapshot.turn];
+    if (!isBot(bot)) return;
+
+    BotMoveJob* bot_job = poolAlloc(&bot_job_pool);
+    if (bot_job == NULL) {
+        logError("cannot allocate a bot move, cancelling the game.");
+        cancel_game(game);
+        return;
+    }
+    bot_job->job.run = searchBotMove;
+    bot_job->job.complete = applyBotMove;
+    bot_job->game = game;
+    bot_job->game_generation = poolGeneration(game);
+    bot_job->sequence = game->sequence;
+    bot_job->snapshot = game->snapshot;
+    bot_job->profile = bot->bot_profile;
+    submitJob(&bot_job->job);
+}
+
+void start_bot_game(User* player, User* bot) {
+    User* bot_player = createBotPlayer(bot);
+    Game* game = (bot_player != NULL) ? initGame(player, bot_player) : NULL; // the human plays first
+    if (game == NULL) {
+        logError("cannot allocate a game against %s.", bot->username);
+        freeBotPlayer(bot_player);
+        sendMessageMatchResponse(player->fd, false);
+        return;
+    }
+    game->accepted_game = true;
+    setActiveGame(player, game);
+    setActiveGame(bot_player, game);
+    logInfo("User %s (id %d) started a game against %s.", player->username, player->id, bot->username);
+    logGameBoard(game);
+
+    // bots accept every challenge, only the human is told
+    MessageGameStart start_mes;
+    memset(&start_mes, 0, sizeof(start_mes));
+    start_mes.first_snapshot = game->snapshot;
+    strcpy(start_mes.opponent_username, bot->username);
+    start_mes.player_side = BOTTOM;
+    sendMessageGameStart(player->fd, start_mes);
+}
+
+bool add_observer(User* observer, Game* game) {
+    if (!addGameObserver(game, observer)) return false;
 
     MessageSpectatorJoin mes;
     strcpy(mes.spectator_username, observer->username);
     mes.spectator_id = observer->id;
-    sendMessageSpectatorJoin(game->players[BOTTOM]->fd, mes);
-    sendMessageSpectatorJoin(game->players[TOP]->fd, mes);
-    
-    for (int i = 0; i < game->observers_count; ++i) {
-        sendMessageSpectatorJoin(game->observers[i]->fd, mes);
-    }
+    sendMessageSpectatorJoin(BROADCAST_FD, mes);
+    broadcastToGame(game, NULL);
+    return true;
 }
 
 void remove_observer(User* observer) {
     Game * game = observer->observed_game;
-    for (int i = 0; i < MAX_OBSERVERS; ++i) {
-        if (game->observers[i] == observer) {
-            game->observers[i] = NULL;
-            game->observers[i] = game->observers[game->observers_count-1];
-            game->observers_count--;
-
-            MessageSpectatorLeave mes;
-            strcpy(mes.spectator_username, observer->username);
-            mes.spectator_id = observer->id;
-            sendMessageSpectatorLeave(game->players[BOTTOM]->fd, mes);
-            sendMessageSpectatorLeave(game->players[TOP]->fd, mes);
-            for (int i = 0; i < game->observers_count; ++i) {
-                sendMessageSpectatorLeave(game->observers[i]->fd, mes);
-            }
-            break;
-        }
-    }    
+    if (game == NULL) return;
+    removeGameObserver(game, observer);
+
+    MessageSpectatorLeave mes;
+    strcpy(mes.spectator_username, observer->username);
+    mes.spectator_id = observer->id;
+    sendMessageSpectatorLeave(BROADCAST_FD, mes);
+    broadcastToGame(game, NULL);
 }
 
 int main(int argc, char **argv) {
@@ -132,6 +369,7 @@ int main(int argc, char **argv) {
 
     signal(SIGINT, int_handler);
     signal(SIGTERM, int_handler);
+    signal(SIGPIPE, SIG_IGN); // a peer closing its socket is reported by writev, not by a signal
 
     int port = atoi(argv[1]);
     if (port <= 0 || port > 65535) {
@@ -139,6 +377,18 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
+    if (logStart(stdout) < 0) {
+        fprintf(stderr, "Cannot start the logging thread, logging synchronously\n");
+    }
+
+    if (!startBots()) {
+        fprintf(stderr, "Cannot create the bot users\n");
+        return EXIT_FAILURE;
+    }
+    if (!openGameArchive(GAME_ARCHIVE_PATH)) {
+        logWarn("Cannot open the game archive %s, finished games are not archived.", GAME_ARCHIVE_PATH);
+    }
+
     int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (listen_fd < 0) {
         perror("socket");
@@ -152,9 +402,6 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    User* users[MAX_CLIENTS];
-    memset(users, 0, sizeof(User*)*MAX_CLIENTS);
-
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
@@ -178,117 +425,185 @@ int main(int argc, char **argv) {
         // not fatal; continue
     }
 
-    struct pollfd *pfds = calloc(MAX_CLIENTS + 1, sizeof(struct pollfd));
-    if (!pfds) {
-        perror("calloc");
+    // the number of connections is only bounded by the number of file descriptors: use as many as allowed
+    struct rlimit fd_limit;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0 && fd_limit.rlim_cur < fd_limit.rlim_max) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &fd_limit) < 0) perror("setrlimit");
+    }
+    int spare_fd = open("/dev/null", O_RDONLY); // released to reject connections when no descriptor is left
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
         close(listen_fd);
         return EXIT_FAILURE;
     }
 
-    pfds[0].fd = listen_fd;
-    pfds[0].events = POLLIN;
-    int nfds = 1; // number of used entries in pfds
+    // the listening socket is the only one registered without a connection
+    struct epoll_event listen_ev;
+    listen_ev.events = EPOLLIN;
+    listen_ev.data.ptr = NULL;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &listen_ev) < 0) {
+        perror("epoll_ctl");
+        close(epoll_fd);
+        close(listen_fd);
+        return EXIT_FAILURE;
+    }
+
+    // bot searches run on the other cores, the loop is woken up when one completes
+    int worker_count = WORKER_THREADS;
+    if (worker_count <= 0) worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (worker_count < 1) worker_count = 1;
+    int worker_fd = startWorkers(worker_count);
+    if (worker_fd < 0) {
+        logWarn("Cannot start the worker threads, bot moves will be searched by the loop.");
+    }
+    else {
+        struct epoll_event worker_ev;
+        worker_ev.events = EPOLLIN;
+        worker_ev.data.ptr = &worker_wakeup_tag;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, worker_fd, &worker_ev) < 0) {
+            perror("epoll_ctl");
+            return EXIT_FAILURE;
+        }
+        logInfo("%d worker threads started.", worker_count);
+    }
+
+    // every sendMessageXXX call is queued on the target connection and written at the end of the loop iteration
+    setMessageSink(queueMessage);
 
-    printf("Server listening on port %d\n", port);
+    logInfo("Server listening on port %d", port);
 
-    char buf[BUF_SIZE];
+    struct epoll_event events[MAX_EVENTS];
 
     while (keep_running) {
         int timeout_ms = 1000; // wakeup every second to check signal
-        int ready = poll(pfds, nfds, timeout_ms);
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
         if (ready < 0) {
             if (errno == EINTR) continue;
-            perror("poll");
+            logError("epoll_wait: %s", strerror(errno));
             break;
         } else if (ready == 0) {
             continue; // timeout, loop again to check keep_running
         }
 
-        // Check listening socket
-        if (pfds[0].revents & POLLIN) {
-            // accept in a loop (because non-blocking)
-            while (1) {
-                struct sockaddr_in cli_addr;
-                socklen_t cli_len = sizeof(cli_addr);
-                int client_fd = accept(listen_fd, (struct sockaddr *)&cli_addr, &cli_len);
-                if (client_fd < 0) {
-                    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-                    perror("accept");
-                    break;
-                }
-
-                // find free slot
-                if (nfds >= MAX_CLIENTS + 1) {
-                    fprintf(stderr, "Too many connections, rejecting\n");
-                    close(client_fd);
-                    continue;
-                }
-
-                if (set_nonblocking(client_fd) < 0) {
-                    // not fatal
-                }
+        // only the sockets that are ready are visited
+        for (int e = 0; e < ready; ++e) {
+            if (events[e].data.ptr == &worker_wakeup_tag) {
+                // searches completed: play their moves, the messages are flushed below with the others
+                runCompletedJobs();
+                continue;
+            }
+            Connection* conn = events[e].data.ptr;
+            uint32_t re = events[e].events;
+
+            if (conn == NULL) {
+                // listening socket: accept in a loop (because non-blocking)
+                while (1) {
+                    struct sockaddr_in cli_addr;
+                    socklen_t cli_len = sizeof(cli_addr);
+                    int client_fd = accept(listen_fd, (struct sockaddr *)&cli_addr, &cli_len);
+                    if (client_fd < 0) {
+                        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                        if ((errno == EMFILE || errno == ENFILE) && spare_fd >= 0) {
+                            // out of file descriptors: use the spare one to accept and close the pending connection,
+                            // otherwise the listening socket would stay readable and the loop would spin
+                            close(spare_fd);
+                            int rejected_fd = accept(listen_fd, NULL, NULL);
+                            if (rejected_fd >= 0) close(rejected_fd);
+                            spare_fd = open("/dev/null", O_RDONLY);
+                            logWarn("Too many connections, rejecting");
+                            continue;
+                        }
+                        logError("accept: %s", strerror(errno));
+                        break;
+                    }
 
-                pfds[nfds].fd = client_fd;
-                pfds[nfds].events = POLLIN;
-                nfds++;
+                    if (set_nonblocking(client_fd) < 0) {
+                        // not fatal
+                    }
 
-                char ipbuf[INET_ADDRSTRLEN];
-                inet_ntop(AF_INET, &cli_addr.sin_addr, ipbuf, sizeof(ipbuf));
-                printf("\nAccepted %s:%d (fd=%d)\n", ipbuf, ntohs(cli_addr.sin_port), client_fd);
-            }
-        }
+                    Connection* new_conn = createConnection(client_fd);
+                    if (new_conn == NULL) {
+                        logError("calloc: %s", strerror(errno));
+                        close(client_fd);
+                        continue;
+                    }
 
-        // Check client sockets (start at 1)
-        for (int i = 1; i < nfds; ++i) {
-            int fd = pfds[i].fd;
-            short re = pfds[i].revents;
-            if (re == 0) continue;
+                    struct epoll_event ev;
+                    ev.events = EDGE_TRIGGERED ? (EPOLLIN | EPOLLOUT | EPOLLET) : EPOLLIN;
+                    ev.data.ptr = new_conn;
+                    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+                        logError("epoll_ctl: %s", strerror(errno));
+                        destroyConnection(new_conn);
+                        close(client_fd);
+                        continue;
+                    }
 
-            if (re & (POLLERR | POLLHUP | POLLNVAL)) {
-                // client disconnected/error
-                disconnectUser(&i, fd, users, pfds, &nfds);             
+                    char ipbuf[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, &cli_addr.sin_addr, ipbuf, sizeof(ipbuf));
+                    logInfo("Accepted %s:%d (fd=%d)", ipbuf, ntohs(cli_addr.sin_port), client_fd);
+                }
                 continue;
             }
 
-            if (re & POLLIN) {
-                ssize_t r = recv(fd, buf, sizeof(buf), 0);
-                if (r < 0) {
-                    if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
-                    perror("recv");
-                    disconnectUser(&i, fd, users, pfds, &nfds);                
+            if (re & EPOLLOUT) {
+                // the socket accepts data again, resume writing the pending output
+                int res = flushConnection(conn);
+                if (res < 0) {
+                    disconnectUser(conn);
                     continue;
+                }
+                watchOutput(conn, res > 0);
+            }
 
-                } else if (r == 0) {
-                    // client closed
-                    disconnectUser(&i, fd, users, pfds, &nfds);               
+            if (re & EPOLLIN) {
+                // read before checking for errors so that the last messages of a closing peer are still handled
+                if (readFromConnection(conn) < 0) {
+                    disconnectUser(conn);
                     continue;
-
-                } else {
-                    // standard case : process how you handle the client when a message was received
-                    printf("\nMessage length : %lu\n",r);
-                    int32_t message_type;
-                    memcpy(&message_type, buf, sizeof(int32_t));
-                    void* message_ptr = (void*) ((int32_t*)buf+1);
-
-                    // TODO: change this mecanism to handle the case where several message are received at once in the same buffer
-                    int success = handleMessage(message_type, message_ptr, r, users, pfds, fd, i);
-
-                    if (success < 0) {
-                        printf("Something went wrong handling message from user with file descriptor %d\n", fd);
-                    }
                 }
             }
+            else if (re & (EPOLLERR | EPOLLHUP)) {
+                // client disconnected/error
+                disconnectUser(conn);
+                continue;
+            }
+        }
+
+        // write everything produced during this iteration, one writev per peer
+        publishLobbyChanges();
+        Connection* dirty;
+        while ((dirty = popDirtyConnection()) != NULL) {
+            int res = flushConnection(dirty);
+            if (res < 0) {
+                // may queue cancellation messages for other peers, they are flushed by this same loop
+                disconnectUser(dirty);
+                publishLobbyChanges();
+                continue;
+            }
+            watchOutput(dirty, res > 0);
         }
     }
 
-    printf("Shutting down server...\n");
+    logInfo("Shutting down server...");
+    stopWorkers();
     // Close all open fds
-    for (int i = 1; i < nfds; ++i) {
-        close(pfds[i].fd);
-        if (users[i] != NULL) free(users[i]);
+    while (connectionCount() > 0) {
+        Connection* conn = connectionAt(0);
+        close(conn->fd);
+        if (conn->user != NULL) freeUser(conn->user);
+        destroyConnection(conn);
     }
-    free(pfds);
+    close(epoll_fd);
     close(listen_fd);
+    if (spare_fd >= 0) close(spare_fd);
+
+    stopBots();
+    closeGameArchive();
+    logStop();
+    printObjectPoolStats(stdout);
 
     return EXIT_SUCCESS;
 }
@@ -299,118 +614,153 @@ int main(int argc, char **argv) {
 // ----- MAIN MESSAGE HANDLING LOGIC ----
 // --------------------------------------
 
-int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* users[MAX_CLIENTS], struct pollfd *pfds, int user_fd, int user_index) {
+int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, Connection* source_conn) {
 
-    // checking if message was received in full
+    // the framing layer only hands out complete messages, this only guards against misuse
     int diff = isMessageComplete(message_type, r);
     if (diff != 0) {
-        printf("lentgh difference between expected and received message size : %d\n", diff);
+        logDebug("lentgh difference between expected and received message size : %d", diff);
         if (diff > 0) return -1; //message not received in full -> cancel operation        
     }
 
-    User* source_user = users[user_index];
+    User* source_user = source_conn->user;
+    int user_fd = source_conn->fd;
+    int user_index = source_conn->slot;
 
     switch (message_type) {
 
         case USER_CREATION:
-            printf("USER_CREATION\n");
+            logDebug("USER_CREATION");
             if (source_user != NULL){
-                printf("error: User is already registered.\n");
+                logWarn("User is already registered.");
                 return -1;
             }
             MessageUserCreation userCreationMes;
             memcpy(&userCreationMes, message_ptr, sizeof(MessageUserCreation));
+            userCreationMes.username[USERNAME_LENGTH - 1] = '\0';
+
+            logDebug("User creation message received");
+            logDebug("username : %s", userCreationMes.username);
 
-            printf("User creation message received\n");
-            printf("username : %s\n", userCreationMes.username);
+            MessageUserRegistration msg;
+            if (findUserByName(userCreationMes.username) != NULL) {
+                logWarn("username %s is already taken.", userCreationMes.username);
+                msg.user_id = -1; // registration refused
+                sendMessageUserRegistration(user_fd, msg);
+                return -1;
+            }
 
             User* instanciated_user = createUser(userCreationMes.username, user_fd);
+            if (instanciated_user == NULL || !registerUser(instanciated_user)) {
+                logError("could not register user %s.", userCreationMes.username);
+                freeUser(instanciated_user);
+                msg.user_id = -1;
+                sendMessageUserRegistration(user_fd, msg);
+                return -1;
+            }
+            if (!lobbyUserJoined(instanciated_user)) {
+                logError("could not add user %s to the user list.", userCreationMes.username);
+                unregisterUser(instanciated_user);
+                freeUser(instanciated_user);
+                msg.user_id = -1;
+                sendMessageUserRegistration(user_fd, msg);
+                return -1;
+            }
             // update user 
-            users[user_index] = instanciated_user;
+            source_conn->user = instanciated_user;
 
             //acknowledge client 
-            MessageUserRegistration msg;
             msg.user_id = instanciated_user->id;
             sendMessageUserRegistration(user_fd, msg);
 
             break;
 
         case GET_USER_LIST:
-            printf("GET_USER_LIST\n");
+            logDebug("GET_USER_LIST");
             if (source_user == NULL) {
-                printf("error: Got a request from an unregistered user.\n");
+                logWarn("Got a request from an unregistered user.");
                 return -1;
             }
-            printf("Received users list request from %s.\n", users[user_index]->username);
-            fflush(stdout);
-
-            // list all users 
-            char usernames[MAX_CLIENTS][USERNAME_LENGTH];
-            int user_ids[MAX_CLIENTS];
-            char in_games[MAX_CLIENTS];
-            int users_count = 0;
-            for (int i = 0; i < MAX_CLIENTS; ++i) {
-                if (users[i] != NULL && i != user_index) {
-                    // we found an user 
-                    strcpy(usernames[users_count], users[i]->username);
-                    user_ids[users_count] = users[i]->id;
-                    in_games[users_count] = (users[i]->active_game != NULL);
-                    ++users_count;
-                }
-            }
+            logDebug("Received users list request from %s.", source_user->username);
+
+            // send the cached list to the client, without its own entry
+            sendLobbySnapshot(source_conn);
+
+            break;
 
-            // send result to client
-            sendUserList(user_fd, usernames, user_ids, users_count, in_games);
+        case HELLO:
+            logDebug("HELLO");
+            MessageHello hello;
+            memcpy(&hello, message_ptr, sizeof(hello));
 
+            // answer in the current protocol, then switch to the highest one both sides understand
+            hello.protocol = (hello.protocol >= PROTOCOL_COMPACT) ? PROTOCOL_COMPACT : PROTOCOL_LEGACY;
+            sendMessageHello(user_fd, hello);
+            setConnectionProtocol(user_fd, hello.protocol);
+            break;
+
+        case SUBSCRIBE_LOBBY:
+            logDebug("SUBSCRIBE_LOBBY");
+            if (source_user == NULL) {
+                logWarn("Got a request from an unregistered user.");
+                return -1;
+            }
+            lobbySubscribe(source_conn);
+            break;
+
+        case UNSUBSCRIBE_LOBBY:
+            logDebug("UNSUBSCRIBE_LOBBY");
+            lobbyUnsubscribe(source_conn);
             break;
 
         case MATCH_REQUEST:
-            printf("MATCH_REQUEST\n");
+            logDebug("MATCH_REQUEST");
             // check that user is indeed created
             if (source_user == NULL) {
-                printf("error: Got a request from an unregistered user.\n");
+                logWarn("Got a request from an unregistered user.");
                 return -1;
             }
-            printf("Received a match request from user %d.\n", user_index);
+            logDebug("Received a match request from user %d.", user_index);
 
             // read message
             MessageMatchRequest mes;
             memcpy(&mes, message_ptr, sizeof(MessageMatchRequest));
 
             // find opponent user by id
-            User* opponent = NULL;
-            for (int i = 0; i < MAX_CLIENTS; ++i) {
-                if (users[i] != NULL && users[i]->id == mes.opponent_id) {
-                    opponent = users[i];
-                }
-            }
+            User* opponent = findUserById(mes.opponent_id);
             if (opponent == NULL) {
-                printf("Unable to find opponent with asked id.\n");
+                logWarn("Unable to find opponent with asked id.");
                 sendMessageMatchResponse(user_fd, false);
                 return -1;
             }
 
             // check that opponent exists 
             if (opponent == source_user) {
-                printf("error: cannot create a game with oneself.\n");
+                logWarn("cannot create a game with oneself.");
                 sendMessageMatchResponse(user_fd, false); // auto cancellation if non-existing or self opponent
             }
             else if (source_user->active_game != NULL || opponent->active_game != NULL) {
-                printf("error: an user already has an active game.\n");
+                logWarn("an user already has an active game.");
                 sendMessageMatchResponse(user_fd, false); // one of 2 users is already in a game
             }
-            else if (source_user->pending_game != NULL || opponent->pending_game != NULL) {
-                printf("error: an user already has a pending invite.\n");
+            else if (pendingGame(source_user) != NULL || pendingGame(opponent) != NULL) {
+                logWarn("an user already has a pending invite.");
                 sendMessageMatchResponse(user_fd, false); // one of 2 users already has an invite
             }
+            else if (isBot(opponent)) {
+                start_bot_game(source_user, opponent);
+            }
             else {
-                printf("Received game request from user %s (id %d) with user %s (id %d).\n", source_user->username, source_user->id, opponent->username, opponent->id);
+                logInfo("Received game request from user %s (id %d) with user %s (id %d).", source_user->username, source_user->id, opponent->username, opponent->id);
 
-                Game * new_game = calloc(1, sizeof(Game));
-                new_game->players[BOTTOM] = source_user; 
-                new_game->players[TOP] = opponent;
-                source_user->pending_game = new_game;       
-                opponent->pending_game = new_game;
+                Game * new_game = initGame(source_user, opponent); // players[BOTTOM] is the requester
+                if (new_game == NULL) {
+                    logError("cannot allocate game.");
+                    sendMessageMatchResponse(user_fd, false);
+                    break;
+                }
+                setPendingGame(source_user, new_game);
+                setPendingGame(opponent, new_game);
 
                 // send invite
                 MessageMatchProposition invite_msg;
@@ -424,27 +774,28 @@ int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* user
             break;
 
         case MATCH_RESPONSE:
-            printf("MATCH_RESPONSE\n");
+            logDebug("MATCH_RESPONSE");
             // check that user is indeed created
             if (source_user == NULL) {
-                printf("error: Got a request from an unregistered user.\n");
+                logWarn("Got a request from an unregistered user.");
                 return -1;
             }
             
             // check it has indeed a pending game
-            if (source_user->pending_game == NULL) {
-                printf("error: user %d (%s) sent a response but has no game invite pending.\n", user_index, source_user->username);
+            Game* invite = pendingGame(source_user);
+            if (invite == NULL) {
+                logWarn("user %d (%s) sent a response but has no game invite pending.", user_index, source_user->username);
                 return -1;
             }
 
             // check it has no active game
             if (source_user->active_game != NULL) {
-                printf("error: user %d (%s) sent a response but has an ongoing game.\n", user_index, source_user->username);
+                logWarn("user %d (%s) sent a response but has an ongoing game.", user_index, source_user->username);
                 return -1;
             }
 
-            if (source_user->pending_game->players[TOP] != source_user) {
-                printf("error: user %d (%s) sent a response but was not the one invited in the game.\n", user_index, source_user->username);
+            if (invite->players[TOP] != source_user) {
+                logWarn("user %d (%s) sent a response but was not the one invited in the game.", user_index, source_user->username);
                 return -1;
             }
 
@@ -452,18 +803,18 @@ int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* user
             int32_t response;
             memcpy(&response, message_ptr, sizeof(response));
 
-            if (response == true && source_user->pending_game->cancelled_game == false) {
+            if (response == true && invite->cancelled_game == false) {
                 // start the game
-                source_user->active_game = source_user->pending_game;
-                source_user->active_game->players[BOTTOM]->active_game = source_user->active_game;
+                setActiveGame(source_user, invite);
+                setActiveGame(source_user->active_game->players[BOTTOM], source_user->active_game);
                 source_user->active_game->accepted_game = true;
                 setupGame(source_user->active_game);
 
-                source_user->active_game->players[BOTTOM]->pending_game = NULL;
-                source_user->pending_game = NULL;
+                setPendingGame(source_user->active_game->players[BOTTOM], NULL);
+                setPendingGame(source_user, NULL);
 
-                printf("Done instanciating a game : \n");
-                simpleGamePrinting(source_user->active_game);
+                logDebug("Done instanciating a game.");
+                logGameBoard(source_user->active_game);
 
                 MessageGameStart start_mes;
                 start_mes.first_snapshot = source_user->active_game->snapshot;
@@ -478,56 +829,56 @@ int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* user
             }
             else {
                 // warn initial user that his invite did not result in a game creation
-                printf("Warn invite creator %s that it was rejected.\n", source_user->pending_game->players[BOTTOM]->username);
-                sendMessageMatchResponse(source_user->pending_game->players[BOTTOM]->fd, false);
+                logInfo("Warn invite creator %s that it was rejected.", invite->players[BOTTOM]->username);
+                sendMessageMatchResponse(invite->players[BOTTOM]->fd, false);
 
                 // end pending game
-                cancel_invite(source_user->pending_game);
+                cancel_invite(invite);
             }
 
             break;
 
         case MATCH_CANCELLATION:
-            printf("MATCH_CANCELLATION\n");
+            logDebug("MATCH_CANCELLATION");
             // check that user is indeed created
             if (source_user == NULL) {
-                printf("error: Got a request from an unregistered user.\n");
+                logWarn("Got a request from an unregistered user.");
                 return -1;
             }
             
             // check it has indeed a pending game or an active game
-            if (source_user->pending_game == NULL && source_user->active_game == NULL) {
-                printf("error: user %d (%s) sent a cancellation but has no game invite pending or active game.\n", user_index, source_user->username);
+            if (pendingGame(source_user) == NULL && source_user->active_game == NULL) {
+                logWarn("user %d (%s) sent a cancellation but has no game invite pending or active game.", user_index, source_user->username);
                 return -1;
             }
-            if (source_user->pending_game != NULL && source_user->active_game != NULL) {
-                printf("error: user %d (%s) has both active and pending game.\n", user_index, source_user->username);
+            if (pendingGame(source_user) != NULL && source_user->active_game != NULL) {
+                logWarn("user %d (%s) has both active and pending game.", user_index, source_user->username);
                 return -1;
             }
 
             // apply cancellation
             if (source_user->active_game != NULL) {
-                printf("request from user %d (%s) to cancel active game.\n", user_index, source_user->username);
+                logInfo("request from user %d (%s) to cancel active game.", user_index, source_user->username);
                 // cancel active game
                 cancel_game(source_user->active_game);
             }
             else {
-                printf("request from user %d (%s) to cancel pending game invite.\n", user_index, source_user->username);
-                cancel_invite(source_user->pending_game);
+                logInfo("request from user %d (%s) to cancel pending game invite.", user_index, source_user->username);
+                cancel_invite(pendingGame(source_user));
             }
             break;
 
         case GAME_MOVE:
-            printf("GAME_MOVE\n");
+            logDebug("GAME_MOVE");
             // check that user is indeed created
             if (source_user == NULL) {
-                printf("error: Got a request from an unregistered user.\n");
+                logWarn("Got a request from an unregistered user.");
                 return -1;
             }
             
             // check it has indeed an active game
             if (source_user->active_game == NULL) {
-                printf("error: user %d (%s) played a move but has no active game.\n", user_index, source_user->username);
+                logWarn("user %d (%s) played a move but has no active game.", user_index, source_user->username);
                 return -1;
             }
 
@@ -535,72 +886,18 @@ int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* user
             memcpy(&move_message, message_ptr, sizeof(MessageGameMove));
             Game* game = source_user->active_game;
             
-            // check it was the right user that played the move
-            int success_code;
-            if ( game->snapshot.turn == BOTTOM && source_user == game->players[BOTTOM]) {
-                printf("BOTTOM user %d (%s) played the move %d.\n", user_index, source_user->username, move_message.selected_house);
-                success_code = playMove(game, BOTTOM, move_message.selected_house);
-            }
-            else if ( game->snapshot.turn == TOP && source_user == game->players[TOP]) {
-                printf("TOP user %d (%s) played the move %d.\n", user_index, source_user->username, move_message.selected_house);
-                success_code = playMove(game, TOP, move_message.selected_house);
-            }
-            else {
-                success_code = -5;
-            }
-            
-            if (success_code < 0) {
-                printf("Move is illegal, notifying sender (failure code %d).\n", success_code);
-                sendMessageGameIllegalMove(source_user->fd);
-            }
-            else if (success_code == 0) {
-                printf("Valid move played by user %d (%s), game updated.\n", user_index, source_user->username);
-                MessageGameUpdate update;
-                update.snapshot = game->snapshot;
-                sendMessageGameUpdate(game->players[BOTTOM]->fd, update);
-                sendMessageGameUpdate(game->players[TOP]->fd, update);
-
-                // update observers 
-                for (int i = 0; i < game->observers_count; ++i) {
-                    printf("Updating observer %s.\n",game->observers[i]->username);
-                    sendMessageGameUpdate(game->observers[i]->fd, update);
-                }
-                simpleGamePrinting(game);
-            }
-            else {
-                // game was won by current user (success code 1)
-                printf("User %d (%s) won the game !\n", user_index, source_user->username);
-                MessageGameEnd end_message;
-                end_message.winner = game->snapshot.turn;
-                end_message.final_snapshot = game->snapshot;
-                sendMessageGameEnd(game->players[BOTTOM]->fd, end_message);
-                sendMessageGameEnd(game->players[TOP]->fd, end_message);
-
-                // update observers 
-                for (int i = 0; i < game->observers_count; ++i) {
-                    sendMessageGameEnd(game->observers[i]->fd, end_message);
-                }
-
-                // remove active game from users
-                game->players[BOTTOM]->active_game = NULL;
-                game->players[TOP]->active_game = NULL;
-                game->players[BOTTOM]->pending_game= NULL;
-                game->players[TOP]->pending_game = NULL;
-
-                // remove observers 
-                // update observers 
-                for (int i = 0; i < game->observers_count; ++i) {
-                    game->observers[i]->observed_game = NULL;
-                }
-                free(game);
+            logDebug("user %d (%s) played the move %d.", user_index, source_user->username, move_message.selected_house);
+            if (play_game_move(game, source_user, move_message.selected_house) == 0) {
+                // the game goes on: a bot opponent answers right away
+                play_bot_turn(game);
             }
             break;
 
         case CHAT_MESSAGE:
-            printf("CHAT_MESSAGE\n");
+            logDebug("CHAT_MESSAGE");
             // check that user is indeed created
             if (source_user == NULL) {
-                printf("error: Got a request from an unregistered user.\n");
+                logWarn("Got a request from an unregistered user.");
                 return -1;
             }
             
@@ -610,7 +907,7 @@ int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* user
                 MessageChat chat_message;
                 memcpy(&chat_message, message_ptr, sizeof(MessageChat));
 
-                printf("user %s sent message \"%s\".\n", source_user->username, chat_message.message);
+                logDebug("user %s sent message \"%s\".", source_user->username, chat_message.message);
 
                 if (source_user->active_game != NULL) {
                     game = source_user->active_game;
@@ -619,61 +916,70 @@ int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* user
                     game = source_user->observed_game;
                 }
                 else {
-                    printf("error: no one to send message to.\n");
+                    logWarn("no one to send message to.");
                     return -1;
                 }
 
-                // redirect message to opponent
-                if (source_user != game->players[BOTTOM]) {
-                    sendMessageChat(game->players[BOTTOM]->fd, chat_message);
-                }
-                if (source_user != game->players[TOP]){
-                    sendMessageChat(game->players[TOP]->fd, chat_message);
-                }
-
-                //also send to observers
-                for (int i = 0; i < game->observers_count; ++i) {
-                    if (source_user != game->observers[i]) {
-                        sendMessageChat(game->observers[i]->fd, chat_message);
-                    }
-                }
+                // redirect message to everyone in the game but its sender
+                sendMessageChat(BROADCAST_FD, chat_message);
+                broadcastToGame(game, source_user);
             }
             else {
-                printf("error: user %d (%s) sent a message but is in no active game.\n", user_index, source_user->username);
+                logWarn("user %d (%s) sent a message but is in no active game.", user_index, source_user->username);
                 return -1;
             }
 
             break;
 
+        case GAME_SNAPSHOT_REQUEST:
+            logDebug("GAME_SNAPSHOT_REQUEST");
+            if (source_user == NULL) {
+                logWarn("Got a request from an unregistered user.");
+                return -1;
+            }
+            // a client replaying moves lost track of the game: send it the whole snapshot
+            game = (source_user->active_game != NULL) ? source_user->active_game : source_user->observed_game;
+            if (game == NULL) {
+                logWarn("user %d (%s) asked for a snapshot but is in no game.", user_index, source_user->username);
+                return -1;
+            }
+            MessageGameUpdate resync;
+            resync.snapshot = game->snapshot;
+            sendMessageGameUpdate(user_fd, resync);
+            break;
+
         case OBSERVE_GAME:
-            printf("OBSERVE_GAME\n");
+            logDebug("OBSERVE_GAME");
             // check that user is indeed created
             if (source_user == NULL) {
-                printf("error: Got a request from an unregistered user.\n");
+                logWarn("Got a request from an unregistered user.");
                 return -1;
             }
 
-            source_user->active_game = NULL;
-            source_user->pending_game = NULL;
+            // leaving a game or an invite to spectate cancels it for the other player too
+            if (source_user->active_game != NULL) cancel_game(source_user->active_game);
+            if (pendingGame(source_user) != NULL) cancel_invite(pendingGame(source_user));
 
             MessageObserve obs_mes;
             memcpy(&obs_mes, message_ptr, sizeof(obs_mes));
 
-            User* user_to_observe = NULL;
-            for (int i = 0; i < MAX_CLIENTS; ++i) {
-                if (users[i] != NULL && users[i]->id == obs_mes.player_to_observe_id) {
-                    user_to_observe = users[i];
-                }
-            }
+            User* user_to_observe = findUserById(obs_mes.player_to_observe_id);
 
-            if (user_to_observe == NULL) {
-                printf("error: cannot find user to observe.\n");
+            if (user_to_observe == NULL || user_to_observe->active_game == NULL) {
+                logWarn("cannot find game to observe.");
                 sendMessageMatchCancellation(source_user->fd);
                 return -1;
             }
 
-            add_observer(source_user, user_to_observe);
-            printf("added observer %s to game of %s.\n", source_user->username, user_to_observe->username);
+            // a spectator follows one game at a time
+            remove_observer(source_user);
+
+            if (!add_observer(source_user, user_to_observe->active_game)) {
+                logError("cannot allocate observer.");
+                sendMessageMatchCancellation(source_user->fd);
+                return -1;
+            }
+            logInfo("added observer %s to game of %s.", source_user->username, user_to_observe->username);
 
             // send first observed game info
             MessageObservationStart observation_start_message;
@@ -688,18 +994,19 @@ int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* user
             break;
 
         case STOP_OBSERVING:
-            printf("STOP_OBSERVING\n");
+            logDebug("STOP_OBSERVING");
             // check that user is indeed created
             if (source_user == NULL) {
-                printf("error: Got a request from an unregistered user.\n");
+                logWarn("Got a request from an unregistered user.");
                 return -1;
             }
 
             if (source_user->observed_game == NULL) {
-                printf("error: user was not spectating.\n");
+                logWarn("user was not spectating.");
+                return -1;
             }
             
-            printf("Ending observation from user %s.\n", source_user->username);
+            logInfo("Ending observation from user %s.", source_user->username);
             remove_observer(source_user);
         
             break;
@@ -10,17 +10,48 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
-#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
 #include <fcntl.h>
 
 #include "../common/communication.h"
+#include "connection.h"
+#include "user_directory.h"
+#include "lobby.h"
+#include "log.h"
+#include "bots.h"
+#include "workers.h"
+#include "archive.h"
+#include "../common/pool.h"
 
-#define BACKLOG 16
-#define BUF_SIZE 4096
+#define BACKLOG 1024
+#define MAX_EVENTS 256 // max number of ready sockets handled per epoll_wait
 
-int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, User* users[MAX_CLIENTS], struct pollfd *pfds, int user_fd, int user_index);
-void disconnectUser(int* user_index, int fd, User* users[MAX_CLIENTS], struct pollfd *pfds, int * nfds);
+#ifndef WORKER_THREADS
+#define WORKER_THREADS 0 // bot search threads, 0 for one per core but the one of the loop
+#endif
+
+#ifndef EDGE_TRIGGERED
+#define EDGE_TRIGGERED 0 // build with -D EDGE_TRIGGERED=1 to register client sockets with EPOLLET
+#endif
+
+int handleMessage(int32_t message_type, void* message_ptr, ssize_t r, Connection* source_conn);
+int readFromConnection(Connection* conn);
+void disconnectUser(Connection* conn);
+void watchOutput(Connection* conn, bool enable);
+void setActiveGame(User* user, Game* game);
 void cancel_game(Game* game);
+void end_game(Game* game);
+// tells the players and observers who won, then frees the game
+int play_game_move(Game* game, User* player, int selected_house);
+// plays the move of a player and tells everyone in the game
+// returns -1 if the move was refused (a human player is told), 0 if the game goes on, 1 if it ended and was freed
+void play_bot_turn(Game* game);
+// has the move of the bot whose turn it is (if any) searched by a worker, it is played when the search completes
+void start_bot_game(User* player, User* bot);
+// starts a game between player and a copy of a registered bot
 void cancel_invite(Game* game);
-void add_observer(User* observer, User* player_to_observe);
+void broadcastToGame(Game* game, User* except);
+// queues the messages sent to BROADCAST_FD to every player and observer of the game but except (may be NULL)
+bool add_observer(User* observer, Game* game);
 void remove_observer(User* observer);
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "user_directory.h"
+
+#define EMPTY_BUCKET -1
+#define MIN_BUCKET_COUNT 64 // must be a power of two
+
+// dense array of registered users, the hash tables store indexes into it
+static User** users = NULL;
+static int user_count = 0;
+static int users_capacity = 0;
+
+// both tables have bucket_count buckets, kept at most half full
+static int* id_buckets = NULL;
+static int* name_buckets = NULL;
+static size_t bucket_count = 0;
+
+
+static size_t hashId(int id) {
+    // multiplicative hashing spreads consecutive ids over the table
+    return (size_t)((uint32_t)id * 2654435761u);
+}
+
+static size_t hashName(const char* username) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < USERNAME_LENGTH && username[i] != '\0'; ++i) {
+        hash ^= (unsigned char)username[i];
+        hash *= 1099511628211ull;
+    }
+    return (size_t)hash;
+}
+
+static size_t idHomeBucket(int index) { return hashId(users[index]->id) & (bucket_count - 1); }
+static size_t nameHomeBucket(int index) { return hashName(users[index]->username) & (bucket_count - 1); }
+
+static void insertIndex(int* buckets, size_t home, int index) {
+    size_t b = home;
+    while (buckets[b] != EMPTY_BUCKET) b = (b + 1) & (bucket_count - 1);
+    buckets[b] = index;
+}
+
+static void removeBucket(int* buckets, size_t b, size_t (*homeBucket)(int)) {
+    // backward shift deletion: move up the following entries of the probe sequence so that no tombstone is needed
+    size_t mask = bucket_count - 1;
+    size_t hole = b;
+    size_t next = (hole + 1) & mask;
+    while (buckets[next] != EMPTY_BUCKET) {
+        size_t home = homeBucket(buckets[next]);
+        // the entry can fill the hole only if its home bucket is not between the hole and its position
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            buckets[hole] = buckets[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    buckets[hole] = EMPTY_BUCKET;
+}
+
+// both return the bucket holding the key, or the empty bucket ending its probe sequence
+static size_t findIdBucket(int id) {
+    size_t b = hashId(id) & (bucket_count - 1);
+    while (id_buckets[b] != EMPTY_BUCKET && users[id_buckets[b]]->id != id) {
+        b = (b + 1) & (bucket_count - 1);
+    }
+    return b;
+}
+
+static size_t findNameBucket(const char* username) {
+    size_t b = hashName(username) & (bucket_count - 1);
+    while (name_buckets[b] != EMPTY_BUCKET && strncmp(users[name_buckets[b]]->username, username, USERNAME_LENGTH) != 0) {
+        b = (b + 1) & (bucket_count - 1);
+    }
+    return b;
+}
+
+static bool rehash(size_t new_bucket_count) {
+    int* new_id_buckets = malloc(new_bucket_count * sizeof(int));
+    int* new_name_buckets = malloc(new_bucket_count * sizeof(int));
+    if (new_id_buckets == NULL || new_name_buckets == NULL) {
+        free(new_id_buckets);
+        free(new_name_buckets);
+        return false;
+    }
+    memset(new_id_buckets, 0xff, new_bucket_count * sizeof(int)); // every bucket to EMPTY_BUCKET
+    memset(new_name_buckets, 0xff, new_bucket_count * sizeof(int));
+
+    free(id_buckets);
+    free(name_buckets);
+    id_buckets = new_id_buckets;
+    name_buckets = new_name_buckets;
+    bucket_count = new_bucket_count;
+
+    for (int i = 0; i < user_count; ++i) {
+        insertIndex(id_buckets, idHomeBucket(i), i);
+        insertIndex(name_buckets, nameHomeBucket(i), i);
+    }
+    return true;
+}
+
+bool registerUser(User* user) {
+    if (bucket_count == 0 && !rehash(MIN_BUCKET_COUNT)) return false;
+    if (findUserByName(user->username) != NULL) return false;
+
+    if (user_count >= users_capacity) {
+        int new_capacity = users_capacity ? users_capacity * 2 : MIN_BUCKET_COUNT;
+        User** grown = realloc(users, new_capacity * sizeof(User*));
+        if (grown == NULL) return false;
+        users = grown;
+        users_capacity = new_capacity;
+    }
+    if ((size_t)(user_count + 1) * 2 > bucket_count && !rehash(bucket_count * 2)) return false;
+
+    int index = user_count++;
+    users[index] = user;
+    insertIndex(id_buckets, idHomeBucket(index), index);
+    insertIndex(name_buckets, nameHomeBucket(index), index);
+    return true;
+}
+
+void unregisterUser(User* user) {
+    if (bucket_count == 0) return;
+    size_t id_bucket = findIdBucket(user->id);
+    if (id_buckets[id_bucket] == EMPTY_BUCKET || users[id_buckets[id_bucket]] != user) return;
+    int index = id_buckets[id_bucket];
+
+    removeBucket(id_buckets, id_bucket, idHomeBucket);
+    removeBucket(name_buckets, findNameBucket(user->username), nameHomeBucket);
+
+    // keep the array dense: the last user takes the freed index
+    int last = --user_count;
+    if (index != last) {
+        size_t moved_id_bucket = findIdBucket(users[last]->id);
+        size_t moved_name_bucket = findNameBucket(users[last]->username);
+        users[index] = users[last];
+        id_buckets[moved_id_bucket] = index;
+        name_buckets[moved_name_bucket] = index;
+    }
+    users[last] = NULL;
+}
+
+User* findUserById(int id) {
+    if (bucket_count == 0) return NULL;
+    size_t b = findIdBucket(id);
+    return id_buckets[b] == EMPTY_BUCKET ? NULL : users[id_buckets[b]];
+}
+
+User* findUserByName(const char username[USERNAME_LENGTH]) {
+    if (bucket_count == 0) return NULL;
+    size_t b = findNameBucket(username);
+    return name_buckets[b] == EMPTY_BUCKET ? NULL : users[name_buckets[b]];
+}
+
+int userIndex(User* user) {
+    if (bucket_count == 0) return -1;
+    size_t b = findIdBucket(user->id);
+    if (id_buckets[b] == EMPTY_BUCKET || users[id_buckets[b]] != user) return -1;
+    return id_buckets[b];
+}
+
+int userCount() {
+    return user_count;
+}
+
+User* userAt(int index) {
+    return users[index];
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "../common/game.h"
+
+// Registry of the registered users, indexed by id and by username.
+// Every lookup is O(1): both indexes are open-addressing hash tables pointing into a dense array of users.
+
+
+bool registerUser(User* user);
+// adds the user to the directory
+// returns false if the username is already taken (or memory is exhausted), the user is then not registered
+
+void unregisterUser(User* user);
+// removes the user from the directory, does not free it
+
+User* findUserById(int id);
+// returns NULL if no registered user has this id
+
+User* findUserByName(const char username[USERNAME_LENGTH]);
+// returns NULL if no registered user has this username
+
+int userIndex(User* user);
+// returns the index of a registered user in the iteration order, -1 if it is not registered
+
+int userCount();
+User* userAt(int index);
+// iterate over every registered user (0 <= index < userCount()), the order changes when users leave
@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "workers.h"
+
+static pthread_t* threads = NULL;
+static int thread_count = 0;
+
+// jobs waiting for a worker, FIFO
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_ready = PTHREAD_COND_INITIALIZER;
+static Job* queue_head = NULL;
+static Job* queue_tail = NULL;
+static int stopping = 0;
+
+// finished jobs, pushed by the workers and taken all at once by the loop
+static _Atomic(Job*) completed = NULL;
+static int event_fd = -1;
+
+
+static void pushCompleted(Job* job) {
+    Job* head = atomic_load_explicit(&completed, memory_order_relaxed);
+    do {
+        job->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&completed, &head, job, memory_order_release, memory_order_relaxed));
+
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) < 0) {
+        // the counter is saturated: the loop has a wakeup pending anyway
+    }
+}
+
+static void* workerMain(void* arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        while (queue_head == NULL && !stopping) pthread_cond_wait(&queue_ready, &queue_lock);
+        Job* job = queue_head;
+        if (job == NULL) {
+            // stopping and nothing left to do
+            pthread_mutex_unlock(&queue_lock);
+            return NULL;
+        }
+        queue_head = job->next;
+        if (queue_head == NULL) queue_tail = NULL;
+        pthread_mutex_unlock(&queue_lock);
+
+        job->run(job);
+        pushCompleted(job);
+    }
+}
+
+int startWorkers(int count) {
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) return -1;
+
+    threads = malloc(sizeof(pthread_t) * count);
+    if (threads == NULL) {
+        close(event_fd);
+        event_fd = -1;
+        return -1;
+    }
+    for (thread_count = 0; thread_count < count; ++thread_count) {
+        if (pthread_create(&threads[thread_count], NULL, workerMain, NULL) != 0) break;
+    }
+    if (thread_count == 0) {
+        free(threads);
+        threads = NULL;
+        close(event_fd);
+        event_fd = -1;
+        return -1;
+    }
+    return event_fd;
+}
+
+void stopWorkers() {
+    if (thread_count == 0) return;
+    pthread_mutex_lock(&queue_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+
+    for (int i = 0; i < thread_count; ++i) pthread_join(threads[i], NULL);
+    free(threads);
+    threads = NULL;
+    thread_count = 0;
+    close(event_fd);
+    event_fd = -1;
+}
+
+void submitJob(Job* job) {
+    if (thread_count == 0) {
+        job->run(job);
+        job->complete(job);
+        return;
+    }
+
+    job->next = NULL;
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail != NULL) queue_tail->next = job;
+    else queue_head = job;
+    queue_tail = job;
+    pthread_cond_signal(&queue_ready);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+void runCompletedJobs() {
+    uint64_t count;
+    if (read(event_fd, &count, sizeof(count)) < 0) {
+        // nothing to reset, jobs may still have been pushed before the previous read
+    }
+
+    // the stack holds the jobs newest first: reverse it to complete them in the order they finished
+    Job* stack = atomic_exchange_explicit(&completed, NULL, memory_order_acquire);
+    Job* ordered = NULL;
+    while (stack != NULL) {
+        Job* next = stack->next;
+        stack->next = ordered;
+        ordered = stack;
+        stack = next;
+    }
+    while (ordered != NULL) {
+        Job* next = ordered->next;
+        ordered->complete(ordered);
+        ordered = next;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// Worker threads for the work that would stall the event loop (bot moves).
+// The loop submits jobs to a fixed pool of threads. A finished job is pushed on a lock-free completion stack and
+// the loop is woken up through an eventfd registered in its epoll set, it then calls the completion of every
+// finished job. Only the run function of a job executes on a worker thread: it must not touch any server state,
+// completions run on the loop thread and are the place to apply the results.
+
+
+typedef struct Job Job;
+typedef void (*JobFunction)(Job* job);
+
+struct Job {
+    JobFunction run;        // called on a worker thread
+    JobFunction complete;   // called on the loop thread once run returned, may free the job
+    Job* next;              // private
+};
+// embed a Job as the first member of a larger structure holding the inputs and results
+
+
+int startWorkers(int count);
+// starts count worker threads, returns the eventfd to watch for completions, or -1 on failure
+// without workers, submitJob runs jobs synchronously
+
+void stopWorkers();
+// lets the workers finish the queued jobs and joins them, the completions of these jobs are not called
+
+void submitJob(Job* job);
+// queues a job, the caller keeps ownership of its memory until its completion is called
+
+void runCompletedJobs();
+// calls the completion of every finished job, to be called when the eventfd is readable
@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../common/game.h"
+#include "../common/batch.h"
+#include "../common/mcts.h"
+
+// executable benchmark of the rules kernel:
+// counts the positions reachable in a given number of moves (perft) from the start position and from stored
+// positions, single-threaded then spread over threads, and reports the node counts and the nodes per second.
+// The counts only depend on the rules: a change of the sowing or capture code that alters them is a bug.
+//
+// A finished game is a leaf: it counts as one node whatever the remaining depth.
+//
+// It then plays random games in a batch of BATCH_BENCH_GAMES and reports the moves per second of playMoveBatch,
+// next to playSnapshotMove playing the same moves in an array of snapshots.
+//
+// Last, it runs searchMcts from the start position on 1, 2, 4... up to the given number of threads and reports
+// the playouts per second of each run and its speedup over one thread.
+
+#define DEFAULT_DEPTH 10
+#define SPLIT_DEPTH 3 // the parallel perft shares out the subtrees below this depth (at most 6^3 tasks)
+#define MAX_TASKS 216
+#define BATCH_BENCH_GAMES 4096
+#define BATCH_BENCH_ROUNDS 2000
+#define MCTS_BENCH_PLAYOUTS 200000
+
+typedef struct BenchPosition {
+    const char* name;
+    GameSnapshot snapshot;
+    uint64_t expected[DEFAULT_DEPTH + 1]; // perft counts from depth 0, 0 when unknown
+} BenchPosition;
+
+static const BenchPosition positions[] = {
+    { "start", { { { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 } }, BOTTOM, { 0, 0 }, 0 },
+        { 1, 6, 36, 190, 1014, 5219, 27332, 139157, 711414, 3592838, 18136217 } },
+    { "middle game", { { { 5, 0, 7, 1, 6, 2, 0, 3, 6, 1, 5, 4 } }, TOP, { 4, 4 }, 0 },
+        { 1, 5, 26, 130, 640, 3167, 15520, 75273, 364262, 1752966, 8419206 } },
+    { "big house", { { { 1, 0, 0, 23, 2, 1, 3, 0, 2, 1, 0, 1 } }, BOTTOM, { 6, 8 }, 0 },
+        { 1, 4, 18, 65, 317, 1211, 5752, 24268, 113591, 490488, 2240482 } },
+    { "endgame", { { { 0, 1, 0, 0, 2, 0, 9, 3, 1, 7, 2, 2 } }, TOP, { 11, 10 }, 0 },
+        { 1, 6, 14, 63, 210, 876, 3254, 12681, 50763, 188580, 768089 } },
+};
+
+#define POSITION_COUNT (int)(sizeof(positions) / sizeof(positions[0]))
+
+
+static uint64_t perft(GameSnapshot* snapshot, int depth) {
+    if (depth == 0) return 1;
+    int moves = generateLegalMoves(snapshot);
+    if (moves == 0) return 1;
+
+    int first_house = (snapshot->turn == TOP) ? 6 : 0;
+    uint64_t nodes = 0;
+    while (moves) {
+        int house = first_house + __builtin_ctz(moves);
+        moves &= moves - 1;
+
+        MoveUndo undo;
+        int result = makeMove(snapshot, house, &undo);
+        nodes += (result == 1) ? 1 : perft(snapshot, depth - 1);
+        unmakeMove(snapshot, &undo);
+    }
+    return nodes;
+}
+
+
+// parallel perft: the tree is expanded down to SPLIT_DEPTH, then idle threads take the next subtree
+// from a shared counter, so a thread that drew small subtrees keeps taking more
+
+typedef struct Task {
+    GameSnapshot snapshot;
+    int depth;              // remaining depth below this task
+    uint64_t nodes;
+} Task;
+
+static Task tasks[MAX_TASKS];
+static int task_count;
+static atomic_int next_task;
+static uint64_t split_leaves; // games that ended above SPLIT_DEPTH
+
+static void splitTasks(const GameSnapshot* snapshot, int depth, int split) {
+    if (split == 0 || depth == 0) {
+        tasks[task_count].snapshot = *snapshot;
+        tasks[task_count].depth = depth;
+        task_count++;
+        return;
+    }
+    int moves = generateLegalMoves(snapshot);
+    if (moves == 0) {
+        split_leaves++;
+        return;
+    }
+    int first_house = (snapshot->turn == TOP) ? 6 : 0;
+    while (moves) {
+        int house = first_house + __builtin_ctz(moves);
+        moves &= moves - 1;
+
+        GameSnapshot child;
+        if (applyMove(snapshot, house, &child) == 1) split_leaves++;
+        else splitTasks(&child, depth - 1, split - 1);
+    }
+}
+
+static void* perftWorker(void* arg) {
+    (void)arg;
+    int index;
+    while ((index = atomic_fetch_add(&next_task, 1)) < task_count) {
+        tasks[index].nodes = perft(&tasks[index].snapshot, tasks[index].depth);
+    }
+    return NULL;
+}
+
+static uint64_t parallelPerft(const GameSnapshot* snapshot, int depth, int thread_count) {
+    task_count = 0;
+    split_leaves = 0;
+    atomic_store(&next_task, 0);
+    splitTasks(snapshot, depth, SPLIT_DEPTH);
+
+    pthread_t threads[thread_count];
+    for (int i = 0; i < thread_count; ++i) pthread_create(&threads[i], NULL, perftWorker, NULL);
+    for (int i = 0; i < thread_count; ++i) pthread_join(threads[i], NULL);
+
+    uint64_t nodes = split_leaves;
+    for (int i = 0; i < task_count; ++i) nodes += tasks[i].nodes;
+    return nodes;
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+
+// batch playouts: every round plays a random legal move in each game, finished games restart from the start
+// position; only playMoveBatch and the playSnapshotMove loop are timed
+
+static bool benchBatch() {
+    static const GameSnapshot start = { { { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 } }, BOTTOM, { 0, 0 }, 0 };
+    static GameSnapshot snapshots[BATCH_BENCH_GAMES];
+    static uint8_t moves[BATCH_BENCH_GAMES], houses[BATCH_BENCH_GAMES];
+    static int8_t results[BATCH_BENCH_GAMES], scalar_results[BATCH_BENCH_GAMES];
+
+    GameBatch* batch = createGameBatch(BATCH_BENCH_GAMES);
+    if (batch == NULL) return false;
+    for (int game = 0; game < BATCH_BENCH_GAMES; ++game) snapshots[game] = start;
+
+    uint64_t random_state = 0x9e3779b97f4a7c15ull;
+    uint64_t played = 0;
+    double batch_time = 0, scalar_time = 0;
+    bool ok = true;
+    for (int round = 0; round < BATCH_BENCH_ROUNDS && ok; ++round) {
+        legalMovesBatch(batch, moves);
+        for (int game = 0; game < BATCH_BENCH_GAMES; ++game) {
+            int legal = moves[game];
+            random_state = random_state * 6364136223846793005ull + 1442695040888963407ull;
+            for (int skip = (random_state >> 33) % __builtin_popcount(legal); skip > 0; --skip) legal &= legal - 1;
+            houses[game] = ((snapshots[game].turn == TOP) ? 6 : 0) + __builtin_ctz(legal);
+        }
+
+        double begin = now();
+        playMoveBatch(batch, houses, results);
+        batch_time += now() - begin;
+
+        begin = now();
+        for (int game = 0; game < BATCH_BENCH_GAMES; ++game) {
+            scalar_results[game] = playSnapshotMove(&snapshots[game], snapshots[game].turn, houses[game]);
+        }
+        scalar_time += now() - begin;
+        played += BATCH_BENCH_GAMES;
+
+        for (int game = 0; game < BATCH_BENCH_GAMES; ++game) {
+            if (results[game] != scalar_results[game]) ok = false;
+            if (BATCH_ROW(batch, BATCH_OVER_ROW)[game]) {
+                snapshots[game] = start;
+                setBatchGame(batch, game, &start);
+            }
+        }
+    }
+    freeGameBatch(batch);
+
+    printf("batch        %12llu moves  %8.1f Mmps  %8.1f Mmps playSnapshotMove  %s\n", (unsigned long long)played,
+        played / batch_time / 1e6, played / scalar_time / 1e6, ok ? "ok" : "MISMATCH");
+    return ok;
+}
+
+
+
+// MCTS thread sweep: the same number of playouts on more and more threads growing one tree
+
+static bool benchMcts(int max_threads) {
+    static const GameSnapshot start = { { { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 } }, BOTTOM, { 0, 0 }, 0 };
+    MctsTree* tree = createMctsTree(MCTS_TREE_CAPACITY(MCTS_BENCH_PLAYOUTS));
+    if (tree == NULL) return false;
+
+    double single = 0;
+    for (int threads = 1; ; threads = (threads * 2 < max_threads) ? threads * 2 : max_threads) {
+        MctsLimits limits = { MCTS_BENCH_PLAYOUTS, 0, threads, 1 };
+        double begin = now();
+        MctsResult result = searchMcts(&start, &limits, tree);
+        double rate = result.playouts / (now() - begin);
+        if (threads == 1) single = rate;
+        printf("mcts %2d threads %9llu playouts  %8.1f kplayouts/s  x%.2f\n", threads,
+            (unsigned long long)result.playouts, rate / 1e3, rate / single);
+        if (threads == max_threads) break;
+    }
+    freeMctsTree(tree);
+    return true;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc > 3) {
+        printf("Usage: COMMAND [depth] [threads]\n");
+        exit(-1);
+    }
+    int depth = (argc > 1) ? atoi(argv[1]) : DEFAULT_DEPTH;
+    int thread_count = (argc > 2) ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (depth < 0) depth = 0;
+    if (thread_count < 1) thread_count = 1;
+
+    int failures = 0;
+    uint64_t total_nodes[2] = { 0, 0 };
+    double total_time[2] = { 0, 0 };
+
+    printf("perft %d, %d threads\n", depth, thread_count);
+    for (int p = 0; p < POSITION_COUNT; ++p) {
+        GameSnapshot snapshot = positions[p].snapshot;
+
+        double start = now();
+        uint64_t nodes = perft(&snapshot, depth);
+        double single = now() - start;
+
+        start = now();
+        uint64_t parallel_nodes = parallelPerft(&positions[p].snapshot, depth, thread_count);
+        double parallel = now() - start;
+
+        uint64_t expected = (depth <= DEFAULT_DEPTH) ? positions[p].expected[depth] : 0;
+        bool ok = nodes == parallel_nodes && (expected == 0 || nodes == expected);
+        if (!ok) failures++;
+
+        printf("%-12s %12llu nodes  %8.1f Mnps  %8.1f Mnps parallel  %s\n", positions[p].name, (unsigned long long)nodes,
+            nodes / single / 1e6, nodes / parallel / 1e6, ok ? "ok" : "MISMATCH");
+        total_nodes[0] += nodes;
+        total_nodes[1] += parallel_nodes;
+        total_time[0] += single;
+        total_time[1] += parallel;
+    }
+    printf("total        %12llu nodes  %8.1f Mnps  %8.1f Mnps parallel\n", (unsigned long long)total_nodes[0],
+        total_nodes[0] / total_time[0] / 1e6, total_nodes[1] / total_time[1] / 1e6);
+
+    if (!benchBatch()) failures++;
+    if (!benchMcts(thread_count)) failures++;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,82 @@
+#include "reference_game.h"
+
+
+static Side ownership(int house) {
+    return (house < 6) ? BOTTOM : TOP;
+}
+
+int referencePlayMove(GameSnapshot* snapshot, Side turn, int selected_house) {
+
+    // check inputs
+    if (turn != TOP && turn != BOTTOM) {
+        return -1;
+    }
+    if (selected_house < 0 || selected_house > 11) {
+        return -1;
+    }
+    if (turn == TOP && selected_house < 6) {
+        return -2;
+    }
+    if (turn == BOTTOM && selected_house > 5) {
+        return -3;
+    }
+    if (snapshot->board.seeds[selected_house] == 0) {
+        return -4;
+    }
+
+    // dispatch the seeds one by one, skipping the house played
+    int seeds_to_dispatch = snapshot->board.seeds[selected_house];
+    int house_to_fill = selected_house;
+    while (seeds_to_dispatch > 0) {
+        house_to_fill = (house_to_fill + 1) % 12;
+        if (house_to_fill == selected_house) continue;
+        ++(snapshot->board.seeds[house_to_fill]);
+        --seeds_to_dispatch;
+    }
+    snapshot->board.seeds[selected_house] = 0;
+
+    // capture backwards from the last house sown while the opponent's houses hold 2 or 3 seeds
+    int house_to_check = house_to_fill;
+    while (ownership(house_to_check) != turn
+        && (snapshot->board.seeds[house_to_check] == 2 || snapshot->board.seeds[house_to_check] == 3)) {
+        snapshot->points[turn] += snapshot->board.seeds[house_to_check];
+        snapshot->board.seeds[house_to_check] = 0;
+        house_to_check = (house_to_check + 11) % 12;
+    }
+
+    // game ends whenever a player reaches 12 points
+    if (snapshot->points[turn] >= 12) {
+        return 1;
+    }
+    snapshot->turn = !(snapshot->turn);
+    return 0;
+}
+
+int referenceLegalMoves(const GameSnapshot* snapshot) {
+    int moves = 0;
+    for (int house = 0; house < 12; ++house) {
+        if (ownership(house) == snapshot->turn && snapshot->board.seeds[house] > 0) {
+            moves |= 1 << (house % 6);
+        }
+    }
+    return moves;
+}
+
+bool referenceIsTerminal(const GameSnapshot* snapshot) {
+    if (snapshot->points[BOTTOM] >= 12 || snapshot->points[TOP] >= 12) return true;
+    return referenceLegalMoves(snapshot) == 0;
+}
+
+Side referenceWinner(const GameSnapshot* snapshot) {
+    if (snapshot->points[BOTTOM] >= 12) return BOTTOM;
+    if (snapshot->points[TOP] >= 12) return TOP;
+
+    // the side to play cannot move: each player adds the seeds left on its side
+    int totals[2] = { snapshot->points[BOTTOM], snapshot->points[TOP] };
+    for (int house = 0; house < 12; ++house) {
+        totals[ownership(house)] += snapshot->board.seeds[house];
+    }
+    if (totals[BOTTOM] > totals[TOP]) return BOTTOM;
+    if (totals[TOP] > totals[BOTTOM]) return TOP;
+    return NO_SIDE;
+}
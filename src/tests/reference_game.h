@@ -0,0 +1,21 @@
+#pragma once
+
+#include "../common/game.h"
+
+// Reference implementation of the rules, written as plainly as possible and never optimized:
+// seeds are sown one by one and every rule is a loop over the houses, as game.c did before its sowing
+// and move generation were rewritten. test_reference plays random games through both, a difference is a bug of game.c.
+// Only change this file when the rules themselves change.
+
+
+int referencePlayMove(GameSnapshot* snapshot, Side turn, int selected_house);
+// same as playSnapshotMove, with the same return values
+
+int referenceLegalMoves(const GameSnapshot* snapshot);
+// same as generateLegalMoves: bit i is set if house i of the side to play holds seeds
+
+bool referenceIsTerminal(const GameSnapshot* snapshot);
+// same as isTerminal
+
+Side referenceWinner(const GameSnapshot* snapshot);
+// same as whoHasWon
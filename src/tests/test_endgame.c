@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/engine.h"
+#include "../common/game_record.h"
+
+// executable to check the engine against an endgame database written by build_endgame:
+// plays random games set up with the seeds of the database (total_seeds / 12 in each house, as selfplay -b),
+// and at every position the database covers checks that
+// - searchBestMove takes its move from the database (result.from_endgame) instead of searching,
+// - that move keeps the exact result of the position (its score is the value read for the position),
+// - for a win or a loss in at most CHECK_PLIES plies, a plain search of that depth without the database finds
+//   the same score, which checks the database itself.
+// Returns 1 if a check fails or if no position was covered.
+
+#define DEFAULT_PATH "endgame.db"
+#define DEFAULT_GAMES 200
+#define DEFAULT_SEED 1
+#define CHECK_PLIES 8
+#define MAX_GAME_PLIES 400
+
+
+static uint64_t random_state;
+
+static uint64_t nextRandom() {
+    // splitmix64
+    uint64_t z = (random_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static int randomMove(const GameSnapshot* snapshot) {
+    int moves = generateLegalMoves(snapshot);
+    for (int skip = nextRandom() % __builtin_popcount(moves); skip > 0; --skip) moves &= moves - 1;
+    return ((snapshot->turn == TOP) ? 6 : 0) + __builtin_ctz(moves);
+}
+
+static int exactScore(const EndgameResult* exact) {
+    // score searchBestMove gives to a root of this result, see endgameScore in engine.c
+    if (exact->outcome == 0) return 0;
+    int score = ENGINE_WIN_SCORE - exact->plies;
+    return (exact->outcome > 0) ? score : -score;
+}
+
+static void printFailure(const char* check, const GameSnapshot* snapshot, int expected, int found) {
+    printf("%s: expected %d, found %d\n", check, expected, found);
+    simpleSnapshotPrinting((GameSnapshot*)snapshot);
+}
+
+
+int main(int argc, char **argv) {
+    const char* path = (argc > 1) ? argv[1] : DEFAULT_PATH;
+    int games = (argc > 2) ? atoi(argv[2]) : DEFAULT_GAMES;
+    random_state = (argc > 3) ? strtoull(argv[3], NULL, 10) : DEFAULT_SEED;
+
+    EndgameDatabase* database = openEndgameDatabase(path);
+    if (database == NULL) {
+        printf("Cannot read the endgame database %s, build it with build_endgame\n", path);
+        return 1;
+    }
+    if (database->total_seeds % 12 != 0 || database->total_seeds > 12 * GAME_RECORD_SEEDS_PER_HOUSE) {
+        printf("%s is built for games of %d seeds, not a number of seeds per house\n", path, database->total_seeds);
+        return 1;
+    }
+    int seeds_per_house = database->total_seeds / 12;
+    printf("test_endgame: %s, %d seeds on the board at most, %d seeds per house, %d games\n", path,
+        database->max_seeds, seeds_per_house, games);
+
+    EngineLimits limits = { 0, 0, 0 };
+    uint64_t positions = 0, endgame_moves = 0, searched = 0, failures = 0;
+
+    for (int g = 0; g < games; ++g) {
+        GameSnapshot snapshot;
+        initialGameRecordSnapshot(seeds_per_house, &snapshot);
+
+        for (int ply = 0; ply < MAX_GAME_PLIES && !isTerminal(&snapshot); ++ply) {
+            EndgameResult exact;
+            if (probeEndgame(database, &snapshot, &exact)) {
+                positions++;
+                int expected = exactScore(&exact);
+
+                setEndgameDatabase(database);
+                limits.max_depth = 1;
+                EngineResult result = searchBestMove(&snapshot, &limits, NULL);
+                endgame_moves += result.from_endgame;
+                if (!result.from_endgame) {
+                    printFailure("move searched instead of read from the database", &snapshot, 1, 0);
+                    failures++;
+                }
+                else if (result.score != expected) {
+                    printFailure("score of the move read from the database", &snapshot, expected, result.score);
+                    failures++;
+                }
+
+                if (exact.outcome != 0 && exact.plies <= CHECK_PLIES) {
+                    setEndgameDatabase(NULL);
+                    limits.max_depth = exact.plies;
+                    result = searchBestMove(&snapshot, &limits, NULL);
+                    searched++;
+                    if (result.score != expected) {
+                        printFailure("score of a search without the database", &snapshot, expected, result.score);
+                        failures++;
+                    }
+                }
+            }
+            playSnapshotMove(&snapshot, snapshot.turn, randomMove(&snapshot));
+        }
+    }
+
+    setEndgameDatabase(NULL);
+    closeEndgameDatabase(database);
+    printf("%llu positions covered, %llu moves read from the database, %llu checked by a search, %llu failures\n",
+        (unsigned long long)positions, (unsigned long long)endgame_moves, (unsigned long long)searched,
+        (unsigned long long)failures);
+    return (failures > 0 || endgame_moves == 0) ? 1 : 0;
+}
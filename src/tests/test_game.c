@@ -21,5 +21,20 @@ int main() {
     printf("valid move ? %d\n", valid_move);
     simpleGamePrinting(game);
 
+    printf("incremental hash matches ? %d\n", game->hash == snapshotHash(&game->snapshot));
+    printf("legal moves mask: 0x%02x, terminal ? %d\n", generateLegalMoves(&game->snapshot), isTerminal(&game->snapshot));
+
+    // explore a move without touching the game
+    GameSnapshot child;
+    valid_move = applyMove(&game->snapshot, 7, &child);
+    printf("applyMove 7 ? %d\n", valid_move);
+    simpleSnapshotPrinting(&child);
+
+    MoveUndo undo;
+    GameSnapshot before = game->snapshot;
+    makeMove(&game->snapshot, 7, &undo);
+    unmakeMove(&game->snapshot, &undo);
+    printf("unmakeMove restored the snapshot ? %d\n", memcmp(&before, &game->snapshot, sizeof(GameSnapshot)) == 0);
+
     return 0;
 }
\ No newline at end of file
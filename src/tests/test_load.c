@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../common/game.h"
+#include "../common/communication.h"
+#include "../server/bots.h"
+
+// executable test for when the server is running:
+// registers many idle users, checks that the server still answers, and reports its memory usage per connection
+
+#define CONNECTIONS_PER_SOURCE_ADDRESS 25000 // stay below the number of ephemeral ports of one source address
+
+
+long server_rss_kb(int server_pid) {
+    // returns -1 if the memory usage of the server cannot be read
+    if (server_pid <= 0) return -1;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", server_pid);
+    FILE* status = fopen(path, "r");
+    if (status == NULL) return -1;
+
+    char line[256];
+    long rss = -1;
+    while (fgets(line, sizeof(line), status) != NULL) {
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            rss = atol(line + 6);
+            break;
+        }
+    }
+    fclose(status);
+    return rss;
+}
+
+int open_user(const char* server_ip, int32_t port, int index) {
+    // returns the socket of a newly registered user, or -1
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    // on loopback, spread the connections over several source addresses to get enough ports
+    if (strncmp(server_ip, "127.", 4) == 0) {
+        struct sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(0x7f000001 + 1 + index / CONNECTIONS_PER_SOURCE_ADDRESS);
+        local.sin_port = 0;
+        bind(sock, (struct sockaddr *)&local, sizeof(local));
+    }
+
+    struct sockaddr_in srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.sin_family = AF_INET;
+    srv.sin_port = htons((unsigned short)port);
+    inet_pton(AF_INET, server_ip, &srv.sin_addr);
+    if (connect(sock, (struct sockaddr *)&srv, sizeof(srv)) < 0) {
+        close(sock);
+        return -1;
+    }
+
+    MessageUserCreation user_creation_msg;
+    memset(&user_creation_msg, 0, sizeof(user_creation_msg));
+    snprintf(user_creation_msg.username, USERNAME_LENGTH, "load%d", index);
+    sendMessageUserCreation(sock, user_creation_msg);
+
+    int32_t reply[2];
+    if (recv(sock, reply, sizeof(reply), MSG_WAITALL) != sizeof(reply) || reply[0] != USER_REGISTRATION || reply[1] < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+
+int main(int argc, char **argv) {
+
+    if (argc != 4 && argc != 5) {
+        printf("Usage: COMMAND <server-ip> <port> <connections> [server-pid]\n");
+        exit(-1);
+    }
+    const char *server_ip = argv[1];
+    int32_t port = atoi(argv[2]);
+    int connections = atoi(argv[3]);
+    int server_pid = (argc == 5) ? atoi(argv[4]) : -1;
+
+    struct rlimit fd_limit;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) == 0) {
+        fd_limit.rlim_cur = fd_limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &fd_limit);
+        if (fd_limit.rlim_cur < (rlim_t)connections + 16) {
+            printf("warning: only %ld file descriptors available.\n", (long) fd_limit.rlim_cur);
+        }
+    }
+
+    int* socks = malloc(sizeof(int) * connections);
+    long rss_before = server_rss_kb(server_pid);
+
+    int opened = 0;
+    for (int i = 0; i < connections; ++i) {
+        socks[opened] = open_user(server_ip, port, i);
+        if (socks[opened] < 0) {
+            printf("error: connection %d failed (%s).\n", i, strerror(errno));
+            break;
+        }
+        ++opened;
+        if (opened % 10000 == 0) printf("%d users registered.\n", opened);
+    }
+    printf("%d idle users registered.\n", opened);
+
+    // the server must still answer, with a list holding every other user and the server bots
+    if (opened > 0) {
+        sendMessageGetUserList(socks[0]);
+        int32_t header[3];
+        recv(socks[0], header, sizeof(header), MSG_WAITALL);
+        char* entries = malloc(header[2] > 0 ? header[2] : 1);
+        recv(socks[0], entries, header[2], MSG_WAITALL);
+        printf("User list: %d users in %d bytes (%s).\n", header[1], header[2], (header[1] == opened - 1 + BOT_COUNT) ? "ok" : "MISMATCH");
+        free(entries);
+    }
+
+    long rss_after = server_rss_kb(server_pid);
+    if (rss_before >= 0 && rss_after >= 0 && opened > 0) {
+        printf("Server memory: %ld kB -> %ld kB, %ld bytes per idle connection.\n",
+            rss_before, rss_after, (rss_after - rss_before) * 1024 / opened);
+    }
+
+    for (int i = 0; i < opened; ++i) close(socks[i]);
+    free(socks);
+    return (opened == connections) ? 0 : 1;
+}
@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/game.h"
+#include "../common/batch.h"
+#include "reference_game.h"
+
+// executable to check game.c against the reference rules of reference_game.c:
+// plays random games, from the initial board or from random boards, through both implementations in lockstep.
+// At every position each of the 24 (side, house) pairs is played both ways, and the return codes, snapshots,
+// legal move masks, end of game, winner, hashes and makeMove / unmakeMove round trips are compared.
+// The same games are then played in batches with playMoveBatch, one game per lane, and compared move by move.
+// A failing game is shrunk to the shortest move list that still fails before being printed.
+//
+// Game i is generated from the seed (seed + i): "test_reference 1 <seed>" replays a reported game.
+
+#define DEFAULT_GAMES 20000
+#define MAX_MOVES 400 // a game without captures can go on forever
+#define BATCH_GAMES 1000 // games played at once by the batch check, not a multiple of BATCH_LANES on purpose
+
+
+typedef struct Scenario {
+    GameSnapshot start;
+    int length;
+    uint8_t moves[MAX_MOVES]; // houses played in turn, a move rejected by both implementations is skipped
+} Scenario;
+
+typedef int (*ScenarioCheck)(const Scenario* scenario, bool verbose);
+
+static uint64_t random_state;
+static uint64_t checked_positions = 0;
+
+static uint64_t nextRandom() {
+    // splitmix64
+    uint64_t z = (random_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static void randomStart(GameSnapshot* snapshot) {
+    memset(snapshot, 0, sizeof(GameSnapshot));
+    if (nextRandom() % 2) {
+        memset(snapshot->board.seeds, 4, sizeof(snapshot->board.seeds));
+        return;
+    }
+    // any board: the seeds not won yet are dropped in random houses, often piled in a few of them
+    snapshot->turn = nextRandom() % 2;
+    snapshot->points[BOTTOM] = nextRandom() % 12;
+    snapshot->points[TOP] = nextRandom() % 12;
+    int spread = 1 + nextRandom() % 12;
+    for (int seeds = 48 - snapshot->points[BOTTOM] - snapshot->points[TOP]; seeds > 0; --seeds) {
+        snapshot->board.seeds[nextRandom() % spread]++;
+    }
+    // rotate so that the piles are not always on the bottom side
+    Board board = snapshot->board;
+    int shift = nextRandom() % 12;
+    for (int i = 0; i < 12; ++i) snapshot->board.seeds[(i + shift) % 12] = board.seeds[i];
+}
+
+static void randomScenario(Scenario* scenario) {
+    randomStart(&scenario->start);
+    scenario->length = 0;
+    GameSnapshot snapshot = scenario->start;
+    while (scenario->length < MAX_MOVES && !referenceIsTerminal(&snapshot)) {
+        int moves = referenceLegalMoves(&snapshot);
+        int house;
+        do {
+            house = nextRandom() % 6;
+        } while (!(moves >> house & 1));
+        house += (snapshot.turn == TOP) ? 6 : 0;
+        // now and then any house, often one that cannot be played
+        if (nextRandom() % 16 == 0) house = nextRandom() % 14;
+        referencePlayMove(&snapshot, snapshot.turn, house);
+        scenario->moves[scenario->length++] = house;
+    }
+}
+
+
+static void printSnapshot(const char* name, const GameSnapshot* snapshot) {
+    printf("  %s: turn %d, points %d %d, seeds", name, snapshot->turn, snapshot->points[BOTTOM], snapshot->points[TOP]);
+    for (int i = 0; i < 12; ++i) printf(" %d", snapshot->board.seeds[i]);
+    printf("\n");
+}
+
+static bool checkPosition(const GameSnapshot* snapshot, bool verbose) {
+    // compares every query and every move of game.c on snapshot with the reference, returns false on a difference
+    checked_positions++;
+    bool same = true;
+
+    for (int turn = BOTTOM; turn <= TOP; ++turn) {
+        for (int house = -1; house <= 12; ++house) {
+            GameSnapshot expected = *snapshot, actual = *snapshot;
+            int expected_result = referencePlayMove(&expected, turn, house);
+            int actual_result = playSnapshotMove(&actual, turn, house);
+            if (expected_result != actual_result || memcmp(&expected, &actual, sizeof(GameSnapshot)) != 0) {
+                if (verbose) {
+                    printf("side %d house %d: reference returns %d, game.c returns %d\n", turn, house, expected_result, actual_result);
+                    printSnapshot("reference", &expected);
+                    printSnapshot("game.c   ", &actual);
+                }
+                same = false;
+            }
+        }
+    }
+
+    int expected_moves = referenceLegalMoves(snapshot);
+    if (generateLegalMoves(snapshot) != expected_moves) {
+        if (verbose) printf("legal moves: reference 0x%02x, game.c 0x%02x\n", expected_moves, generateLegalMoves(snapshot));
+        same = false;
+    }
+    bool expected_end = referenceIsTerminal(snapshot);
+    if (isTerminal(snapshot) != expected_end || isGameOver(*snapshot) != expected_end) {
+        if (verbose) printf("end of game: reference %d, game.c %d\n", expected_end, isTerminal(snapshot));
+        same = false;
+    }
+    if (expected_end && whoHasWon(*snapshot) != referenceWinner(snapshot)) {
+        if (verbose) printf("winner: reference %d, game.c %d\n", referenceWinner(snapshot), whoHasWon(*snapshot));
+        same = false;
+    }
+
+    // the move API used by the engine, for the side to play
+    int first_house = (snapshot->turn == TOP) ? 6 : 0;
+    for (int house = first_house; house < first_house + 6; ++house) {
+        GameSnapshot expected = *snapshot;
+        int expected_result = referencePlayMove(&expected, snapshot->turn, house);
+
+        GameSnapshot applied;
+        int applied_result = applyMove(snapshot, house, &applied);
+        if (expected_result < 0) expected = *snapshot;
+        if (applied_result != expected_result || memcmp(&expected, &applied, sizeof(GameSnapshot)) != 0) {
+            if (verbose) printf("applyMove %d: reference returns %d, game.c returns %d\n", house, expected_result, applied_result);
+            same = false;
+        }
+        if (expected_result < 0) continue;
+
+        GameSnapshot made = *snapshot;
+        MoveUndo undo;
+        makeMove(&made, house, &undo);
+        if (undo.hash_delta != (snapshotHash(snapshot) ^ snapshotHash(&made))) {
+            if (verbose) printf("makeMove %d: wrong hash delta\n", house);
+            same = false;
+        }
+        unmakeMove(&made, &undo);
+        if (memcmp(&made, snapshot, sizeof(GameSnapshot)) != 0) {
+            if (verbose) {
+                printf("unmakeMove %d does not restore the snapshot\n", house);
+                printSnapshot("restored", &made);
+            }
+            same = false;
+        }
+    }
+    return same;
+}
+
+static void printScenario(const Scenario* scenario) {
+    printSnapshot("start", &scenario->start);
+    printf("  moves:");
+    for (int m = 0; m < scenario->length; ++m) printf(" %d", scenario->moves[m]);
+    printf("\n");
+}
+
+static int checkScenario(const Scenario* scenario, bool verbose) {
+    // replays the scenario through a Game and through the reference
+    // returns the number of moves needed to reach the first difference, -1 if there is none
+    Game game;
+    memset(&game, 0, sizeof(Game));
+    game.snapshot = scenario->start;
+    game.hash = snapshotHash(&game.snapshot);
+    GameSnapshot expected = scenario->start;
+
+    int difference = -1;
+    for (int i = 0; ; ++i) {
+        if (!checkPosition(&expected, verbose)) {
+            difference = i;
+            break;
+        }
+        if (i == scenario->length) break;
+
+        int expected_result = referencePlayMove(&expected, expected.turn, scenario->moves[i]);
+        int actual_result = playMove(&game, game.snapshot.turn, scenario->moves[i]);
+        if (expected_result != actual_result || memcmp(&expected, &game.snapshot, sizeof(GameSnapshot)) != 0
+            || game.hash != snapshotHash(&game.snapshot)
+            || (actual_result >= 0 && game.moves[game.recorded_moves - 1] != scenario->moves[i])) {
+            if (verbose) printf("playMove %d: reference returns %d, game.c returns %d\n", scenario->moves[i], expected_result, actual_result);
+            difference = i + 1;
+            break;
+        }
+        if (expected_result == 1) break;
+    }
+    free(game.moves);
+    return difference;
+}
+
+static bool checkBatchMove(GameBatch* batch, int game, GameSnapshot* expected, uint8_t house, uint8_t legal_moves, int result, bool verbose) {
+    // compares one game of a batch before and after a move with the reference, and plays the move on expected
+    bool over = referenceIsTerminal(expected);
+    int expected_moves = over ? 0 : referenceLegalMoves(expected);
+    if (legal_moves != expected_moves) {
+        if (verbose) printf("legalMovesBatch: reference 0x%02x, batch 0x%02x\n", expected_moves, legal_moves);
+        return false;
+    }
+
+    int expected_result = over ? BATCH_GAME_OVER : referencePlayMove(expected, expected->turn, house);
+    GameSnapshot actual;
+    getBatchGame(batch, game, &actual);
+    if (result != expected_result || memcmp(expected, &actual, sizeof(GameSnapshot)) != 0
+        || BATCH_ROW(batch, BATCH_OVER_ROW)[game] != referenceIsTerminal(expected)) {
+        if (verbose) {
+            printf("playMoveBatch %d: reference returns %d, batch returns %d, end of game %d\n",
+                house, expected_result, result, BATCH_ROW(batch, BATCH_OVER_ROW)[game]);
+            printSnapshot("reference", expected);
+            printSnapshot("batch    ", &actual);
+        }
+        return false;
+    }
+    return true;
+}
+
+static int checkBatchScenario(const Scenario* scenario, bool verbose) {
+    // replays the scenario alone in a batch, returns the same values as checkScenario
+    static GameBatch* batch = NULL;
+    if (batch == NULL) batch = createGameBatch(1);
+    setBatchGame(batch, 0, &scenario->start);
+    GameSnapshot expected = scenario->start;
+
+    for (int i = 0; i < scenario->length; ++i) {
+        uint8_t legal_moves;
+        int8_t result;
+        legalMovesBatch(batch, &legal_moves);
+        playMoveBatch(batch, &scenario->moves[i], &result);
+        if (!checkBatchMove(batch, 0, &expected, scenario->moves[i], legal_moves, result, verbose)) return i + 1;
+    }
+    return -1;
+}
+
+static int checkBatchGames(const Scenario* scenarios, int count) {
+    // plays the scenarios side by side in one batch, returns the first game that differs or -1
+    static GameSnapshot expected[BATCH_GAMES];
+    static uint8_t houses[BATCH_GAMES], legal_moves[BATCH_GAMES];
+    static int8_t results[BATCH_GAMES];
+
+    GameBatch* batch = createGameBatch(count);
+    int rounds = 0;
+    for (int game = 0; game < count; ++game) {
+        setBatchGame(batch, game, &scenarios[game].start);
+        expected[game] = scenarios[game].start;
+        if (scenarios[game].length > rounds) rounds = scenarios[game].length;
+    }
+
+    int failure = -1;
+    for (int round = 0; round < rounds && failure < 0; ++round) {
+        // a scenario that is over plays an invalid house
+        for (int game = 0; game < count; ++game) {
+            houses[game] = (round < scenarios[game].length) ? scenarios[game].moves[round] : 12;
+        }
+        legalMovesBatch(batch, legal_moves);
+        playMoveBatch(batch, houses, results);
+        for (int game = 0; game < count && failure < 0; ++game) {
+            checked_positions++;
+            if (!checkBatchMove(batch, game, &expected[game], houses[game], legal_moves[game], results[game], false)) failure = game;
+        }
+    }
+    freeGameBatch(batch);
+    return failure;
+}
+
+static void shrinkScenario(Scenario* scenario, ScenarioCheck check) {
+    // drops the moves after the difference, then every move that is not needed to reproduce it
+    scenario->length = check(scenario, false);
+    bool shrunk = true;
+    while (shrunk) {
+        shrunk = false;
+        for (int i = 0; i < scenario->length; ++i) {
+            Scenario candidate = *scenario;
+            memmove(&candidate.moves[i], &candidate.moves[i + 1], candidate.length - i - 1);
+            candidate.length--;
+            int failure = check(&candidate, false);
+            if (failure >= 0) {
+                *scenario = candidate;
+                scenario->length = failure;
+                shrunk = true;
+                --i;
+            }
+        }
+    }
+}
+
+
+int main(int argc, char **argv) {
+    if (argc > 3) {
+        printf("Usage: COMMAND [games] [seed]\n");
+        exit(-1);
+    }
+    long games = (argc > 1) ? atol(argv[1]) : DEFAULT_GAMES;
+    uint64_t seed = (argc > 2) ? strtoull(argv[2], NULL, 10) : (uint64_t)time(NULL);
+    printf("%ld games from seed %llu\n", games, (unsigned long long)seed);
+
+    Scenario scenario;
+    for (long i = 0; i < games; ++i) {
+        random_state = seed + i;
+        randomScenario(&scenario);
+        if (checkScenario(&scenario, false) < 0) continue;
+
+        printf("game from seed %llu differs, shrinking %d moves\n", (unsigned long long)(seed + i), scenario.length);
+        shrinkScenario(&scenario, checkScenario);
+        printScenario(&scenario);
+        checkScenario(&scenario, true);
+        return 1;
+    }
+
+    static Scenario scenarios[BATCH_GAMES];
+    for (long first = 0; first < games; first += BATCH_GAMES) {
+        int count = (games - first < BATCH_GAMES) ? games - first : BATCH_GAMES;
+        for (int game = 0; game < count; ++game) {
+            random_state = seed + first + game;
+            randomScenario(&scenarios[game]);
+        }
+        int failure = checkBatchGames(scenarios, count);
+        if (failure < 0) continue;
+
+        scenario = scenarios[failure];
+        printf("batch game from seed %llu differs, shrinking %d moves\n", (unsigned long long)(seed + first + failure), scenario.length);
+        shrinkScenario(&scenario, checkBatchScenario);
+        printScenario(&scenario);
+        checkBatchScenario(&scenario, true);
+        return 1;
+    }
+
+    printf("no difference in %llu positions\n", (unsigned long long)checked_positions);
+    return 0;
+}
@@ -67,11 +67,13 @@ int main(int argc, char **argv) {
 
     // get response from server
     int32_t message_type;
+    int32_t first_id = -1, second_id = -1; // the server bots take the first ids
     recv(sock, &message_type, sizeof(int32_t), 0);
     if (message_type == USER_REGISTRATION) {
         MessageUserRegistration msg;
         recv(sock, &msg, sizeof(msg), 0);
         printf("Server acknowledged user registration with id %d.\n", msg.user_id);
+        first_id = msg.user_id;
     } 
     else {
         printf("Server did not acknowledge user registration.\n");
@@ -95,6 +97,7 @@ int main(int argc, char **argv) {
         MessageUserRegistration msg;
         recv(sock2, &msg, sizeof(msg), 0);
         printf("Server acknowledged user registration with id %d.\n", msg.user_id);
+        second_id = msg.user_id;
     } 
     else {
         printf("Server did not acknowledge user registration.\n");
@@ -124,26 +127,28 @@ int main(int argc, char **argv) {
     recv(sock, &message_type, sizeof(int32_t), 0);
     if (message_type == SEND_USER_LIST) {
         int32_t usernames_count;
-        recv(sock, &usernames_count, sizeof(int32_t), 0);
-        char buffer[USERNAME_LENGTH];
+        int32_t entries_length;
+        recv(sock, &usernames_count, sizeof(int32_t), MSG_WAITALL);
+        recv(sock, &entries_length, sizeof(int32_t), MSG_WAITALL);
+        char* entries = malloc(entries_length);
+        recv(sock, entries, entries_length, MSG_WAITALL);
         printf("Users : \n");
+        size_t offset = 0;
         for (int i = 0; i < usernames_count; ++i) {
-            recv(sock, &buffer, sizeof(char)*USERNAME_LENGTH, 0);
-            printf(" - %s\n", buffer);
-        }
-        int32_t id;
-        printf("Corresponding ids : \n");
-        for (int i = 0; i < usernames_count; ++i) {
-            recv(sock, &id, sizeof(int32_t), 0);
-            printf(" - %d\n", id);
+            int32_t id;
+            char in_game;
+            char buffer[USERNAME_LENGTH];
+            offset += decodeUserListEntry(entries + offset, entries_length - offset, &id, &in_game, buffer);
+            printf(" - %s (id %d)\n", buffer, id);
         }
+        free(entries);
     }
     
     // try to create a game
     MessageMatchRequest req;
-    req.opponent_id = 1;
+    req.opponent_id = second_id;
     sendMessageMatchRequest(sock, req);
-    printf("sending match request from 0 to 1.\n");
+    printf("sending match request from %d to %d.\n", first_id, second_id);
 
     recv(sock2, &message_type, sizeof(int32_t), 0);
     if (message_type == MATCH_PROPOSITION) {
@@ -183,17 +188,21 @@ int main(int argc, char **argv) {
     sendMessageMatchResponse(sock2, true);
 
     recv(sock, &message_type, sizeof(int32_t), 0);
+    // snapshots are widened on the legacy wire, the bodies are decoded into their structs
+    char body[MAX_FRAME_LENGTH];
     MessageGameStart start_mes;
     if (message_type == GAME_START) {
         printf("player 0 received game start message.\n");
-        recv(sock, &start_mes, sizeof(start_mes), 0);
+        recv(sock, body, legacyBodyLength(GAME_START), MSG_WAITALL);
+        decodeLegacyBody(GAME_START, body, &start_mes);
     }
     else { printf("error: unexpected message %d\n", message_type); }
 
     recv(sock2, &message_type, sizeof(int32_t), 0);
     if (message_type == GAME_START) {
         printf("player 1 received game start message.\n");
-        recv(sock2, &start_mes, sizeof(start_mes), 0);
+        recv(sock2, body, legacyBodyLength(GAME_START), MSG_WAITALL);
+        decodeLegacyBody(GAME_START, body, &start_mes);
         printf("opponent name : %s\n", start_mes.opponent_username);
         simpleSnapshotPrinting(&start_mes.first_snapshot);
     }
@@ -209,7 +218,8 @@ int main(int argc, char **argv) {
     if (message_type==GAME_UPDATE) {
         printf("Game update from server received.\n");
         MessageGameUpdate mes;
-        recv(sock, &mes, sizeof(MessageGameUpdate), 0);
+        recv(sock, body, legacyBodyLength(GAME_UPDATE), MSG_WAITALL);
+        decodeLegacyBody(GAME_UPDATE, body, &mes);
         simpleSnapshotPrinting(&mes.snapshot);
     }
     else { printf("error: unexpected message %d\n", message_type); }
@@ -242,7 +252,7 @@ int main(int argc, char **argv) {
 
     // test observation
     MessageObserve message_observe;
-    message_observe.player_to_observe_id = 0;
+    message_observe.player_to_observe_id = first_id;
     sendMessageObserve(sock3, message_observe);
 
     recv(sock3, &message_type, sizeof(int32_t), 0);
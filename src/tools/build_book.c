@@ -0,0 +1,191 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/book.h"
+#include "../common/game_record.h"
+
+// executable building the opening book from game record files: the games written by selfplay, or the archive
+// of the games played on the server. The first plies of every game are replayed, each move adds the result of
+// the game for its player to the entry of its (position, house) pair; the entries are then sorted by key and
+// house, merged, and the moves played in too few games are left out.
+//
+// The entries are kept in one array, sorted and merged in place each time it is full, so memory grows with the
+// number of distinct (position, house) pairs, not with the number of games.
+
+#define DEFAULT_MAX_PLIES 20
+#define DEFAULT_MIN_GAMES 4
+#define DEFAULT_PATH "book.db"
+#define INITIAL_CAPACITY (1 << 16)
+
+static BookEntry* entries;
+static uint64_t entry_count;
+static uint64_t capacity;
+
+
+static int compareEntries(const void* a, const void* b) {
+    const BookEntry* x = a;
+    const BookEntry* y = b;
+    if (x->key != y->key) return (x->key < y->key) ? -1 : 1;
+    return (int)x->house - (int)y->house;
+}
+
+static void mergeEntries() {
+    // sorts the entries and adds up those of the same (position, house) pair
+    qsort(entries, entry_count, sizeof(BookEntry), compareEntries);
+    uint64_t merged = 0;
+    for (uint64_t i = 0; i < entry_count; ++i) {
+        if (merged > 0 && compareEntries(&entries[merged - 1], &entries[i]) == 0) {
+            entries[merged - 1].wins += entries[i].wins;
+            entries[merged - 1].draws += entries[i].draws;
+            entries[merged - 1].losses += entries[i].losses;
+        }
+        else entries[merged++] = entries[i];
+    }
+    entry_count = merged;
+}
+
+static bool addEntry(uint64_t key, int house, int outcome) {
+    if (entry_count == capacity) {
+        mergeEntries();
+        // grow only if merging freed less than half of the array
+        if (entry_count > capacity / 2) {
+            BookEntry* grown = realloc(entries, 2 * capacity * sizeof(BookEntry));
+            if (grown == NULL) return false;
+            entries = grown;
+            capacity *= 2;
+        }
+    }
+    BookEntry* entry = &entries[entry_count++];
+    memset(entry, 0, sizeof(BookEntry));
+    entry->key = key;
+    entry->house = house;
+    if (outcome > 0) entry->wins = 1;
+    else if (outcome == 0) entry->draws = 1;
+    else entry->losses = 1;
+    return true;
+}
+
+static int addGames(const char* path, int max_plies, uint64_t* games) {
+    // returns 0, or -1 if the file cannot be read, -2 if memory is exhausted and -3 if its games are not standard games
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return -1;
+    GameRecordFileHeader header;
+    if (!readGameRecordHeader(file, &header, NULL)) {
+        fclose(file);
+        return -1;
+    }
+    if (header.seeds_per_house != GAME_RECORD_SEEDS_PER_HOUSE) {
+        // games set up with fewer seeds never reach the positions of the server games
+        fclose(file);
+        return -3;
+    }
+
+    static uint8_t houses[GAME_RECORD_MAX_MOVES];
+    GameRecord record;
+    int status;
+    while ((status = readGameRecord(file, &record, houses)) == 1) {
+        GameSnapshot snapshot;
+        initialGameRecordSnapshot(header.seeds_per_house, &snapshot);
+
+        for (int ply = 0; ply < record.move_count && ply < max_plies && !isTerminal(&snapshot); ++ply) {
+            Side turn = snapshot.turn;
+            int outcome = (record.winner == NO_SIDE) ? 0 : (record.winner == turn) ? 1 : -1;
+            if (!addEntry(canonicalSnapshotHash(&snapshot), houses[ply] % 6, outcome)) {
+                fclose(file);
+                return -2;
+            }
+            if (playSnapshotMove(&snapshot, turn, houses[ply]) < 0) break; // corrupted game, its next moves are dropped
+        }
+        (*games)++;
+    }
+    fclose(file);
+    return (status < 0) ? -1 : 0;
+}
+
+static bool writeBook(const char* path, int max_plies, int min_games, uint64_t* written) {
+    // a running server maps the book: it is written next to it, then renamed over it, the mapping keeps the old file
+    char temporary_path[4096];
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", path) >= (int)sizeof(temporary_path)) return false;
+    FILE* file = fopen(temporary_path, "wb");
+    if (file == NULL) return false;
+
+    // the header is written again once the number of entries kept is known
+    BookHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BOOK_MAGIC, sizeof(header.magic));
+    header.max_plies = max_plies;
+    header.min_games = min_games;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (uint64_t i = 0; i < entry_count && ok; ++i) {
+        const BookEntry* entry = &entries[i];
+        if ((uint64_t)entry->wins + entry->draws + entry->losses < (uint64_t)min_games) continue;
+        ok = fwrite(entry, sizeof(BookEntry), 1, file) == 1;
+        header.entries++;
+    }
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    *written = header.entries;
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    ok = ok && rename(temporary_path, path) == 0;
+    if (!ok) unlink(temporary_path);
+    return ok;
+}
+
+
+int main(int argc, char **argv) {
+    int max_plies = DEFAULT_MAX_PLIES;
+    int min_games = DEFAULT_MIN_GAMES;
+    const char* output_path = DEFAULT_PATH;
+
+    bool usage = false;
+    int option;
+    while ((option = getopt(argc, argv, "p:m:o:")) != -1) {
+        switch (option) {
+        case 'p': max_plies = atoi(optarg); break;
+        case 'm': min_games = atoi(optarg); break;
+        case 'o': output_path = optarg; break;
+        default: usage = true;
+        }
+    }
+    if (usage || optind >= argc) {
+        printf("Usage: COMMAND [-p max plies] [-m min games] [-o book] games_file...\n");
+        exit(-1);
+    }
+    if (max_plies < 1) max_plies = 1;
+    if (min_games < 1) min_games = 1;
+
+    capacity = INITIAL_CAPACITY;
+    entries = malloc(capacity * sizeof(BookEntry));
+    if (entries == NULL) {
+        printf("Not enough memory\n");
+        exit(1);
+    }
+
+    uint64_t games = 0;
+    for (int i = optind; i < argc; ++i) {
+        int status = addGames(argv[i], max_plies, &games);
+        if (status == -1) printf("%s is not a game record file or is truncated, its complete games are used\n", argv[i]);
+        if (status == -3) printf("%s holds games set up with fewer seeds, it is skipped\n", argv[i]);
+        if (status == -2) {
+            printf("Not enough memory\n");
+            exit(1);
+        }
+    }
+    mergeEntries();
+
+    uint64_t written;
+    if (!writeBook(output_path, max_plies, min_games, &written)) {
+        printf("Cannot write %s\n", output_path);
+        exit(1);
+    }
+    printf("%llu games, %llu moves of %d plies at most, %llu played in %d games or more written to %s\n",
+        (unsigned long long)games, (unsigned long long)entry_count, max_plies, (unsigned long long)written,
+        min_games, output_path);
+    free(entries);
+    return 0;
+}
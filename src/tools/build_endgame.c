@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../common/endgame.h"
+
+// executable solving the endgame database of a game played with total_seeds seeds by retrograde analysis, layer
+// by layer of seeds left on the board: a capture leads to a layer already solved, a move without capture stays in
+// the layer being solved.
+//
+// Each layer is solved in steps: step d finds the positions won or lost in exactly d plies, which only depend on
+// positions of the layer found at earlier steps and on positions of the solved layers. A step never reads the
+// values it writes (they are d plies long), so the threads of a step share the layer without locks.
+// The positions still unsolved when no step can find more are draws: neither side can force the end of the game.
+
+#define DEFAULT_MAX_SEEDS 6
+#define DEFAULT_TOTAL_SEEDS 12 // one seed per house: with 48, no position in play has 6 seeds or fewer on the board
+#define DEFAULT_PATH "endgame.db"
+#define CHUNK_SIZE 4096 // positions taken at once by a thread
+
+static _Atomic uint8_t* values;
+
+// layer being solved, shared with the threads of a step
+static int layer_seeds;
+static uint64_t layer_offset;
+static uint64_t layer_boards;
+static uint64_t layer_size;
+static int layer_lowest_points;
+static int max_seeds;
+static int total_seeds;
+static int step;
+static atomic_uint_fast64_t next_chunk;
+static atomic_uint_fast64_t solved_positions;
+
+
+static void layerSnapshot(uint64_t position, GameSnapshot* snapshot) {
+    // position of the layer, from the point of view of the side to play (always BOTTOM)
+    memset(snapshot, 0, sizeof(GameSnapshot));
+    int points = layer_lowest_points + position / layer_boards;
+    endgameBoardUnrank(position % layer_boards, layer_seeds, &snapshot->board);
+    snapshot->turn = BOTTOM;
+    snapshot->points[BOTTOM] = points;
+    snapshot->points[TOP] = total_seeds - layer_seeds - points;
+}
+
+static int solvePosition(const GameSnapshot* snapshot) {
+    // value found at this step, ENDGAME_DRAW if the position stays unsolved
+    int moves = generateLegalMoves(snapshot);
+    if (moves == 0) {
+        if (step > 0) return ENDGAME_DRAW;
+        Side winner = whoHasWon(*snapshot);
+        return (winner == NO_SIDE) ? ENDGAME_DRAW : (winner == BOTTOM) ? ENDGAME_WIN(0) : ENDGAME_LOSS(0);
+    }
+
+    bool all_lost = true; // every move leads to a win of the other side found at an earlier step
+    while (moves) {
+        int house = __builtin_ctz(moves);
+        moves &= moves - 1;
+
+        GameSnapshot child;
+        if (applyMove(snapshot, house, &child) == 1) return (step == 1) ? ENDGAME_WIN(1) : ENDGAME_DRAW;
+
+        int value = atomic_load_explicit(&values[endgameIndex(&child, total_seeds, max_seeds)], memory_order_relaxed);
+        bool known = value != ENDGAME_DRAW && ENDGAME_PLIES(value) < step;
+        if (known && ENDGAME_IS_LOSS(value) && ENDGAME_PLIES(value) == step - 1) return ENDGAME_WIN(step);
+        if (!known || !ENDGAME_IS_WIN(value)) all_lost = false;
+    }
+    // the longest of the wins left to the other side is step - 1 plies long, or the position was solved earlier
+    return all_lost ? ENDGAME_LOSS(step) : ENDGAME_DRAW;
+}
+
+static void* solveWorker(void* arg) {
+    (void)arg;
+    uint64_t solved = 0;
+    uint64_t chunk;
+    while ((chunk = atomic_fetch_add(&next_chunk, 1)) * CHUNK_SIZE < layer_size) {
+        uint64_t end = (chunk + 1) * CHUNK_SIZE;
+        if (end > layer_size) end = layer_size;
+        for (uint64_t position = chunk * CHUNK_SIZE; position < end; ++position) {
+            if (atomic_load_explicit(&values[layer_offset + position], memory_order_relaxed) != ENDGAME_DRAW) continue;
+
+            GameSnapshot snapshot;
+            layerSnapshot(position, &snapshot);
+            int value = solvePosition(&snapshot);
+            if (value == ENDGAME_DRAW) continue;
+            atomic_store_explicit(&values[layer_offset + position], value, memory_order_relaxed);
+            solved++;
+        }
+    }
+    atomic_fetch_add(&solved_positions, solved);
+    return NULL;
+}
+
+static uint64_t solveStep(int thread_count) {
+    // runs step on the whole layer, returns the number of positions solved
+    atomic_store(&next_chunk, 0);
+    atomic_store(&solved_positions, 0);
+    pthread_t threads[thread_count];
+    for (int i = 0; i < thread_count; ++i) pthread_create(&threads[i], NULL, solveWorker, NULL);
+    for (int i = 0; i < thread_count; ++i) pthread_join(threads[i], NULL);
+    return atomic_load(&solved_positions);
+}
+
+static int longestResult(uint64_t from, uint64_t to) {
+    int longest = 0;
+    for (uint64_t i = from; i < to; ++i) {
+        int value = atomic_load_explicit(&values[i], memory_order_relaxed);
+        if (value != ENDGAME_DRAW && ENDGAME_PLIES(value) > longest) longest = ENDGAME_PLIES(value);
+    }
+    return longest;
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char **argv) {
+    if (argc > 5) {
+        printf("Usage: COMMAND [max_seeds] [total_seeds] [threads] [path]\n");
+        exit(-1);
+    }
+    max_seeds = (argc > 1) ? atoi(argv[1]) : DEFAULT_MAX_SEEDS;
+    total_seeds = (argc > 2) ? atoi(argv[2]) : DEFAULT_TOTAL_SEEDS;
+    int thread_count = (argc > 3) ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char* path = (argc > 4) ? argv[4] : DEFAULT_PATH;
+    if (max_seeds < 0 || max_seeds > ENDGAME_MAX_SEEDS) {
+        printf("max_seeds must be between 0 and %d\n", ENDGAME_MAX_SEEDS);
+        exit(-1);
+    }
+    if (total_seeds < 1 || total_seeds > 48) {
+        printf("total_seeds must be between 1 and 48\n");
+        exit(-1);
+    }
+    if (thread_count < 1) thread_count = 1;
+
+    uint64_t positions = endgameLayerOffset(total_seeds, max_seeds + 1);
+    values = calloc(positions, 1);
+    if (values == NULL) {
+        printf("Cannot allocate %llu positions\n", (unsigned long long)positions);
+        exit(-1);
+    }
+    printf("solving %llu positions with up to %d of %d seeds on the board on %d threads\n",
+        (unsigned long long)positions, max_seeds, total_seeds, thread_count);
+
+    double start = now();
+    for (layer_seeds = 0; layer_seeds <= max_seeds; ++layer_seeds) {
+        layer_offset = endgameLayerOffset(total_seeds, layer_seeds);
+        layer_boards = endgameBoardCount(layer_seeds);
+        layer_size = endgamePointClasses(total_seeds, layer_seeds) * layer_boards;
+        layer_lowest_points = endgameLowestPoints(total_seeds, layer_seeds);
+
+        // a capture can lead to a solved position up to this many plies from the end, keep stepping until then
+        int longest_below = longestResult(0, layer_offset);
+        uint64_t solved = 0;
+        for (step = 0; ; ++step) {
+            if (step > ENDGAME_MAX_PLIES) {
+                printf("a result is longer than %d plies, it cannot be stored\n", ENDGAME_MAX_PLIES);
+                exit(-1);
+            }
+            uint64_t found = solveStep(thread_count);
+            solved += found;
+            if (found == 0 && step > longest_below) break;
+        }
+        printf("%2d seeds: %10llu positions, %10llu draws, %3d steps, longest %3d plies, %.1f s\n",
+            layer_seeds, (unsigned long long)layer_size, (unsigned long long)(layer_size - solved), step,
+            longestResult(layer_offset, layer_offset + layer_size), now() - start);
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("fopen");
+        exit(-1);
+    }
+    EndgameHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ENDGAME_MAGIC, sizeof(header.magic));
+    header.max_seeds = max_seeds;
+    header.total_seeds = total_seeds;
+    header.positions = positions;
+    if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite((uint8_t*)values, 1, positions, file) != positions) {
+        perror("fwrite");
+        exit(-1);
+    }
+    fclose(file);
+    printf("%s written (%llu bytes)\n", path, (unsigned long long)(sizeof(header) + positions));
+
+    free(values);
+    return 0;
+}
@@ -0,0 +1,433 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../common/engine.h"
+#include "../common/mcts.h"
+#include "../common/game_record.h"
+
+// executable playing the bot engines against each other: a round robin (every pair of players) or a gauntlet
+// (the first player against each of the others), the games being spread over threads. It reports the score
+// of every pairing, an Elo estimate of every player and the time each one spent per move, and can write the
+// games to a game record file.
+//
+// A run only depends on its seed, not on the threads or the machine: each pair of games starts with a few
+// random moves drawn from the seed, then is played twice with the colours swapped; the engines search with node
+// or playout budgets only, MCTS playouts are seeded, and each side gets its own transposition table, cleared
+// before every game. Two runs of the same engines and seed give the same games, so an engine change can be
+// measured both in speed (time per move) and in strength (score against the unchanged engines).
+//
+// The games can be set up with fewer seeds in each house than the standard 4, so that they reach the positions
+// of an endgame database built for that number of seeds (build_endgame, src/tools).
+
+#define DEFAULT_GAMES 20            // per pairing
+#define DEFAULT_OPENING_PLIES 4     // random moves starting each pair of games
+#define DEFAULT_SEED 1
+#define MAX_SEEDS_PER_HOUSE 4       // the hash keys of a house only hold the 48 seeds of the standard game
+#define DEFAULT_PLAYERS "easy medium hard mcts"
+#define MAX_PLAYERS 16
+#define MAX_GAME_PLIES 400          // longer games are given to the player with the most points
+#define TABLE_SIZE_LOG2 18          // per side and thread, as the server bots
+#define DEFAULT_PLAYOUTS 15000      // budget of an mcts player, as bot_mcts
+#define ELO_ITERATIONS 200
+
+typedef enum PlayerEngine {
+    ENGINE_RANDOM = 0,
+    ENGINE_ALPHA_BETA,
+    ENGINE_MCTS,
+} PlayerEngine;
+
+typedef struct Player {
+    const char* name;       // as given on the command line
+    PlayerEngine engine;
+    EngineLimits limits;    // of an alpha-beta player
+    uint64_t playouts;      // of an MCTS player
+} Player;
+
+typedef struct GameTask {
+    uint8_t players[2];     // indices of the players of BOTTOM and TOP
+    uint64_t seed;          // same for both games of a pair
+    GameRecord record;
+    uint8_t houses[MAX_GAME_PLIES];
+    uint64_t think_ns[2];   // thread CPU time spent choosing moves, per side
+    int moves[2];           // moves chosen by the engine of each side, the random opening excluded
+    int endgame_moves[2];   // of those, moves read from the endgame database
+} GameTask;
+
+typedef struct Worker {
+    pthread_t thread;
+    TranspositionTable* tables[2]; // one per side
+    MctsTree* tree;
+} Worker;
+
+static Player players[MAX_PLAYERS];
+static int player_count;
+static int opening_plies = DEFAULT_OPENING_PLIES;
+static int seeds_per_house = GAME_RECORD_SEEDS_PER_HOUSE;
+
+static GameTask* tasks;
+static int task_count;
+static atomic_int next_task;
+
+
+static uint64_t mix(uint64_t x) {
+    // splitmix64 finalizer, spreads consecutive seeds over the whole range
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static int randomMove(const GameSnapshot* snapshot, uint64_t* random_state) {
+    *random_state = mix(*random_state);
+    int moves = generateLegalMoves(snapshot);
+    for (int skip = *random_state % __builtin_popcount(moves); skip > 0; --skip) moves &= moves - 1;
+    return ((snapshot->turn == TOP) ? 6 : 0) + __builtin_ctz(moves);
+}
+
+static uint64_t threadTime() {
+    struct timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static int chooseMove(Worker* worker, const Player* player, const GameSnapshot* snapshot, uint64_t* random_state, int ply,
+    bool* from_endgame) {
+    switch (player->engine) {
+    case ENGINE_ALPHA_BETA: {
+        EngineResult result = searchBestMove(snapshot, &player->limits, worker->tables[snapshot->turn]);
+        *from_endgame = result.from_endgame;
+        return result.house;
+    }
+    case ENGINE_MCTS: {
+        MctsLimits limits = { player->playouts, 0, 1, mix(*random_state + ply) | 1 };
+        return searchMcts(snapshot, &limits, worker->tree).house;
+    }
+    default:
+        return randomMove(snapshot, random_state);
+    }
+}
+
+static void playGame(Worker* worker, GameTask* task) {
+    GameSnapshot snapshot;
+    initialGameRecordSnapshot(seeds_per_house, &snapshot);
+    clearTranspositionTable(worker->tables[BOTTOM]);
+    clearTranspositionTable(worker->tables[TOP]);
+
+    uint64_t random_state = task->seed;
+    int ply = 0;
+    while (ply < MAX_GAME_PLIES && !isTerminal(&snapshot)) {
+        Side turn = snapshot.turn;
+        int house;
+        if (ply < opening_plies) house = randomMove(&snapshot, &random_state);
+        else {
+            uint64_t start = threadTime();
+            bool from_endgame = false;
+            house = chooseMove(worker, &players[task->players[turn]], &snapshot, &random_state, ply, &from_endgame);
+            task->think_ns[turn] += threadTime() - start;
+            task->moves[turn]++;
+            task->endgame_moves[turn] += from_endgame;
+        }
+        task->houses[ply++] = house;
+        if (playSnapshotMove(&snapshot, turn, house) == 1) break;
+    }
+
+    task->record.move_count = ply;
+    task->record.players[BOTTOM] = task->players[BOTTOM];
+    task->record.players[TOP] = task->players[TOP];
+    task->record.points[BOTTOM] = snapshot.points[BOTTOM];
+    task->record.points[TOP] = snapshot.points[TOP];
+    task->record.unused = 0;
+    if (isTerminal(&snapshot)) task->record.winner = whoHasWon(snapshot);
+    else if (snapshot.points[BOTTOM] == snapshot.points[TOP]) task->record.winner = NO_SIDE;
+    else task->record.winner = (snapshot.points[BOTTOM] > snapshot.points[TOP]) ? BOTTOM : TOP;
+}
+
+static void* workerThread(void* arg) {
+    Worker* worker = arg;
+    int index;
+    while ((index = atomic_fetch_add(&next_task, 1)) < task_count) playGame(worker, &tasks[index]);
+    return NULL;
+}
+
+static bool parsePlayer(const char* argument, Player* player) {
+    // name[:budget], the budget being nodes for alpha-beta and playouts for mcts
+    static const char* const levels[BOT_LEVEL_COUNT] = { "easy", "medium", "hard" };
+    char name[16];
+    const char* colon = strchr(argument, ':');
+    size_t length = colon ? (size_t)(colon - argument) : strlen(argument);
+    if (length >= sizeof(name)) return false;
+    memcpy(name, argument, length);
+    name[length] = '\0';
+    long long budget = colon ? atoll(colon + 1) : 0;
+    if (colon && budget <= 0) return false;
+
+    player->name = argument;
+    if (strcmp(name, "random") == 0) {
+        player->engine = ENGINE_RANDOM;
+        return colon == NULL;
+    }
+    if (strcmp(name, "mcts") == 0) {
+        player->engine = ENGINE_MCTS;
+        player->playouts = colon ? (uint64_t)budget : DEFAULT_PLAYOUTS;
+        return true;
+    }
+    for (int level = 0; level < BOT_LEVEL_COUNT; ++level) {
+        if (strcmp(name, levels[level]) != 0) continue;
+        player->engine = ENGINE_ALPHA_BETA;
+        player->limits = botLevelLimits(level);
+        player->limits.max_time_ms = 0; // a time limit would make the games depend on the machine load
+        if (colon) player->limits.max_nodes = budget;
+        return true;
+    }
+    return false;
+}
+
+static double eloDifference(double score) {
+    // Elo difference giving this expected score, bounded for scores of 0 and 1
+    if (score < 0.001) score = 0.001;
+    if (score > 0.999) score = 0.999;
+    return 400 * log10(score / (1 - score));
+}
+
+static void printResults(int games_per_pairing, double elapsed) {
+    // points[i][j]: score of i against j, a draw counting as half a game
+    static double points[MAX_PLAYERS][MAX_PLAYERS];
+    static int games[MAX_PLAYERS][MAX_PLAYERS];
+    static int outcomes[MAX_PLAYERS][MAX_PLAYERS][3]; // wins, draws, losses of i against j
+    uint64_t think_ns[MAX_PLAYERS] = { 0 };
+    uint64_t moves[MAX_PLAYERS] = { 0 };
+    uint64_t total_moves = 0;
+    uint64_t endgame_moves = 0;
+
+    for (int t = 0; t < task_count; ++t) {
+        const GameTask* task = &tasks[t];
+        total_moves += task->record.move_count;
+        for (int side = 0; side < 2; ++side) {
+            int player = task->players[side], opponent = task->players[1 - side];
+            think_ns[player] += task->think_ns[side];
+            moves[player] += task->moves[side];
+            endgame_moves += task->endgame_moves[side];
+            games[player][opponent]++;
+            int outcome = (task->record.winner == NO_SIDE) ? 1 : (task->record.winner == side) ? 0 : 2;
+            outcomes[player][opponent][outcome]++;
+            points[player][opponent] += (outcome == 0) ? 1 : (outcome == 1) ? 0.5 : 0;
+        }
+    }
+
+    printf("\n%-33s %6s %6s %6s %6s %7s %14s\n", "pairing", "games", "wins", "draws", "losses", "score", "elo");
+    for (int i = 0; i < player_count; ++i) {
+        for (int j = i + 1; j < player_count; ++j) {
+            int n = games[i][j];
+            if (n == 0) continue;
+            // 95% interval from the spread of the results of one game
+            double score = points[i][j] / n;
+            double square = (outcomes[i][j][0] + 0.25 * outcomes[i][j][1]) / n;
+            double margin = 1.96 * sqrt(fmax(square - score * score, 0) / n);
+            printf("%-16s - %-14s %6d %6d %6d %6d %6.1f%% %+6.0f +- %-4.0f\n", players[i].name, players[j].name, n,
+                outcomes[i][j][0], outcomes[i][j][1], outcomes[i][j][2], 100 * score, eloDifference(score),
+                (eloDifference(fmin(score + margin, 1)) - eloDifference(fmax(score - margin, 0))) / 2);
+        }
+    }
+
+    // Bradley-Terry ratings by minorization-maximization, with one virtual draw per pairing played,
+    // so that a player that won or lost every game keeps a finite rating
+    double strength[MAX_PLAYERS];
+    for (int i = 0; i < player_count; ++i) strength[i] = 1;
+    for (int iteration = 0; iteration < ELO_ITERATIONS; ++iteration) {
+        double log_sum = 0;
+        for (int i = 0; i < player_count; ++i) {
+            double score = 0, weight = 0;
+            for (int j = 0; j < player_count; ++j) {
+                if (games[i][j] == 0) continue;
+                score += points[i][j] + 0.5;
+                weight += (games[i][j] + 1) / (strength[i] + strength[j]);
+            }
+            if (weight > 0) strength[i] = score / weight;
+            log_sum += log(strength[i]);
+        }
+        double mean = exp(log_sum / player_count);
+        for (int i = 0; i < player_count; ++i) strength[i] /= mean;
+    }
+
+    printf("\n%-16s %6s %7s %6s %10s\n", "player", "games", "score", "elo", "ms/move");
+    for (int i = 0; i < player_count; ++i) {
+        int n = 0;
+        double score = 0;
+        for (int j = 0; j < player_count; ++j) {
+            n += games[i][j];
+            score += points[i][j];
+        }
+        printf("%-16s %6d %6.1f%% %+6.0f %10.3f\n", players[i].name, n, n ? 100 * score / n : 0,
+            400 * log10(strength[i]), moves[i] ? think_ns[i] / 1e6 / moves[i] : 0);
+    }
+    printf("\n%d games (%d per pairing), %llu moves in %.1f s: %.1f games/s\n", task_count, games_per_pairing,
+        (unsigned long long)total_moves, elapsed, task_count / elapsed);
+    if (endgame_moves > 0) printf("%llu moves read from the endgame database\n", (unsigned long long)endgame_moves);
+}
+
+static bool writeGames(const char* path, uint64_t seed) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return false;
+    const char* names[MAX_PLAYERS];
+    for (int i = 0; i < player_count; ++i) names[i] = players[i].name;
+    bool ok = writeGameRecordHeader(file, seed, seeds_per_house, player_count, names);
+    for (int t = 0; t < task_count && ok; ++t) ok = writeGameRecord(file, &tasks[t].record, tasks[t].houses);
+    return fclose(file) == 0 && ok;
+}
+
+static double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char **argv) {
+    int games_per_pairing = DEFAULT_GAMES;
+    int thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = DEFAULT_SEED;
+    const char* output_path = NULL;
+    const char* endgame_path = NULL;
+    bool gauntlet = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:t:s:p:b:o:e:g")) != -1) {
+        switch (option) {
+        case 'n': games_per_pairing = atoi(optarg); break;
+        case 't': thread_count = atoi(optarg); break;
+        case 's': seed = strtoull(optarg, NULL, 10); break;
+        case 'p': opening_plies = atoi(optarg); break;
+        case 'b': seeds_per_house = atoi(optarg); break;
+        case 'o': output_path = optarg; break;
+        case 'e': endgame_path = optarg; break;
+        case 'g': gauntlet = true; break;
+        default:
+            printf("Usage: COMMAND [-n games] [-t threads] [-s seed] [-p opening plies] [-b seeds per house] "
+                "[-o games file] [-e endgame database] [-g] [player...]\n");
+            printf("players: random, easy, medium, hard or mcts, with an optional budget (hard:500000, mcts:30000)\n");
+            exit(-1);
+        }
+    }
+    if (games_per_pairing < 1) games_per_pairing = 1;
+    if (thread_count < 1) thread_count = 1;
+    if (opening_plies < 0) opening_plies = 0;
+    if (seeds_per_house < 1 || seeds_per_house > MAX_SEEDS_PER_HOUSE) {
+        printf("The seeds per house must be between 1 and %d\n", MAX_SEEDS_PER_HOUSE);
+        exit(-1);
+    }
+
+    // players from the command line, or the server bots
+    static char default_players[] = DEFAULT_PLAYERS;
+    char* names[MAX_PLAYERS];
+    int name_count = 0;
+    if (optind < argc) {
+        for (int i = optind; i < argc && name_count < MAX_PLAYERS; ++i) names[name_count++] = argv[i];
+    }
+    else {
+        for (char* name = strtok(default_players, " "); name != NULL && name_count < MAX_PLAYERS; name = strtok(NULL, " ")) {
+            names[name_count++] = name;
+        }
+    }
+    for (int i = 0; i < name_count; ++i) {
+        if (!parsePlayer(names[i], &players[player_count])) {
+            printf("Unknown player %s\n", names[i]);
+            exit(-1);
+        }
+        player_count++;
+    }
+    if (player_count < 2) {
+        printf("At least two players are needed\n");
+        exit(-1);
+    }
+
+    EndgameDatabase* endgame = NULL;
+    if (endgame_path != NULL) {
+        endgame = openEndgameDatabase(endgame_path);
+        if (endgame == NULL) {
+            printf("Cannot read the endgame database %s\n", endgame_path);
+            exit(1);
+        }
+        if (endgame->total_seeds != 12 * seeds_per_house) {
+            // its positions would never be reached
+            printf("The endgame database %s is built for games of %d seeds, not %d\n", endgame_path,
+                endgame->total_seeds, 12 * seeds_per_house);
+            exit(1);
+        }
+        setEndgameDatabase(endgame);
+    }
+
+    // every pairing plays the same openings: game g uses the seed of pair g / 2, with the colours swapped
+    int pairings = gauntlet ? player_count - 1 : player_count * (player_count - 1) / 2;
+    task_count = pairings * games_per_pairing;
+    tasks = calloc(task_count, sizeof(GameTask));
+    if (tasks == NULL) {
+        printf("Not enough memory for %d games\n", task_count);
+        exit(1);
+    }
+    int t = 0;
+    for (int i = 0; i < player_count; ++i) {
+        for (int j = i + 1; j < player_count; ++j) {
+            if (gauntlet && i > 0) continue;
+            for (int g = 0; g < games_per_pairing; ++g) {
+                tasks[t].players[BOTTOM] = (g % 2) ? j : i;
+                tasks[t].players[TOP] = (g % 2) ? i : j;
+                tasks[t].seed = mix(seed ^ mix(g / 2));
+                t++;
+            }
+        }
+    }
+
+    uint64_t max_playouts = 0;
+    for (int i = 0; i < player_count; ++i) {
+        if (players[i].engine == ENGINE_MCTS && players[i].playouts > max_playouts) max_playouts = players[i].playouts;
+    }
+    if (thread_count > task_count) thread_count = task_count;
+    Worker workers[thread_count];
+    for (int i = 0; i < thread_count; ++i) {
+        workers[i].tables[BOTTOM] = createTranspositionTable(TABLE_SIZE_LOG2);
+        workers[i].tables[TOP] = createTranspositionTable(TABLE_SIZE_LOG2);
+        workers[i].tree = createMctsTree(MCTS_TREE_CAPACITY(max_playouts));
+        if (workers[i].tables[BOTTOM] == NULL || workers[i].tables[TOP] == NULL || workers[i].tree == NULL) {
+            printf("Not enough memory for %d threads\n", thread_count);
+            exit(1);
+        }
+    }
+
+    printf("selfplay: %d players, %s, %d games per pairing, %d opening plies, %d seeds per house, seed %llu, %d threads\n",
+        player_count, gauntlet ? "gauntlet" : "round robin", games_per_pairing, opening_plies, seeds_per_house,
+        (unsigned long long)seed, thread_count);
+    double start = now();
+    atomic_store(&next_task, 0);
+    for (int i = 1; i < thread_count; ++i) pthread_create(&workers[i].thread, NULL, workerThread, &workers[i]);
+    workerThread(&workers[0]);
+    for (int i = 1; i < thread_count; ++i) pthread_join(workers[i].thread, NULL);
+    double elapsed = now() - start;
+
+    printResults(games_per_pairing, elapsed);
+    int status = 0;
+    if (output_path != NULL) {
+        if (writeGames(output_path, seed)) printf("games written to %s\n", output_path);
+        else {
+            printf("Cannot write %s\n", output_path);
+            status = 1;
+        }
+    }
+
+    for (int i = 0; i < thread_count; ++i) {
+        freeTranspositionTable(workers[i].tables[BOTTOM]);
+        freeTranspositionTable(workers[i].tables[TOP]);
+        freeMctsTree(workers[i].tree);
+    }
+    free(tasks);
+    setEndgameDatabase(NULL);
+    closeEndgameDatabase(endgame);
+    return status;
+}